@@ -68,10 +68,15 @@
  *    document tags must be a non-colliding set (see matching rules).
  *
  * 5. The input/output features of the c library produced by hddm-c
- *    are implemented using the xdr binary i/o library written originally
- *    by Sun Microsystems.  This library provides basic serialization/
- *    deserialization of binary data using network byte-ordering
- *    (RFC-1832) and is a part of many unix installations.
+ *    use the xdr binary encoding defined originally by Sun Microsystems,
+ *    which serializes binary data using network byte-ordering (RFC-1832).
+ *    The encoding is generated inline on the i/o buffer, so the c library
+ *    no longer depends on the rpc xdr library being installed.
+ *
+ * 6. Compressed and crc-checked streams are handled with zlib and libbz2
+ *    directly, using the same size-prefixed block framing as the xstream
+ *    codecs of the c++ library, so the generated c library must also be
+ *    linked with -lz -lbz2.
  */
 
 #define MAX_POPLIST_LENGTH 99
@@ -91,6 +96,7 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 #include <fstream>
 #include <sstream>
 
@@ -147,6 +153,9 @@ class CodeBuilder
    void constructGroup(DOMElement* el);
    void constructConstructors();
    void constructUnpackers();
+   void writeFixedRun(std::vector<std::pair<XtString,XtString> >& run,
+                      int decode, const char* indent);
+   void constructStreamFuncs();
    void constructReadFunc(DOMElement* topEl);
    void constructSkipFunc();
    void constructPackers();
@@ -155,6 +164,7 @@ class CodeBuilder
    void constructOpenFunc(DOMElement* el);
    void constructInitFunc(DOMElement* el);
    void constructCloseFunc(DOMElement* el);
+   void constructReaderFuncs();
    void constructDocument(DOMElement* el);
 
  private:
@@ -422,7 +432,11 @@ int main(int argC, char* argV[])
          << "   return 0;"                                      << std::endl
          << "}"                                                 << std::endl
          << "#endif"                                            << std::endl
-         << "#include <rpc/xdr.h>"                              << std::endl
+         << "#include <stdint.h>"                               << std::endl
+         << "#ifndef HDDM_BOOL_T"                               << std::endl
+         << "#define HDDM_BOOL_T"                               << std::endl
+         << "typedef int bool_t;"                               << std::endl
+         << "#endif"                                            << std::endl
          << "#include <string.h>"                               << std::endl
          << "#ifndef _WIN32"                                    << std::endl
          << "static inline int "
@@ -487,6 +501,16 @@ int main(int argC, char* argV[])
                                                                 << std::endl
          << "#include \"" << hname << "\""                      << std::endl
          << "#include <assert.h>"                               << std::endl
+         << "#include <zlib.h>"                                 << std::endl
+         << "#include <bzlib.h>"                                << std::endl
+         << "#include <pthread.h>"                              << std::endl
+         << "#ifndef _WIN32"                                    << std::endl
+         << "#include <sys/mman.h>"                             << std::endl
+         << "#include <sys/stat.h>"                             << std::endl
+         << "#else"                                             << std::endl
+         << "#define fseeko _fseeki64"                          << std::endl
+         << "#define ftello _ftelli64"                          << std::endl
+         << "#endif"                                            << std::endl
                                                                 << std::endl
          << "int hddm_" + classPrefix + "_buffersize = 1000000;"
                                                                 << std::endl
@@ -494,6 +518,7 @@ int main(int argC, char* argV[])
                                                                 << std::endl
          << "int hddm_" + classPrefix + "_headersize = 1000000;"
                                                                 << std::endl
+         << "int hddm_" + classPrefix + "_poolsize = 0;"        << std::endl
                                                                 << std::endl
          << "void set_" + classPrefix + "_HDDM_buffersize(int size)"
                                                                 << std::endl
@@ -526,6 +551,17 @@ int main(int argC, char* argV[])
          << "int get_" + classPrefix + "_HDDM_headersize()"     << std::endl
          << "{"                                                 << std::endl
          << "   return hddm_" + classPrefix + "_headersize;"    << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "void set_" + classPrefix + "_HDDM_poolsize(int size)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   hddm_" + classPrefix + "_poolsize = size;"      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "int get_" + classPrefix + "_HDDM_poolsize()"       << std::endl
+         << "{"                                                 << std::endl
+         << "   return hddm_" + classPrefix + "_poolsize;"      << std::endl
          << "}"                                                 << std::endl
                                                                 << std::endl
          << "static int XDRerror()"                             << std::endl
@@ -537,6 +573,225 @@ int main(int argC, char* argV[])
          << "   \" buffers or maximum string size.\\n\");"      << std::endl
          << "   exit(9);"                                       << std::endl
          << "   return 0;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "/* When hddm_" << classPrefix << "_poolsize is set to a nonzero value, each call to"
+                                                                << std::endl
+         << " * make_" << classPrefix << "_HDDM() opens a new memory pool for that record, and the"
+                                                                << std::endl
+         << " * structs made after it in the same thread are carved out of the"
+                                                                << std::endl
+         << " * pool rather than being malloc'ed one at a time. The whole pool is"
+                                                                << std::endl
+         << " * released at once when the record is flushed. Strings are always"
+                                                                << std::endl
+         << " * malloc'ed, and are freed individually as before."
+                                                                << std::endl
+         << " */"                                               << std::endl
+                                                                << std::endl
+         << "#ifndef HDDM_THREAD_LOCAL"                         << std::endl
+         << "# if defined _WIN32"                               << std::endl
+         << "#  define HDDM_THREAD_LOCAL __declspec(thread)"    << std::endl
+         << "# else"                                            << std::endl
+         << "#  define HDDM_THREAD_LOCAL __thread"              << std::endl
+         << "# endif"                                           << std::endl
+         << "#endif"                                            << std::endl
+                                                                << std::endl
+         << "typedef struct hddm_pool_chunk_s {"                << std::endl
+         << "   struct hddm_pool_chunk_s* next;"                << std::endl
+         << "   size_t size;"                                   << std::endl
+         << "   size_t used;"                                   << std::endl
+         << "} hddm_pool_chunk_t;"                              << std::endl
+                                                                << std::endl
+         << "struct hddm_pool_s {"                              << std::endl
+         << "   hddm_pool_chunk_t* chunks;"                     << std::endl
+         << "};"                                                << std::endl
+                                                                << std::endl
+         << "#define HDDM_POOL_ALIGN 16"                        << std::endl
+         << "#ifndef HDDM_POOL_SPARES"                          << std::endl
+         << "#define HDDM_POOL_SPARES 8"                        << std::endl
+         << "#endif"                                            << std::endl
+         << "#define HDDM_POOL_HEADER ((sizeof(hddm_pool_chunk_t) + HDDM_POOL_ALIGN - 1) \\"
+                                                                << std::endl
+         << "                          & ~(size_t)(HDDM_POOL_ALIGN - 1))"
+                                                                << std::endl
+                                                                << std::endl
+         << "static HDDM_THREAD_LOCAL struct hddm_pool_s* hddm_" << classPrefix << "_pool = 0;"
+                                                                << std::endl
+         << "static HDDM_THREAD_LOCAL hddm_pool_chunk_t* hddm_" << classPrefix << "_spare_chunks = 0;"
+                                                                << std::endl
+         << "static HDDM_THREAD_LOCAL int hddm_" << classPrefix << "_spare_count = 0;"
+                                                                << std::endl
+                                                                << std::endl
+         << "#if ! defined MALLOC_FREE_WITH_MEMCHECK"           << std::endl
+         << "static pthread_key_t hddm_" << classPrefix << "_spare_key;"
+                                                                << std::endl
+         << "static pthread_once_t hddm_" << classPrefix << "_spare_once = PTHREAD_ONCE_INIT;"
+                                                                << std::endl
+                                                                << std::endl
+         << "static void spare_chunks_free(void* spares)"       << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Runs as a thread that kept spare chunks exits */"
+                                                                << std::endl
+         << "   hddm_pool_chunk_t** head = (hddm_pool_chunk_t**)spares;"
+                                                                << std::endl
+         << "   while (*head)"                                  << std::endl
+         << "   {"                                              << std::endl
+         << "      hddm_pool_chunk_t* chunk = *head;"           << std::endl
+         << "      *head = chunk->next;"                        << std::endl
+         << "      FREE(chunk);"                                << std::endl
+         << "   }"                                              << std::endl
+         << "   hddm_" << classPrefix << "_spare_count = 0;"    << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static void spare_key_create()"                    << std::endl
+         << "{"                                                 << std::endl
+         << "   pthread_key_create(&hddm_" << classPrefix << "_spare_key,"
+                                                                << std::endl
+         << "                      spare_chunks_free);"         << std::endl
+         << "}"                                                 << std::endl
+         << "#endif"                                            << std::endl
+                                                                << std::endl
+         << "static struct hddm_pool_s* pool_open()"            << std::endl
+         << "{"                                                 << std::endl
+         << "   struct hddm_pool_s* pool = 0;"                  << std::endl
+         << "   if (hddm_" << classPrefix << "_poolsize > 0)"   << std::endl
+         << "   {"                                              << std::endl
+         << "      pool = (struct hddm_pool_s*)MALLOC(sizeof(struct hddm_pool_s),"
+                                                                << std::endl
+         << "                                         \"hddm_pool_s\");"
+                                                                << std::endl
+         << "      pool->chunks = 0;"                           << std::endl
+         << "   }"                                              << std::endl
+         << "   hddm_" << classPrefix << "_pool = pool;"        << std::endl
+         << "   return pool;"                                   << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static void* pool_alloc(size_t size, char* what)"  << std::endl
+         << "{"                                                 << std::endl
+         << "   struct hddm_pool_s* pool = hddm_" << classPrefix << "_pool;"
+                                                                << std::endl
+         << "   hddm_pool_chunk_t* chunk;"                      << std::endl
+         << "   char* p;"                                       << std::endl
+         << "   (void)what;"                                    << std::endl
+         << "   if (pool == 0)"                                 << std::endl
+         << "   {"                                              << std::endl
+         << "      return MALLOC(size,what);"                   << std::endl
+         << "   }"                                              << std::endl
+         << "   size = (size + HDDM_POOL_ALIGN - 1) & ~(size_t)(HDDM_POOL_ALIGN - 1);"
+                                                                << std::endl
+         << "   chunk = pool->chunks;"                          << std::endl
+         << "   if (chunk == 0 || chunk->used + size > chunk->size)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      size_t csize = (size_t)hddm_" << classPrefix << "_poolsize;"
+                                                                << std::endl
+         << "      while ((chunk = hddm_" << classPrefix << "_spare_chunks) != 0 && chunk->size != csize)"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         hddm_" << classPrefix << "_spare_chunks = chunk->next;"
+                                                                << std::endl
+         << "         --hddm_" << classPrefix << "_spare_count;"
+                                                                << std::endl
+         << "         FREE(chunk);"                             << std::endl
+         << "      }"                                           << std::endl
+         << "      if (chunk != 0 && size <= csize)"            << std::endl
+         << "      {"                                           << std::endl
+         << "         hddm_" << classPrefix << "_spare_chunks = chunk->next;"
+                                                                << std::endl
+         << "         --hddm_" << classPrefix << "_spare_count;"
+                                                                << std::endl
+         << "      }"                                           << std::endl
+         << "      else"                                        << std::endl
+         << "      {"                                           << std::endl
+         << "         csize = (size > csize)? size : csize;"    << std::endl
+         << "         chunk = (hddm_pool_chunk_t*)MALLOC(HDDM_POOL_HEADER + csize,"
+                                                                << std::endl
+         << "                                            \"hddm_pool_chunk_t\");"
+                                                                << std::endl
+         << "         chunk->size = csize;"                     << std::endl
+         << "      }"                                           << std::endl
+         << "      chunk->next = pool->chunks;"                 << std::endl
+         << "      chunk->used = 0;"                            << std::endl
+         << "      pool->chunks = chunk;"                       << std::endl
+         << "   }"                                              << std::endl
+         << "   p = (char*)chunk + HDDM_POOL_HEADER + chunk->used;"
+                                                                << std::endl
+         << "   chunk->used += size;"                           << std::endl
+         << "   return p;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static void pool_free(struct hddm_pool_s* pool, void* p)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Frees p unless it was carved out of the given pool */"
+                                                                << std::endl
+         << "   hddm_pool_chunk_t* chunk;"                      << std::endl
+         << "   for (chunk = (pool)? pool->chunks : 0; chunk; chunk = chunk->next)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      char* base = (char*)chunk + HDDM_POOL_HEADER;"
+                                                                << std::endl
+         << "      if ((char*)p >= base && (char*)p < base + chunk->size)"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         return;"                                  << std::endl
+         << "      }"                                           << std::endl
+         << "   }"                                              << std::endl
+         << "   FREE(p);"                                       << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static void pool_release(struct hddm_pool_s* pool)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Up to HDDM_POOL_SPARES chunks of the standard size are kept for"
+                                                                << std::endl
+         << "    * reuse by the next pool opened in this thread, and are freed by"
+                                                                << std::endl
+         << "    * a thread-specific key destructor when the thread exits. In"
+                                                                << std::endl
+         << "    * memcheck builds they are all freed right away so that"
+                                                                << std::endl
+         << "    * checkpoint() does not report them as leaks."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   while (pool->chunks)"                           << std::endl
+         << "   {"                                              << std::endl
+         << "      hddm_pool_chunk_t* chunk = pool->chunks;"    << std::endl
+         << "      pool->chunks = chunk->next;"                 << std::endl
+         << "#if ! defined MALLOC_FREE_WITH_MEMCHECK"           << std::endl
+         << "      if (chunk->size == (size_t)hddm_" << classPrefix << "_poolsize &&"
+                                                                << std::endl
+         << "          hddm_" << classPrefix << "_spare_count < HDDM_POOL_SPARES)"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         if (hddm_" << classPrefix << "_spare_chunks == 0)"
+                                                                << std::endl
+         << "         {"                                        << std::endl
+         << "            pthread_once(&hddm_" << classPrefix << "_spare_once,"
+                                                                << std::endl
+         << "                         spare_key_create);"       << std::endl
+         << "            pthread_setspecific(hddm_" << classPrefix << "_spare_key,"
+                                                                << std::endl
+         << "                                &hddm_" << classPrefix << "_spare_chunks);"
+                                                                << std::endl
+         << "         }"                                        << std::endl
+         << "         chunk->next = hddm_" << classPrefix << "_spare_chunks;"
+                                                                << std::endl
+         << "         hddm_" << classPrefix << "_spare_chunks = chunk;"
+                                                                << std::endl
+         << "         ++hddm_" << classPrefix << "_spare_count;"
+                                                                << std::endl
+         << "         continue;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "#endif"                                            << std::endl
+         << "      FREE(chunk);"                                << std::endl
+         << "   }"                                              << std::endl
+         << "   if (hddm_" << classPrefix << "_pool == pool)"   << std::endl
+         << "   {"                                              << std::endl
+         << "      hddm_" << classPrefix << "_pool = 0;"        << std::endl
+         << "   }"                                              << std::endl
+         << "   FREE(pool);"                                    << std::endl
          << "}"                                                 << std::endl;
 
    builder.constructGroup(rootEl);
@@ -575,8 +830,29 @@ int main(int argC, char* argV[])
          << "#define HDDM_STREAM_INPUT -91"                     << std::endl
          << "#define HDDM_STREAM_OUTPUT -92"                    << std::endl
                                                                 << std::endl
+         << "#define HDDM_BITS_COMPRESSION 0xf0"                << std::endl
+         << "#define HDDM_NO_COMPRESSION 0x00"                  << std::endl
+         << "#define HDDM_Z_COMPRESSION 0x10"                   << std::endl
+         << "#define HDDM_BZ2_COMPRESSION 0x20"                 << std::endl
+         << "#define HDDM_BITS_INTEGRITY 0x0f"                  << std::endl
+         << "#define HDDM_NO_INTEGRITY 0x00"                    << std::endl
+         << "#define HDDM_CRC32_INTEGRITY 0x01"                 << std::endl
+         << "#define HDDM_CAN_REPOSITION 0x100"                 << std::endl
+                                                                << std::endl
+         << "#define HDDM_READ_STDIO 0"                         << std::endl
+         << "#define HDDM_READ_USER 1"                          << std::endl
+         << "#define HDDM_READ_OWNED 2"                         << std::endl
+         << "#define HDDM_READ_MMAP 3"                          << std::endl
+                                                                << std::endl
+         << "typedef struct {"                                  << std::endl
+         << "   char* x_base;"                                  << std::endl
+         << "   char* x_ptr;"                                   << std::endl
+         << "   char* x_end;"                                   << std::endl
+         << "} hddm_xdr_t;"                                     << std::endl
+                                                                << std::endl
          << "struct popNode_s {"                                << std::endl
-         << "   void* (*unpacker)(XDR*, struct popNode_s*);"    << std::endl
+         << "   void* (*unpacker)(hddm_xdr_t*, struct popNode_s*);"
+                                                                << std::endl
          << "   int inParent;"                                  << std::endl
          << "   int popListLength;"                             << std::endl
          << "   struct popNode_s* popList["
@@ -589,10 +865,23 @@ int main(int argC, char* argV[])
          << "   int iomode;"                                    << std::endl
          << "   int lerrno;"                                    << std::endl
          << "   char* filename;"                                << std::endl
-         << "   XDR* xdrs;"                                     << std::endl
+         << "   hddm_xdr_t* xdrs;"                              << std::endl
          << "   popNode* popTop;"                               << std::endl
          << "   char* iobuffer;"                                << std::endl
          << "   int iobuffer_size;"                             << std::endl
+         << "   int status_bits;"                               << std::endl
+         << "   void* codec;"                                   << std::endl
+         << "   char* cbuffer;"                                 << std::endl
+         << "   int cbuffer_size;"                              << std::endl
+         << "   char* dbuffer;"                                 << std::endl
+         << "   int dbuffer_size;"                              << std::endl
+         << "   int dbuffer_len;"                               << std::endl
+         << "   int dbuffer_pos;"                               << std::endl
+         << "   char* rbuffer;"                                 << std::endl
+         << "   size_t rbuffer_size;"                           << std::endl
+         << "   size_t rbuffer_len;"                            << std::endl
+         << "   size_t rbuffer_pos;"                            << std::endl
+         << "   int rbuffer_mode;"                              << std::endl
          << "} " << classPrefix << "_iostream_t;"               << std::endl
                                                                 << std::endl
          << "#endif /* HDDM_STREAM_INPUT */"                    << std::endl;
@@ -603,22 +892,174 @@ int main(int argC, char* argV[])
          << "# define _LARGEFILE64_SOURCE 1"                    << std::endl
          << "#endif"                                            << std::endl
                                                                 << std::endl
-         << "static off_t xdr_getpos64(XDR *xdrs)"              << std::endl
+         << "/* The record contents are xdr-encoded inline, directly on the memory"
+                                                                << std::endl
+         << " * buffer, rather than through the rpc xdr library. All items are"
+                                                                << std::endl
+         << " * big-endian and padded to a multiple of 4 bytes (RFC-1832)."
+                                                                << std::endl
+         << " */"                                               << std::endl
+                                                                << std::endl
+         << "static inline void hxdr_create(hddm_xdr_t* xdrs, char* buf, int size)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   xdrs->x_base = buf;"                            << std::endl
+         << "   xdrs->x_ptr = buf;"                             << std::endl
+         << "   xdrs->x_end = buf + size;"                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline off_t hxdr_getpos(hddm_xdr_t* xdrs)" << std::endl
+         << "{"                                                 << std::endl
+         << "   return xdrs->x_ptr - xdrs->x_base;"             << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline int hxdr_setpos(hddm_xdr_t* xdrs, off_t pos)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   if (pos < 0 || pos > xdrs->x_end - xdrs->x_base)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   xdrs->x_ptr = xdrs->x_base + pos;"              << std::endl
+         << "   return 1;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "/* The unchecked get and put calls below leave it to the caller to"
+                                                                << std::endl
+         << " * verify that the buffer has room, so that a run of fixed-size items"
+                                                                << std::endl
+         << " * can be covered by a single bounds check."       << std::endl
+         << " */"                                               << std::endl
+                                                                << std::endl
+         << "static inline unsigned int hxdr_get32(hddm_xdr_t* xdrs)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   unsigned char* p = (unsigned char*)xdrs->x_ptr;"
+                                                                << std::endl
+         << "   xdrs->x_ptr += 4;"                              << std::endl
+         << "   return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |"
+                                                                << std::endl
+         << "          ((unsigned int)p[2] << 8) | (unsigned int)p[3];"
+                                                                << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline uint64_t hxdr_get64(hddm_xdr_t* xdrs)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   uint64_t hi = hxdr_get32(xdrs);"                << std::endl
+         << "   return (hi << 32) | hxdr_get32(xdrs);"          << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline float hxdr_getf(hddm_xdr_t* xdrs)"   << std::endl
+         << "{"                                                 << std::endl
+         << "   union { uint32_t u; float f; } v;"              << std::endl
+         << "   v.u = hxdr_get32(xdrs);"                        << std::endl
+         << "   return v.f;"                                    << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline double hxdr_getd(hddm_xdr_t* xdrs)"  << std::endl
+         << "{"                                                 << std::endl
+         << "   union { uint64_t u; double d; } v;"             << std::endl
+         << "   v.u = hxdr_get64(xdrs);"                        << std::endl
+         << "   return v.d;"                                    << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline void hxdr_put32(hddm_xdr_t* xdrs, unsigned int value)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   unsigned char* p = (unsigned char*)xdrs->x_ptr;"
+                                                                << std::endl
+         << "   p[0] = (unsigned char)(value >> 24);"           << std::endl
+         << "   p[1] = (unsigned char)(value >> 16);"           << std::endl
+         << "   p[2] = (unsigned char)(value >> 8);"            << std::endl
+         << "   p[3] = (unsigned char)value;"                   << std::endl
+         << "   xdrs->x_ptr += 4;"                              << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline void hxdr_put64(hddm_xdr_t* xdrs, uint64_t value)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   hxdr_put32(xdrs,(unsigned int)(value >> 32));"  << std::endl
+         << "   hxdr_put32(xdrs,(unsigned int)value);"          << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline void hxdr_putf(hddm_xdr_t* xdrs, float value)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   union { uint32_t u; float f; } v;"              << std::endl
+         << "   v.f = value;"                                   << std::endl
+         << "   hxdr_put32(xdrs,v.u);"                          << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline void hxdr_putd(hddm_xdr_t* xdrs, double value)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   union { uint64_t u; double d; } v;"             << std::endl
+         << "   v.d = value;"                                   << std::endl
+         << "   hxdr_put64(xdrs,v.u);"                          << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline int hxdr_get_u_int(hddm_xdr_t* xdrs, unsigned int* value)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   if (xdrs->x_end - xdrs->x_ptr < 4)"             << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   *value = hxdr_get32(xdrs);"                     << std::endl
+         << "   return 1;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline int hxdr_put_u_int(hddm_xdr_t* xdrs, unsigned int value)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   if (xdrs->x_end - xdrs->x_ptr < 4)"             << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   hxdr_put32(xdrs,value);"                        << std::endl
+         << "   return 1;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static inline int hxdr_get_string(hddm_xdr_t* xdrs, char** sp, unsigned int maxsize)"
+                                                                << std::endl
          << "{"                                                 << std::endl
-         << "   if (xdrs->x_base == 0) {"                       << std::endl
-         << "      return ftello((FILE *)xdrs->x_private);"     << std::endl
+         << "   unsigned int size;"                             << std::endl
+         << "   size_t padded;"                                 << std::endl
+         << "   if (! hxdr_get_u_int(xdrs,&size) || size > maxsize)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   padded = ((size_t)size + 3) & ~(size_t)3;"      << std::endl
+         << "   if ((size_t)(xdrs->x_end - xdrs->x_ptr) < padded)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
          << "   }"                                              << std::endl
-         << "   off_t pos = xdr_getpos(xdrs);"                  << std::endl
-         << "   return pos;"                                    << std::endl
+         << "   *sp = (char*)malloc(size + 1);"                 << std::endl
+         << "   memcpy(*sp,xdrs->x_ptr,size);"                  << std::endl
+         << "   (*sp)[size] = 0;"                               << std::endl
+         << "   xdrs->x_ptr += padded;"                         << std::endl
+         << "   return 1;"                                      << std::endl
          << "}"                                                 << std::endl
                                                                 << std::endl
-         << "static bool_t xdr_setpos64(XDR *xdrs, off_t pos) " << std::endl
-         << "{ "                                                << std::endl
-         << "   if (xdrs->x_base == 0) {"                       << std::endl
-         << "      return ((fseeko((FILE *)xdrs->x_private, pos, 0) < 0)? FALSE : TRUE);"
+         << "static inline int hxdr_put_string(hddm_xdr_t* xdrs, char* s, unsigned int maxsize)"
                                                                 << std::endl
+         << "{"                                                 << std::endl
+         << "   size_t size = strlen(s);"                       << std::endl
+         << "   size_t padded = (size + 3) & ~(size_t)3;"       << std::endl
+         << "   if (size > maxsize || (size_t)(xdrs->x_end - xdrs->x_ptr) < padded + 4)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
          << "   }"                                              << std::endl
-         << "   return xdr_setpos(xdrs,(int)pos);"              << std::endl
+         << "   hxdr_put32(xdrs,(unsigned int)size);"           << std::endl
+         << "   memcpy(xdrs->x_ptr,s,size);"                    << std::endl
+         << "   memset(xdrs->x_ptr + size,0,padded - size);"    << std::endl
+         << "   xdrs->x_ptr += padded;"                         << std::endl
+         << "   return 1;"                                      << std::endl
          << "}"                                                 << std::endl;
 
    builder.constructUnpackers();
@@ -636,13 +1077,18 @@ int main(int argC, char* argV[])
          << "int get_" + classPrefix + "_HDDM_stringsize();"    << std::endl
          << "void set_" + classPrefix + "_HDDM_headersize(int size);"
                                                                 << std::endl
-         << "int get_" + classPrefix + "_HDDM_headersize();"    << std::endl;
+         << "int get_" + classPrefix + "_HDDM_headersize();"    << std::endl
+         << "void set_" + classPrefix + "_HDDM_poolsize(int size);"
+                                                                << std::endl
+         << "int get_" + classPrefix + "_HDDM_poolsize();"      << std::endl;
+   builder.constructStreamFuncs();
    builder.constructReadFunc(rootEl);
    builder.constructSkipFunc();
    builder.constructFlushFunc(rootEl);
    builder.constructOpenFunc(rootEl);
    builder.constructInitFunc(rootEl);
    builder.constructCloseFunc(rootEl);
+   builder.constructReaderFuncs();
    builder.hFile                                                << std::endl
          << "#ifdef __cplusplus"                                << std::endl
          << "}"                                                 << std::endl
@@ -901,6 +1347,11 @@ void CodeBuilder::writeHeader(DOMElement* el)
       }
    }
 
+   if (tagS == "HDDM")
+   {
+      hFile << "   struct hddm_pool_s*  pool;" << std::endl;
+   }
+
    hFile << "} " << ctypeDef << ";" << std::endl;
 
    XtString repS(el->getAttribute(X("maxOccurs")));
@@ -985,7 +1436,7 @@ void CodeBuilder::constructConstructors()
                << "   int size = sizeof(" << listType
                << ") + rep * sizeof(" << simpleType << ");"     << std::endl
                << "   " << listType
-               << "* p = (" << listType << "*)MALLOC(size,\""
+               << "* p = (" << listType << "*)pool_alloc(size,\""
                << listType << "\");"                            << std::endl
                << "   p->mult = 0;"                             << std::endl
                << "   for (i=0; i<n; i++) {"                    << std::endl
@@ -1058,10 +1509,19 @@ void CodeBuilder::constructConstructors()
          hFile << "();"                                         << std::endl;
          cFile << "()"                                          << std::endl
                << "{"                                           << std::endl
-               << "   int size = sizeof(" << simpleType << ");" << std::endl
-               << "   " << simpleType << "* p = "
-               << "(" << simpleType << "*)MALLOC(size,\""
+               << "   int size = sizeof(" << simpleType << ");" << std::endl;
+         if (tagS == "HDDM")
+         {
+            cFile << "   struct hddm_pool_s* pool = pool_open();"
+                                                                << std::endl;
+         }
+         cFile << "   " << simpleType << "* p = "
+               << "(" << simpleType << "*)pool_alloc(size,\""
                << simpleType << "\");"                          << std::endl;
+         if (tagS == "HDDM")
+         {
+            cFile << "   p->pool = pool;"                       << std::endl;
+         }
          DOMNamedNodeMap* varList = tagEl->getAttributes();
          size_t varCount = varList->getLength();
          for (int v = 0; v < varCount; v++)
@@ -1123,54 +1583,139 @@ void CodeBuilder::constructConstructors()
    }
 }
 
-/* Generate c functions for unpacking binary stream into c-structures */
+/* Generate inline xdr code to unpack (decode=1) or pack (decode=0) a run
+ * of consecutive fixed-size attributes, with one bounds check on the i/o
+ * buffer for the whole run; the run is emptied on return.
+ */
 
-void CodeBuilder::constructUnpackers()
+void CodeBuilder::writeFixedRun(std::vector<std::pair<XtString,XtString> >& run,
+                                int decode, const char* indent)
 {
-   cFile << std::endl;
-   std::vector<DOMElement*>::iterator iter;
-   for (iter = tagList.begin(); iter != tagList.end(); iter++)
+   if (run.size() == 0)
    {
-      DOMElement* tagEl = *iter;
-      XtString tagS(tagEl->getTagName());
-      XtString listType = tagS.listType();
-      XtString simpleType = tagS.simpleType();
-
-      cFile << std::endl << "static ";
-
-      XtString tagType;
-      XtString repS = tagEl->getAttribute(X("maxOccurs"));
-      int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
-      if (rep > 1)
-      {
-         tagType = tagS.listType();
-      }
-      else
-      {
-         tagType = tagS.simpleType();
-      }
-      XtString tagT(tagType);
-      tagT.erase(tagT.rfind('_'));
-      cFile << tagType << "* unpack_" << tagT
-            << "(XDR* xdrs, popNode* pop)"
+      return;
+   }
+   int bytes = 0;
+   std::vector<std::pair<XtString,XtString> >::iterator iter;
+   for (iter = run.begin(); iter != run.end(); ++iter)
+   {
+      bytes += (iter->first == "long" || iter->first == "double")? 8 : 4;
+   }
+   cFile << indent << "if (xdrs->x_end - xdrs->x_ptr < " << bytes << ")"
                                                                 << std::endl
-            << "{"                                              << std::endl
-            << "   " << tagType << "* this1 = (" << tagType
-            << "*)HDDM_NULL;"                                   << std::endl
-            << "   unsigned int size;"                          << std::endl
-            << "   if (! xdr_u_int(xdrs,&size))"                << std::endl
-            << "   {"                                           << std::endl
+         << indent << "   XDRerror();"                          << std::endl;
+   for (iter = run.begin(); iter != run.end(); ++iter)
+   {
+      XtString typeS(iter->first);
+      XtString nameStr(iter->second);
+      if (decode)
+      {
+         cFile << indent << "this1->" << nameStr << " = ";
+         if (typeS == "int")
+         {
+            cFile << "(int32_t)hxdr_get32(xdrs);"               << std::endl;
+         }
+         else if (typeS == "long")
+         {
+            cFile << "(int64_t)hxdr_get64(xdrs);"               << std::endl;
+         }
+         else if (typeS == "float")
+         {
+            cFile << "hxdr_getf(xdrs);"                         << std::endl;
+         }
+         else if (typeS == "double")
+         {
+            cFile << "hxdr_getd(xdrs);"                         << std::endl;
+         }
+         else if (typeS == "boolean")
+         {
+            cFile << "(hxdr_get32(xdrs) != 0);"                 << std::endl;
+         }
+         else if (typeS == "Particle_t")
+         {
+            cFile << "(Particle_t)hxdr_get32(xdrs);"            << std::endl;
+         }
+      }
+      else
+      {
+         if (typeS == "int" || typeS == "Particle_t")
+         {
+            cFile << indent << "hxdr_put32(xdrs,(unsigned int)this1->"
+                  << nameStr << ");"                            << std::endl;
+         }
+         else if (typeS == "long")
+         {
+            cFile << indent << "hxdr_put64(xdrs,(uint64_t)this1->"
+                  << nameStr << ");"                            << std::endl;
+         }
+         else if (typeS == "float")
+         {
+            cFile << indent << "hxdr_putf(xdrs,this1->"
+                  << nameStr << ");"                            << std::endl;
+         }
+         else if (typeS == "double")
+         {
+            cFile << indent << "hxdr_putd(xdrs,this1->"
+                  << nameStr << ");"                            << std::endl;
+         }
+         else if (typeS == "boolean")
+         {
+            cFile << indent << "hxdr_put32(xdrs,(this1->"
+                  << nameStr << " != 0));"                      << std::endl;
+         }
+      }
+   }
+   run.clear();
+}
+
+/* Generate c functions for unpacking binary stream into c-structures */
+
+void CodeBuilder::constructUnpackers()
+{
+   cFile << std::endl;
+   std::vector<DOMElement*>::iterator iter;
+   for (iter = tagList.begin(); iter != tagList.end(); iter++)
+   {
+      DOMElement* tagEl = *iter;
+      XtString tagS(tagEl->getTagName());
+      XtString listType = tagS.listType();
+      XtString simpleType = tagS.simpleType();
+
+      cFile << std::endl << "static ";
+
+      XtString tagType;
+      XtString repS = tagEl->getAttribute(X("maxOccurs"));
+      int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
+      if (rep > 1)
+      {
+         tagType = tagS.listType();
+      }
+      else
+      {
+         tagType = tagS.simpleType();
+      }
+      XtString tagT(tagType);
+      tagT.erase(tagT.rfind('_'));
+      cFile << tagType << "* unpack_" << tagT
+            << "(hddm_xdr_t* xdrs, popNode* pop)"
+                                                                << std::endl
+            << "{"                                              << std::endl
+            << "   " << tagType << "* this1 = (" << tagType
+            << "*)HDDM_NULL;"                                   << std::endl
+            << "   unsigned int size;"                          << std::endl
+            << "   if (! hxdr_get_u_int(xdrs,&size))"           << std::endl
+            << "   {"                                           << std::endl
             << "       return this1;"                           << std::endl
             << "   }"                                           << std::endl
             << "   else if (size > 0)"                          << std::endl
             << "   {"                                           << std::endl
-            << "      off_t start = xdr_getpos64(xdrs);"        << std::endl;
+            << "      off_t start = hxdr_getpos(xdrs);"         << std::endl;
 
       if (rep > 1)
       {
          cFile << "      unsigned int m;"                       << std::endl
                << "      unsigned int mult;"                    << std::endl
-               << "      if (! xdr_u_int(xdrs,&mult))"          << std::endl
+               << "      if (! hxdr_get_u_int(xdrs,&mult))"     << std::endl
                << "         XDRerror();"                        << std::endl;
          cFile << "      this1 = make_" << tagT << "(mult);"    << std::endl;
 
@@ -1206,6 +1751,7 @@ void CodeBuilder::constructUnpackers()
       }
 
       DOMNamedNodeMap* attList = tagEl->getAttributes();
+      std::vector<std::pair<XtString,XtString> > run;
       for (unsigned int a = 0; a < attList->getLength(); a++)
       {
          DOMNode* att = attList->item(a);
@@ -1216,79 +1762,18 @@ void CodeBuilder::constructUnpackers()
          {
             nameStr = "in[m]." + nameS;
          }
-         if (typeS == "int")
+         if (typeS == "int" || typeS == "long" ||
+             typeS == "float" || typeS == "double" ||
+             typeS == "boolean" || typeS == "Particle_t")
          {
-            cFile << "         if (! xdr_int(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "            XDRerror();"                  << std::endl;
+            run.push_back(std::pair<XtString,XtString>(typeS,nameStr));
          }
-         else if (typeS == "long")
-         {
-            cFile << "#ifndef XDR_LONGLONG_MISSING"             << std::endl
-                  << "         if (! xdr_longlong_t(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "            XDRerror();"                  << std::endl
-                  << "#else"                                    << std::endl
-                  << "         {"                               << std::endl
-                  << "            int* " << nameStr << "_ = "
-                  << "(int*)&this1->" << nameStr << ";"         << std::endl
-                  << "# if __BIG_ENDIAN__"                      << std::endl
-                  << "            if (! xdr_int(xdrs,&"
-                  << nameStr << "_[0]))"                        << std::endl
-                  << "               XDRerror();"               << std::endl
-                  << "            if (! xdr_int(xdrs,&"
-                  << nameStr << "_[1]))"                        << std::endl
-                  << "               XDRerror();"               << std::endl
-                  << "# else"                                   << std::endl
-                  << "            if (! xdr_int(xdrs,&"
-                  << nameStr << "_[1]))"                        << std::endl
-                  << "               XDRerror();"               << std::endl
-                  << "            if (! xdr_int(xdrs,&"
-                  << nameStr << "_[0]))"                        << std::endl
-                  << "               XDRerror();"               << std::endl
-                  << "# endif"                                  << std::endl
-                  << "         }"                               << std::endl
-                  << "#endif"                                   << std::endl;
-         }
-         else if (typeS == "float")
-         {
-            cFile << "         if (! xdr_float(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "            XDRerror();"                  << std::endl;
-         }
-         else if (typeS == "double")
-         {
-            cFile << "         if (! xdr_double(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "            XDRerror();"                  << std::endl;
-         }
-         else if (typeS == "boolean")
-         {
-            cFile << "         if (! xdr_bool(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "            XDRerror();"                  << std::endl;
-         }
-         else if (typeS == "Particle_t")
-         {
-            cFile << "         if (! xdr_int(xdrs,(int*)&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "            XDRerror();"                  << std::endl;
-         }
-         else if (typeS == "string")
+         else if (typeS == "string" || typeS == "anyURI")
          {
+            writeFixedRun(run,1,"         ");
             cFile << "         this1->" << nameStr << " = 0;"   << std::endl
-                  << "         if (! xdr_string(xdrs, &this1->"
-                  << nameStr << ", hddm_" + classPrefix
-                  << "_stringsize))"                            << std::endl
-                  << "            XDRerror();"                  << std::endl;
-            cFile << "      CHECK(this1->" << nameStr << ","
-                  << "\"string_t\");"                           << std::endl;
-         }
-         else if (typeS == "anyURI")
-         {
-            cFile << "         this1->" << nameStr << " = 0;"   << std::endl
-                  << "         if (! xdr_string(xdrs, &this1->"
-                  << nameStr << ", hddm_" + classPrefix
+                  << "         if (! hxdr_get_string(xdrs,&this1->"
+                  << nameStr << ",hddm_" + classPrefix
                   << "_stringsize))"                            << std::endl
                   << "            XDRerror();"                  << std::endl;
             cFile << "      CHECK(this1->" << nameStr << ","
@@ -1299,6 +1784,7 @@ void CodeBuilder::constructUnpackers()
             /* ignore attributes with unrecognized values */
          }
       }
+      writeFixedRun(run,1,"         ");
 
       if (hasContents)
       {
@@ -1314,21 +1800,785 @@ void CodeBuilder::constructUnpackers()
                << "            else"                            << std::endl
                << "            {"                               << std::endl
                << "               unsigned int skip;"           << std::endl
-               << "               if (! xdr_u_int(xdrs,&skip))" << std::endl
+               << "               if (! hxdr_get_u_int(xdrs,&skip))"
+                                                                << std::endl
                << "                  XDRerror();"               << std::endl
-               << "               xdr_setpos64(xdrs,xdr_getpos64(xdrs)+skip);"
+               << "               hxdr_setpos(xdrs,hxdr_getpos(xdrs)+skip);"
                                                                 << std::endl
                << "            }"                               << std::endl
                << "         }"                                  << std::endl;
       }
       cFile << "      }"                                        << std::endl
-            << "      xdr_setpos64(xdrs,start+size);"           << std::endl
+            << "      hxdr_setpos(xdrs,start+size);"            << std::endl
             << "   }"                                           << std::endl
             << "   return this1;"                               << std::endl
             << "}"                                              << std::endl;
    }
 }
 
+/* Generate c functions that move bytes between the i/o buffer and the
+ * file, through the z or bz2 block codecs when compression is enabled.
+ * The block framing and stream modifier tokens follow the same format
+ * as the c++ library, so streams written by either can be read by both.
+ */
+
+void CodeBuilder::constructStreamFuncs()
+{
+   hFile
+         << "int set_" << classPrefix << "_HDDM_compression(" << classPrefix << "_iostream_t* fp, int flags);"
+                                                                << std::endl
+         << "int get_" << classPrefix << "_HDDM_compression(" << classPrefix << "_iostream_t* fp);"
+                                                                << std::endl
+         << "int set_" << classPrefix << "_HDDM_integrity(" << classPrefix << "_iostream_t* fp, int flags);"
+                                                                << std::endl
+         << "int get_" << classPrefix << "_HDDM_integrity(" << classPrefix << "_iostream_t* fp);"
+                                                                << std::endl
+         << "int set_" << classPrefix << "_HDDM_readbuffer(" << classPrefix << "_iostream_t* fp, char* buffer, int size);"
+                                                                << std::endl
+         << "int map_" << classPrefix << "_HDDM(" << classPrefix << "_iostream_t* fp);"
+                                                                << std::endl;
+
+   cFile
+         << "static void set_stream_bits(" << classPrefix << "_iostream_t* fp, int bits)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   int oldcmp = fp->status_bits & HDDM_BITS_COMPRESSION;"
+                                                                << std::endl
+         << "   int newcmp = bits & HDDM_BITS_COMPRESSION;"     << std::endl
+         << "   if (oldcmp != newcmp)"                          << std::endl
+         << "   {"                                              << std::endl
+         << "      if (oldcmp == HDDM_Z_COMPRESSION)"           << std::endl
+         << "      {"                                           << std::endl
+         << "         if (fp->iomode == HDDM_STREAM_INPUT)"     << std::endl
+         << "            inflateEnd((z_stream*)fp->codec);"     << std::endl
+         << "         else"                                     << std::endl
+         << "            deflateEnd((z_stream*)fp->codec);"     << std::endl
+         << "      }"                                           << std::endl
+         << "      free(fp->codec);"                            << std::endl
+         << "      fp->codec = 0;"                              << std::endl
+         << "      if (newcmp == HDDM_Z_COMPRESSION)"           << std::endl
+         << "      {"                                           << std::endl
+         << "         z_stream* zs = (z_stream*)calloc(1,sizeof(z_stream));"
+                                                                << std::endl
+         << "         if (fp->iomode == HDDM_STREAM_INPUT)"     << std::endl
+         << "            inflateInit(zs);"                      << std::endl
+         << "         else"                                     << std::endl
+         << "            deflateInit(zs,Z_DEFAULT_COMPRESSION);"
+                                                                << std::endl
+         << "         fp->codec = zs;"                          << std::endl
+         << "      }"                                           << std::endl
+         << "      else if (newcmp == HDDM_BZ2_COMPRESSION)"    << std::endl
+         << "      {"                                           << std::endl
+         << "         fp->codec = calloc(1,sizeof(bz_stream));" << std::endl
+         << "      }"                                           << std::endl
+         << "      else if (newcmp != HDDM_NO_COMPRESSION)"     << std::endl
+         << "      {"                                           << std::endl
+         << "         fprintf(stderr,\"hddm error - \""         << std::endl
+         << "         \"unsupported compression format found in hddm stream, \""
+                                                                << std::endl
+         << "         \"cannot continue.\\n\");"                << std::endl
+         << "         exit(9);"                                 << std::endl
+         << "      }"                                           << std::endl
+         << "      fp->dbuffer_len = 0;"                        << std::endl
+         << "      fp->dbuffer_pos = 0;"                        << std::endl
+         << "   }"                                              << std::endl
+         << "   fp->status_bits = bits;"                        << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static int need_buffer(char** buf, int* size, int needed)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   if (needed > *size)"                            << std::endl
+         << "   {"                                              << std::endl
+         << "      int newsize = (*size > 0)? *size : 0x10000;" << std::endl
+         << "      while (newsize < needed)"                    << std::endl
+         << "         newsize *= 2;"                            << std::endl
+         << "      *buf = (char*)realloc(*buf,newsize);"        << std::endl
+         << "      *size = newsize;"                            << std::endl
+         << "   }"                                              << std::endl
+         << "   return *size;"                                  << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static size_t raw_read(" << classPrefix << "_iostream_t* fp, char* buf, size_t count)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Reads bytes from the input file, through the read buffer or"
+                                                                << std::endl
+         << "    * memory map if one has been set up on this stream."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   size_t got = 0;"                                << std::endl
+         << "   if (fp->rbuffer == 0)"                          << std::endl
+         << "   {"                                              << std::endl
+         << "      return fread(buf,1,count,fp->fd);"           << std::endl
+         << "   }"                                              << std::endl
+         << "   while (got < count)"                            << std::endl
+         << "   {"                                              << std::endl
+         << "      size_t n = fp->rbuffer_len - fp->rbuffer_pos;"
+                                                                << std::endl
+         << "      if (n == 0)"                                 << std::endl
+         << "      {"                                           << std::endl
+         << "         if (fp->rbuffer_mode == HDDM_READ_MMAP)"  << std::endl
+         << "            break;"                                << std::endl
+         << "         fp->rbuffer_len = fread(fp->rbuffer,1,fp->rbuffer_size,fp->fd);"
+                                                                << std::endl
+         << "         fp->rbuffer_pos = 0;"                     << std::endl
+         << "         if (fp->rbuffer_len == 0)"                << std::endl
+         << "            break;"                                << std::endl
+         << "         continue;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "      n = (n < count - got)? n : count - got;"     << std::endl
+         << "      memcpy(buf + got,fp->rbuffer + fp->rbuffer_pos,n);"
+                                                                << std::endl
+         << "      fp->rbuffer_pos += n;"                       << std::endl
+         << "      got += n;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   return got;"                                    << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static size_t raw_skip(" << classPrefix << "_iostream_t* fp, size_t count)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Advances the input file by count bytes without reading them"
+                                                                << std::endl
+         << "    * where possible, returns the number of bytes skipped."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   size_t skipped = 0;"                            << std::endl
+         << "   if (fp->rbuffer != 0)"                          << std::endl
+         << "   {"                                              << std::endl
+         << "      size_t n = fp->rbuffer_len - fp->rbuffer_pos;"
+                                                                << std::endl
+         << "      if (count <= n || fp->rbuffer_mode == HDDM_READ_MMAP)"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         n = (n < count)? n : count;"              << std::endl
+         << "         fp->rbuffer_pos += n;"                    << std::endl
+         << "         return n;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "      fp->rbuffer_pos = fp->rbuffer_len;"          << std::endl
+         << "      skipped = n;"                                << std::endl
+         << "   }"                                              << std::endl
+         << "   if (fseeko(fp->fd,count - skipped,SEEK_CUR) == 0)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return count;"                               << std::endl
+         << "   }"                                              << std::endl
+         << "   while (skipped < count)"                        << std::endl
+         << "   {"                                              << std::endl
+         << "      size_t n = count - skipped;"                 << std::endl
+         << "      n = (n < (size_t)fp->iobuffer_size)? n : (size_t)fp->iobuffer_size;"
+                                                                << std::endl
+         << "      n = fread(fp->iobuffer,1,n,fp->fd);"         << std::endl
+         << "      if (n == 0)"                                 << std::endl
+         << "         break;"                                   << std::endl
+         << "      skipped += n;"                               << std::endl
+         << "   }"                                              << std::endl
+         << "   return skipped;"                                << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static int read_block(" << classPrefix << "_iostream_t* fp)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Reads the next compressed block from the input file and"
+                                                                << std::endl
+         << "    * expands it into dbuffer, returns 0 at end of input."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   static unsigned char z_header[2] = {0x78, 0x9c};"
+                                                                << std::endl
+         << "   unsigned char prefix[4];"                       << std::endl
+         << "   unsigned int size;"                             << std::endl
+         << "   char* block;"                                   << std::endl
+         << "   if (raw_read(fp,(char*)prefix,4) != 4)"         << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   else if (prefix[0] != 0)"                       << std::endl
+         << "   {"                                              << std::endl
+         << "      fprintf(stderr,\"hddm error - \""            << std::endl
+         << "      \"compressed input stream has no block size markers.\\n\""
+                                                                << std::endl
+         << "      \"This old format is not supported by the hddm c i/o interface.\\n\");"
+                                                                << std::endl
+         << "      fprintf(stderr,\"You must use the c++ interface to read this file.\\n\");"
+                                                                << std::endl
+         << "      exit(9);"                                    << std::endl
+         << "   }"                                              << std::endl
+         << "   size = (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];"
+                                                                << std::endl
+         << "   if (fp->rbuffer_mode == HDDM_READ_MMAP &&"      << std::endl
+         << "       fp->rbuffer_len - fp->rbuffer_pos >= size)" << std::endl
+         << "   {"                                              << std::endl
+         << "      /* decompress straight out of the memory map */"
+                                                                << std::endl
+         << "      block = fp->rbuffer + fp->rbuffer_pos;"      << std::endl
+         << "      fp->rbuffer_pos += size;"                    << std::endl
+         << "   }"                                              << std::endl
+         << "   else"                                           << std::endl
+         << "   {"                                              << std::endl
+         << "      need_buffer(&fp->cbuffer,&fp->cbuffer_size,size);"
+                                                                << std::endl
+         << "      block = fp->cbuffer;"                        << std::endl
+         << "      if (raw_read(fp,block,size) != size)"        << std::endl
+         << "      {"                                           << std::endl
+         << "         fprintf(stderr,\"hddm error - \""         << std::endl
+         << "         \"read failed on input hddm stream, \""   << std::endl
+         << "         \"cannot continue.\\n\");"                << std::endl
+         << "         exit(9);"                                 << std::endl
+         << "      }"                                           << std::endl
+         << "   }"                                              << std::endl
+         << "   fp->dbuffer_len = 0;"                           << std::endl
+         << "   fp->dbuffer_pos = 0;"                           << std::endl
+         << "   if ((fp->status_bits & HDDM_BITS_COMPRESSION) == HDDM_Z_COMPRESSION)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      z_stream* zs = (z_stream*)fp->codec;"        << std::endl
+         << "      int ret = Z_OK;"                             << std::endl
+         << "      inflateReset(zs);"                           << std::endl
+         << "      if (size < 2 || memcmp(block,z_header,2) != 0)"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         unsigned char dummy[1];"                  << std::endl
+         << "         zs->next_in = z_header;"                  << std::endl
+         << "         zs->avail_in = 2;"                        << std::endl
+         << "         zs->next_out = dummy;"                    << std::endl
+         << "         zs->avail_out = 0;"                       << std::endl
+         << "         inflate(zs,Z_NO_FLUSH);"                  << std::endl
+         << "      }"                                           << std::endl
+         << "      zs->next_in = (unsigned char*)block;"        << std::endl
+         << "      zs->avail_in = size;"                        << std::endl
+         << "      while (ret == Z_OK)"                         << std::endl
+         << "      {"                                           << std::endl
+         << "         need_buffer(&fp->dbuffer,&fp->dbuffer_size,fp->dbuffer_len + 1);"
+                                                                << std::endl
+         << "         zs->next_out = (unsigned char*)fp->dbuffer + fp->dbuffer_len;"
+                                                                << std::endl
+         << "         zs->avail_out = fp->dbuffer_size - fp->dbuffer_len;"
+                                                                << std::endl
+         << "         ret = inflate(zs,Z_NO_FLUSH);"            << std::endl
+         << "         fp->dbuffer_len = fp->dbuffer_size - zs->avail_out;"
+                                                                << std::endl
+         << "         if (ret == Z_BUF_ERROR && zs->avail_out > 0)"
+                                                                << std::endl
+         << "            break;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "      if (ret != Z_STREAM_END && ret != Z_BUF_ERROR &&"
+                                                                << std::endl
+         << "         (ret != Z_DATA_ERROR || zs->avail_in > 0))"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         fprintf(stderr,\"hddm error - \""         << std::endl
+         << "         \"z decompression failed on input hddm stream, \""
+                                                                << std::endl
+         << "         \"cannot continue.\\n\");"                << std::endl
+         << "         exit(9);"                                 << std::endl
+         << "      }"                                           << std::endl
+         << "   }"                                              << std::endl
+         << "   else"                                           << std::endl
+         << "   {"                                              << std::endl
+         << "      bz_stream* bs = (bz_stream*)fp->codec;"      << std::endl
+         << "      int ret = BZ_OK;"                            << std::endl
+         << "      BZ2_bzDecompressInit(bs,0,0);"               << std::endl
+         << "      bs->next_in = block;"                        << std::endl
+         << "      bs->avail_in = size;"                        << std::endl
+         << "      while (ret == BZ_OK)"                        << std::endl
+         << "      {"                                           << std::endl
+         << "         need_buffer(&fp->dbuffer,&fp->dbuffer_size,fp->dbuffer_len + 1);"
+                                                                << std::endl
+         << "         bs->next_out = fp->dbuffer + fp->dbuffer_len;"
+                                                                << std::endl
+         << "         bs->avail_out = fp->dbuffer_size - fp->dbuffer_len;"
+                                                                << std::endl
+         << "         ret = BZ2_bzDecompress(bs);"              << std::endl
+         << "         fp->dbuffer_len = fp->dbuffer_size - bs->avail_out;"
+                                                                << std::endl
+         << "         if (ret == BZ_OK && bs->avail_in == 0 && bs->avail_out > 0)"
+                                                                << std::endl
+         << "            break;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "      BZ2_bzDecompressEnd(bs);"                    << std::endl
+         << "      if (ret != BZ_STREAM_END && ret != BZ_OK)"   << std::endl
+         << "      {"                                           << std::endl
+         << "         fprintf(stderr,\"hddm error - \""         << std::endl
+         << "         \"bz2 decompression failed on input hddm stream, \""
+                                                                << std::endl
+         << "         \"cannot continue.\\n\");"                << std::endl
+         << "         exit(9);"                                 << std::endl
+         << "      }"                                           << std::endl
+         << "   }"                                              << std::endl
+         << "   return 1;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static size_t read_bytes(" << classPrefix << "_iostream_t* fp, char* buf, size_t count)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   size_t got = 0;"                                << std::endl
+         << "   if ((fp->status_bits & HDDM_BITS_COMPRESSION) == HDDM_NO_COMPRESSION)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return raw_read(fp,buf,count);"              << std::endl
+         << "   }"                                              << std::endl
+         << "   while (got < count)"                            << std::endl
+         << "   {"                                              << std::endl
+         << "      size_t n = fp->dbuffer_len - fp->dbuffer_pos;"
+                                                                << std::endl
+         << "      if (n == 0)"                                 << std::endl
+         << "      {"                                           << std::endl
+         << "         if (read_block(fp) == 0)"                 << std::endl
+         << "            break;"                                << std::endl
+         << "         continue;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "      n = (n < count - got)? n : count - got;"     << std::endl
+         << "      memcpy(buf + got,fp->dbuffer + fp->dbuffer_pos,n);"
+                                                                << std::endl
+         << "      fp->dbuffer_pos += (int)n;"                  << std::endl
+         << "      got += n;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   return got;"                                    << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static size_t skip_bytes(" << classPrefix << "_iostream_t* fp, size_t count)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   size_t skipped = 0;"                            << std::endl
+         << "   if ((fp->status_bits & HDDM_BITS_COMPRESSION) == HDDM_NO_COMPRESSION)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return raw_skip(fp,count);"                  << std::endl
+         << "   }"                                              << std::endl
+         << "   while (skipped < count)"                        << std::endl
+         << "   {"                                              << std::endl
+         << "      size_t n = fp->dbuffer_len - fp->dbuffer_pos;"
+                                                                << std::endl
+         << "      if (n == 0)"                                 << std::endl
+         << "      {"                                           << std::endl
+         << "         if (read_block(fp) == 0)"                 << std::endl
+         << "            break;"                                << std::endl
+         << "         continue;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "      n = (n < count - skipped)? n : count - skipped;"
+                                                                << std::endl
+         << "      fp->dbuffer_pos += (int)n;"                  << std::endl
+         << "      skipped += n;"                               << std::endl
+         << "   }"                                              << std::endl
+         << "   return skipped;"                                << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static int next_record(" << classPrefix << "_iostream_t* fp)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Reads the size word of the next record into iobuffer, acting"
+                                                                << std::endl
+         << "    * on any stream modifier tokens that precede it. Returns the size"
+                                                                << std::endl
+         << "    * of the record following the size word, or -1 at end of input."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   while (1)"                                      << std::endl
+         << "   {"                                              << std::endl
+         << "      unsigned int size;"                          << std::endl
+         << "      hxdr_create(fp->xdrs,fp->iobuffer,fp->iobuffer_size);"
+                                                                << std::endl
+         << "      if (read_bytes(fp,fp->iobuffer,4) != 4 || ! hxdr_get_u_int(fp->xdrs,&size))"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         return -1;"                               << std::endl
+         << "      }"                                           << std::endl
+         << "      else if (size == 1)"                         << std::endl
+         << "      {"                                           << std::endl
+         << "         int format, flags;"                       << std::endl
+         << "         if (read_bytes(fp,fp->iobuffer+4,12) != 12)"
+                                                                << std::endl
+         << "         {"                                        << std::endl
+         << "            fprintf(stderr,\"hddm error - \""      << std::endl
+         << "            \"read error on token input, cannot continue.\\n\");"
+                                                                << std::endl
+         << "            exit(9);"                              << std::endl
+         << "         }"                                        << std::endl
+         << "         size = hxdr_get32(fp->xdrs);"             << std::endl
+         << "         format = (int)hxdr_get32(fp->xdrs);"      << std::endl
+         << "         flags = (int)hxdr_get32(fp->xdrs);"       << std::endl
+         << "         if (format != 0)"                         << std::endl
+         << "         {"                                        << std::endl
+         << "            fprintf(stderr,\"hddm error - \""      << std::endl
+         << "            \"unsupported compression format found in hddm stream, \""
+                                                                << std::endl
+         << "            \"cannot continue.\\n\");"             << std::endl
+         << "            exit(9);"                              << std::endl
+         << "         }"                                        << std::endl
+         << "         set_stream_bits(fp,flags);"               << std::endl
+         << "         continue;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "      return (int)size;"                           << std::endl
+         << "   }"                                              << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static int read_record(" << classPrefix << "_iostream_t* fp)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Loads the next record into iobuffer and checks its crc if the"
+                                                                << std::endl
+         << "    * stream has integrity checks enabled. Returns the size of the"
+                                                                << std::endl
+         << "    * record following the 4-byte size word, or -1 at end of input."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   int size = next_record(fp);"                    << std::endl
+         << "   if (size < 0)"                                  << std::endl
+         << "   {"                                              << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   need_buffer(&fp->iobuffer,&fp->iobuffer_size,size + 8);"
+                                                                << std::endl
+         << "   if (read_bytes(fp,fp->iobuffer+4,size) != size)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      fprintf(stderr,\"hddm error - \""            << std::endl
+         << "      \"read failed on input hddm stream, \""      << std::endl
+         << "      \"cannot continue.\\n\");"                   << std::endl
+         << "      exit(9);"                                    << std::endl
+         << "   }"                                              << std::endl
+         << "   if (fp->status_bits & HDDM_CRC32_INTEGRITY)"    << std::endl
+         << "   {"                                              << std::endl
+         << "      unsigned char crc[4];"                       << std::endl
+         << "      unsigned long recorded;"                     << std::endl
+         << "      if (read_bytes(fp,(char*)crc,4) != 4)"       << std::endl
+         << "      {"                                           << std::endl
+         << "         fprintf(stderr,\"hddm error - \""         << std::endl
+         << "         \"read failed on input hddm stream, \""   << std::endl
+         << "         \"cannot continue.\\n\");"                << std::endl
+         << "         exit(9);"                                 << std::endl
+         << "      }"                                           << std::endl
+         << "      recorded = ((unsigned long)crc[0] << 24) | (crc[1] << 16) |"
+                                                                << std::endl
+         << "                 (crc[2] << 8) | crc[3];"          << std::endl
+         << "      if (crc32(0,(unsigned char*)fp->iobuffer,size + 4) != recorded &&"
+                                                                << std::endl
+         << "         (fp->status_bits & 0x02) == 0)"           << std::endl
+         << "      {"                                           << std::endl
+         << "         fprintf(stderr,\"WARNING: crc data integrity check failed\""
+                                                                << std::endl
+         << "         \" on hddm_" << classPrefix << " input stream!\\n\");"
+                                                                << std::endl
+         << "         fp->status_bits |= 0x02;"                 << std::endl
+         << "      }"                                           << std::endl
+         << "   }"                                              << std::endl
+         << "   return size;"                                   << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static int skip_record(" << classPrefix << "_iostream_t* fp)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Steps over the next record without reading it in, seeking past"
+                                                                << std::endl
+         << "    * it in the input file if the stream is not compressed. Returns"
+                                                                << std::endl
+         << "    * the size of the record skipped, or -1 at end of input."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   int size = next_record(fp);"                    << std::endl
+         << "   size_t count;"                                  << std::endl
+         << "   if (size < 0)"                                  << std::endl
+         << "   {"                                              << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   count = size + ((fp->status_bits & HDDM_CRC32_INTEGRITY)? 4 : 0);"
+                                                                << std::endl
+         << "   if (skip_bytes(fp,count) != count)"             << std::endl
+         << "   {"                                              << std::endl
+         << "      fprintf(stderr,\"hddm error - \""            << std::endl
+         << "      \"read failed on input hddm stream, \""      << std::endl
+         << "      \"cannot continue.\\n\");"                   << std::endl
+         << "      exit(9);"                                    << std::endl
+         << "   }"                                              << std::endl
+         << "   return size;"                                   << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static void write_bytes(" << classPrefix << "_iostream_t* fp, char* buf, size_t count)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   if ((fp->status_bits & HDDM_BITS_COMPRESSION) == HDDM_NO_COMPRESSION)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      size_t wsize = fwrite(buf,1,count,fp->fd);"  << std::endl
+         << "      if (wsize != count)"                         << std::endl
+         << "      {"                                           << std::endl
+         << "         fprintf(stderr,\"HDDM Error: error writing to \""
+                                                                << std::endl
+         << "                 \"output hddm file.\\n\");"       << std::endl
+         << "         fprintf(stderr,\"%zd bytes of %zd actually written.\\n\","
+                                                                << std::endl
+         << "                 wsize, count);"                   << std::endl
+         << "         exit(9);"                                 << std::endl
+         << "      }"                                           << std::endl
+         << "   }"                                              << std::endl
+         << "   else"                                           << std::endl
+         << "   {"                                              << std::endl
+         << "      need_buffer(&fp->dbuffer,&fp->dbuffer_size,fp->dbuffer_len + (int)count);"
+                                                                << std::endl
+         << "      memcpy(fp->dbuffer + fp->dbuffer_len,buf,count);"
+                                                                << std::endl
+         << "      fp->dbuffer_len += (int)count;"              << std::endl
+         << "   }"                                              << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static void write_block(" << classPrefix << "_iostream_t* fp)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Compresses the data pending in dbuffer into a single block,"
+                                                                << std::endl
+         << "    * and writes it to the output file behind a 4-byte size prefix."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   unsigned int size;"                             << std::endl
+         << "   unsigned char prefix[4];"                       << std::endl
+         << "   if (fp->dbuffer_len == 0)"                      << std::endl
+         << "   {"                                              << std::endl
+         << "      return;"                                     << std::endl
+         << "   }"                                              << std::endl
+         << "   need_buffer(&fp->cbuffer,&fp->cbuffer_size,fp->dbuffer_len + 0x1000);"
+                                                                << std::endl
+         << "   if ((fp->status_bits & HDDM_BITS_COMPRESSION) == HDDM_Z_COMPRESSION)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      z_stream* zs = (z_stream*)fp->codec;"        << std::endl
+         << "      int ret = Z_OK;"                             << std::endl
+         << "      deflateReset(zs);"                           << std::endl
+         << "      zs->next_in = (unsigned char*)fp->dbuffer;"  << std::endl
+         << "      zs->avail_in = fp->dbuffer_len;"             << std::endl
+         << "      zs->next_out = (unsigned char*)fp->cbuffer;" << std::endl
+         << "      zs->avail_out = fp->cbuffer_size;"           << std::endl
+         << "      while ((ret = deflate(zs,Z_FINISH)) == Z_OK || ret == Z_BUF_ERROR)"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         size = fp->cbuffer_size - zs->avail_out;" << std::endl
+         << "         need_buffer(&fp->cbuffer,&fp->cbuffer_size,fp->cbuffer_size * 2);"
+                                                                << std::endl
+         << "         zs->next_out = (unsigned char*)fp->cbuffer + size;"
+                                                                << std::endl
+         << "         zs->avail_out = fp->cbuffer_size - size;" << std::endl
+         << "      }"                                           << std::endl
+         << "      size = fp->cbuffer_size - zs->avail_out;"    << std::endl
+         << "   }"                                              << std::endl
+         << "   else"                                           << std::endl
+         << "   {"                                              << std::endl
+         << "      bz_stream* bs = (bz_stream*)fp->codec;"      << std::endl
+         << "      int ret = BZ_FINISH_OK;"                     << std::endl
+         << "      BZ2_bzCompressInit(bs,9,0,30);"              << std::endl
+         << "      bs->next_in = fp->dbuffer;"                  << std::endl
+         << "      bs->avail_in = fp->dbuffer_len;"             << std::endl
+         << "      bs->next_out = fp->cbuffer;"                 << std::endl
+         << "      bs->avail_out = fp->cbuffer_size;"           << std::endl
+         << "      while ((ret = BZ2_bzCompress(bs,BZ_FINISH)) == BZ_FINISH_OK)"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         size = fp->cbuffer_size - bs->avail_out;" << std::endl
+         << "         need_buffer(&fp->cbuffer,&fp->cbuffer_size,fp->cbuffer_size * 2);"
+                                                                << std::endl
+         << "         bs->next_out = fp->cbuffer + size;"       << std::endl
+         << "         bs->avail_out = fp->cbuffer_size - size;" << std::endl
+         << "      }"                                           << std::endl
+         << "      size = fp->cbuffer_size - bs->avail_out;"    << std::endl
+         << "      BZ2_bzCompressEnd(bs);"                      << std::endl
+         << "   }"                                              << std::endl
+         << "   prefix[0] = 0;"                                 << std::endl
+         << "   prefix[1] = (size >> 16) & 0xff;"               << std::endl
+         << "   prefix[2] = (size >> 8) & 0xff;"                << std::endl
+         << "   prefix[3] = size & 0xff;"                       << std::endl
+         << "   if (fwrite(prefix,1,4,fp->fd) != 4 ||"          << std::endl
+         << "       fwrite(fp->cbuffer,1,size,fp->fd) != size)" << std::endl
+         << "   {"                                              << std::endl
+         << "      fprintf(stderr,\"HDDM Error: error writing to \""
+                                                                << std::endl
+         << "              \"output hddm file.\\n\");"          << std::endl
+         << "      exit(9);"                                    << std::endl
+         << "   }"                                              << std::endl
+         << "   fp->dbuffer_len = 0;"                           << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static void write_token(" << classPrefix << "_iostream_t* fp, int bits)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Writes a stream modifier token announcing the new status"
+                                                                << std::endl
+         << "    * bits, which closes the current compressed block, if any."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   hddm_xdr_t xdrs;"                               << std::endl
+         << "   char token[16];"                                << std::endl
+         << "   hxdr_create(&xdrs,token,16);"                   << std::endl
+         << "   hxdr_put32(&xdrs,1);"                           << std::endl
+         << "   hxdr_put32(&xdrs,8);"                           << std::endl
+         << "   hxdr_put32(&xdrs,0);"                           << std::endl
+         << "   hxdr_put32(&xdrs,bits);"                        << std::endl
+         << "   write_bytes(fp,token,16);"                      << std::endl
+         << "   if ((fp->status_bits & HDDM_BITS_COMPRESSION) != HDDM_NO_COMPRESSION)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      write_block(fp);"                            << std::endl
+         << "   }"                                              << std::endl
+         << "}"                                                 << std::endl;
+
+   cFile
+         << "int set_" << classPrefix << "_HDDM_compression(" << classPrefix << "_iostream_t* fp, int flags)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   int cmp = flags & HDDM_BITS_COMPRESSION;"       << std::endl
+         << "   int bits = (fp->status_bits & ~HDDM_BITS_COMPRESSION) | cmp;"
+                                                                << std::endl
+         << "   if (fp->iomode != HDDM_STREAM_OUTPUT ||"        << std::endl
+         << "       (cmp != HDDM_NO_COMPRESSION &&"             << std::endl
+         << "        cmp != HDDM_Z_COMPRESSION &&"              << std::endl
+         << "        cmp != HDDM_BZ2_COMPRESSION))"             << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->lerrno = EINVAL;"                        << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   if (cmp != HDDM_NO_COMPRESSION)"                << std::endl
+         << "   {"                                              << std::endl
+         << "      bits |= HDDM_CAN_REPOSITION;"                << std::endl
+         << "   }"                                              << std::endl
+         << "   if (cmp != (fp->status_bits & HDDM_BITS_COMPRESSION))"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      write_token(fp,bits);"                       << std::endl
+         << "      set_stream_bits(fp,bits);"                   << std::endl
+         << "   }"                                              << std::endl
+         << "   return 0;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "int get_" << classPrefix << "_HDDM_compression(" << classPrefix << "_iostream_t* fp)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   return fp->status_bits & HDDM_BITS_COMPRESSION;"
+                                                                << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "int set_" << classPrefix << "_HDDM_integrity(" << classPrefix << "_iostream_t* fp, int flags)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   int chk = flags & HDDM_BITS_INTEGRITY;"         << std::endl
+         << "   int bits = (fp->status_bits & ~HDDM_BITS_INTEGRITY) | chk;"
+                                                                << std::endl
+         << "   if (fp->iomode != HDDM_STREAM_OUTPUT ||"        << std::endl
+         << "       (chk != HDDM_NO_INTEGRITY && chk != HDDM_CRC32_INTEGRITY))"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->lerrno = EINVAL;"                        << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   if (chk != (fp->status_bits & HDDM_BITS_INTEGRITY))"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      write_token(fp,bits);"                       << std::endl
+         << "      set_stream_bits(fp,bits);"                   << std::endl
+         << "   }"                                              << std::endl
+         << "   return 0;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "int get_" << classPrefix << "_HDDM_integrity(" << classPrefix << "_iostream_t* fp)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   return fp->status_bits & HDDM_CRC32_INTEGRITY;" << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "int set_" << classPrefix << "_HDDM_readbuffer(" << classPrefix << "_iostream_t* fp, char* buffer, int size)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Routes input through a read buffer of the given size so that"
+                                                                << std::endl
+         << "    * record sizes and tokens are not fetched by separate fread calls."
+                                                                << std::endl
+         << "    * If buffer is zero then one is allocated and owned by the stream."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   if (fp->iomode != HDDM_STREAM_INPUT || size <= 0 ||"
+                                                                << std::endl
+         << "       fp->rbuffer_mode == HDDM_READ_MMAP ||"      << std::endl
+         << "       fp->rbuffer_pos < fp->rbuffer_len)"         << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->lerrno = EINVAL;"                        << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   if (fp->rbuffer_mode == HDDM_READ_OWNED)"       << std::endl
+         << "   {"                                              << std::endl
+         << "      free(fp->rbuffer);"                          << std::endl
+         << "   }"                                              << std::endl
+         << "   if (buffer == 0)"                               << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->rbuffer = (char*)malloc(size);"          << std::endl
+         << "      fp->rbuffer_mode = HDDM_READ_OWNED;"         << std::endl
+         << "   }"                                              << std::endl
+         << "   else"                                           << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->rbuffer = buffer;"                       << std::endl
+         << "      fp->rbuffer_mode = HDDM_READ_USER;"          << std::endl
+         << "   }"                                              << std::endl
+         << "   fp->rbuffer_size = size;"                       << std::endl
+         << "   fp->rbuffer_len = 0;"                           << std::endl
+         << "   fp->rbuffer_pos = 0;"                           << std::endl
+         << "   return 0;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "int map_" << classPrefix << "_HDDM(" << classPrefix << "_iostream_t* fp)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Maps the remainder of the input file into memory so that reads"
+                                                                << std::endl
+         << "    * and skips become pointer arithmetic. Fails on pipes and other"
+                                                                << std::endl
+         << "    * inputs that cannot be mapped, leaving the stream as it was."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "#ifndef _WIN32"                                    << std::endl
+         << "   struct stat st;"                                << std::endl
+         << "   off_t pos;"                                     << std::endl
+         << "   char* map;"                                     << std::endl
+         << "   if (fp->iomode != HDDM_STREAM_INPUT ||"         << std::endl
+         << "       fp->rbuffer_mode == HDDM_READ_MMAP)"        << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->lerrno = EINVAL;"                        << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   else if (fstat(fileno(fp->fd),&st) != 0 || ! S_ISREG(st.st_mode) ||"
+                                                                << std::endl
+         << "            (pos = ftello(fp->fd)) < 0)"           << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->lerrno = ESPIPE;"                        << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   pos -= fp->rbuffer_len - fp->rbuffer_pos;"      << std::endl
+         << "   if (st.st_size == 0)"                           << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->lerrno = EINVAL;"                        << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   map = (char*)mmap(0,st.st_size,PROT_READ,MAP_PRIVATE,fileno(fp->fd),0);"
+                                                                << std::endl
+         << "   if (map == MAP_FAILED)"                         << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->lerrno = errno;"                         << std::endl
+         << "      return -1;"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   madvise(map,st.st_size,MADV_SEQUENTIAL);"       << std::endl
+         << "   if (fp->rbuffer_mode == HDDM_READ_OWNED)"       << std::endl
+         << "   {"                                              << std::endl
+         << "      free(fp->rbuffer);"                          << std::endl
+         << "   }"                                              << std::endl
+         << "   fp->rbuffer = map;"                             << std::endl
+         << "   fp->rbuffer_mode = HDDM_READ_MMAP;"             << std::endl
+         << "   fp->rbuffer_size = st.st_size;"                 << std::endl
+         << "   fp->rbuffer_len = st.st_size;"                  << std::endl
+         << "   fp->rbuffer_pos = pos;"                         << std::endl
+         << "   return 0;"                                      << std::endl
+         << "#else"                                             << std::endl
+         << "   fp->lerrno = ENOSYS;"                           << std::endl
+         << "   return -1;"                                     << std::endl
+         << "#endif"                                            << std::endl
+         << "}"                                                 << std::endl;
+}
+
 /* Generate c function to read from binary stream into c-structures */
 
 void CodeBuilder::constructReadFunc(DOMElement* topEl)
@@ -1345,51 +2595,14 @@ void CodeBuilder::constructReadFunc(DOMElement* topEl)
          << topType << "* read_" << topT
          << "(" << classPrefix << "_iostream_t* fp" << ")"      << std::endl
          << "{"                                                 << std::endl
-         << "   off_t base;"                                    << std::endl
-         << "   unsigned int size;"                             << std::endl
-         << "   xdrmem_create(fp->xdrs,fp->iobuffer,fp->iobuffer_size,XDR_DECODE);"
-                                                                << std::endl
-         << "   base = xdr_getpos64(fp->xdrs);"                 << std::endl
-         << "   if (fread(fp->iobuffer,1,4,fp->fd) != 4 || ! xdr_u_int(fp->xdrs,&size))"
-                                                                << std::endl
+         << "   if (read_record(fp) < 0)"                       << std::endl
          << "   {"                                              << std::endl
-         << "      xdr_destroy(fp->xdrs);"                      << std::endl
          << "      return 0;"                                   << std::endl
          << "   }"                                              << std::endl
-         << "   else if (size == 1)"                            << std::endl
-         << "   {"                                              << std::endl
-         << "      fprintf(stderr,\"hddm error - \""            << std::endl
-         << "      \"stream compression and/or integrity checks"
-                   " found in input stream.\\n\""               << std::endl
-         << "      \"These features are not supported by the"
-                   " hddm c i/o interface.\\n\");"              << std::endl
-         << "      fprintf(stderr,\"You must use the c++ interface"
-                   " to read this file.\\n\");"                 << std::endl
-         << "      exit(9);"                                    << std::endl
-         << "   }"                                              << std::endl
-         << "   else if ((int)size + 4 > fp->iobuffer_size)"    << std::endl
-         << "   {"                                              << std::endl
-         << "      xdr_destroy(fp->xdrs);"                      << std::endl
-         << "      char *newbuf = (char*)malloc(fp->iobuffer_size *= 2);"
-                                                                << std::endl
-         << "      memcpy(newbuf,fp->iobuffer,4);"              << std::endl
-         << "      free(fp->iobuffer);"                         << std::endl
-         << "      fp->iobuffer = newbuf;"                      << std::endl
-         << "      xdrmem_create(fp->xdrs,fp->iobuffer,fp->iobuffer_size,XDR_DECODE);"
+         << "   hxdr_create(fp->xdrs,fp->iobuffer,fp->iobuffer_size);"
                                                                 << std::endl
-         << "      base = xdr_getpos64(fp->xdrs);"              << std::endl
-         << "   }"                                              << std::endl
-         << "   if (fread(fp->iobuffer+4,1,size,fp->fd) != size)" << std::endl
-         << "   {"                                              << std::endl
-         << "      fprintf(stderr,\"hddm error - \""            << std::endl
-         << "      \"read failed on input hddm stream, \""      << std::endl
-         << "      \"cannot continue.\\n\");"                   << std::endl
-         << "      exit(9);"                                    << std::endl
-         << "   }"                                              << std::endl
-         << "   xdr_setpos64(fp->xdrs,base);"                   << std::endl
          << "   " << topType << "* nextEvent = "
          << "unpack_" << topT << "(fp->xdrs,fp->popTop);"       << std::endl
-         << "   xdr_destroy(fp->xdrs);"                         << std::endl
          << "   return (nextEvent == HDDM_NULL)? 0 : nextEvent;" << std::endl
          << "}"                                                 << std::endl;
 }
@@ -1409,45 +2622,11 @@ void CodeBuilder::constructSkipFunc()
          << "   int skipped;"                                   << std::endl
          << "   for (skipped=0; skipped < nskip; ++skipped)"    << std::endl
          << "   {"                                              << std::endl
-         << "      unsigned int size;"                          << std::endl
-         << "      xdrmem_create(fp->xdrs,fp->iobuffer,fp->iobuffer_size,XDR_DECODE);"
-                                                                << std::endl
-         << "      if (fread(fp->iobuffer,1,4,fp->fd) != 4 || ! xdr_u_int(fp->xdrs,&size))"
-                                                                << std::endl
+         << "      if (skip_record(fp) < 0)"                    << std::endl
          << "      {"                                           << std::endl
          << "         break;"                                   << std::endl
          << "      }"                                           << std::endl
-         << "      else if (size == 1)"                         << std::endl
-         << "      {"                                           << std::endl
-         << "         fprintf(stderr,\"hddm error - \""         << std::endl
-         << "         \"stream compression and/or integrity "
-                      "checks found in input stream.\\n\""      << std::endl
-         << "         \"These features are not supported "
-                      "by the hddm c i/o interface.\\n\");"     << std::endl
-         << "         fprintf(stderr,\"You must use the c++ "
-         <<           "interface to read this file.\\n\");"     << std::endl
-         << "         exit(9);"                                 << std::endl
-         << "      }"                                           << std::endl
-         << "      else if ((int)size + 4 > fp->iobuffer_size)" << std::endl
-         << "      {"                                           << std::endl
-         << "         xdr_destroy(fp->xdrs);"                   << std::endl
-         << "         char *newbuf = (char*)malloc(fp->iobuffer_size *= 2);"
-                                                                << std::endl
-         << "         memcpy(newbuf,fp->iobuffer,4);"           << std::endl
-         << "         free(fp->iobuffer);"                      << std::endl
-         << "         fp->iobuffer = newbuf;"                   << std::endl
-         << "         xdrmem_create(fp->xdrs,fp->iobuffer,fp->iobuffer_size,XDR_DECODE);"
-                                                                << std::endl
-         << "      }"                                           << std::endl
-         << "      if (fread(fp->iobuffer+4,1,size,fp->fd) != size)" << std::endl
-         << "      {"                                           << std::endl
-         << "         fprintf(stderr,\"hddm error - \""         << std::endl
-         << "         \"read failed on input hddm stream, \""   << std::endl
-         << "         \"cannot continue.\\n\");"                << std::endl
-         << "         exit(9);"                                 << std::endl
-         << "      }"                                           << std::endl
          << "   }"                                              << std::endl
-         << "   xdr_destroy(fp->xdrs);"                         << std::endl
          << "   return skipped;"                                << std::endl
          << "}"                                                 << std::endl;
 }
@@ -1482,8 +2661,8 @@ void CodeBuilder::constructPackers()
       }
       XtString tagT(tagType);
       tagT.erase(tagT.rfind('_'));
-      cFile << "int pack_" << tagT << "(XDR* xdrs, "
-            << tagType << "* this1);"                           << std::endl;
+      cFile << "int pack_" << tagT << "(hddm_xdr_t* xdrs, "
+            << tagType << "* this1, struct hddm_pool_s* pool);" << std::endl;
    }
 
    for (iter = tagList.begin(); iter != tagList.end(); iter++)
@@ -1508,8 +2687,8 @@ void CodeBuilder::constructPackers()
       }
       XtString tagT(tagType);
       tagT.erase(tagT.rfind('_'));
-      cFile << "int pack_" << tagT << "(XDR* xdrs, "
-            << tagType << "* this1)"                            << std::endl
+      cFile << "int pack_" << tagT << "(hddm_xdr_t* xdrs, "
+            << tagType << "* this1, struct hddm_pool_s* pool)"  << std::endl
             << "{"                                              << std::endl;
       if (rep > 1)
       {
@@ -1517,26 +2696,14 @@ void CodeBuilder::constructPackers()
       }
       cFile << "   unsigned int size=0;"                        << std::endl
             << "   off_t base,start,end;"                       << std::endl
-            << "   base = xdr_getpos64(xdrs);"                  << std::endl;
-      if (tagT.find("_HDDM") != tagT.npos)
-      {
-         cFile
-            << "   if (base == -1)"                             << std::endl
-            << "   {"                                           << std::endl
-            << "      fprintf(stderr,\"hddm error - \""         << std::endl
-            << "      \"stream offset request failed "
-                      "on output hddm stream, \""               << std::endl
-            << "      \"cannot continue.\\n\");"                << std::endl
-            << "      return -1;"                               << std::endl
-            << "   }"                                           << std::endl;
-      }
-      cFile << "   if (! xdr_u_int(xdrs,&size))"                << std::endl
+            << "   base = hxdr_getpos(xdrs);"                   << std::endl;
+      cFile << "   if (! hxdr_put_u_int(xdrs,0))"               << std::endl
             << "      XDRerror();"                              << std::endl
-            << "   start = xdr_getpos64(xdrs);"                 << std::endl
+            << "   start = hxdr_getpos(xdrs);"                  << std::endl
                                                                 << std::endl;
       if (rep > 1)
       {
-         cFile << "   if (! xdr_u_int(xdrs,&this1->mult))"      << std::endl
+         cFile << "   if (! hxdr_put_u_int(xdrs,this1->mult))"  << std::endl
                << "      XDRerror();"                           << std::endl
                << "   for (m = 0; m < this1->mult; m++)"        << std::endl
                << "   {"                                        << std::endl;
@@ -1547,6 +2714,7 @@ void CodeBuilder::constructPackers()
       }
 
       DOMNamedNodeMap* attList = tagEl->getAttributes();
+      std::vector<std::pair<XtString,XtString> > run;
       for (unsigned int a = 0; a < attList->getLength(); a++)
       {
          DOMNode* att = attList->item(a);
@@ -1557,85 +2725,27 @@ void CodeBuilder::constructPackers()
          {
             nameStr = "in[m]." + nameS;
          }
-         if (typeS == "int")
-         {
-            cFile << "      if (! xdr_int(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "         XDRerror();"                     << std::endl;
-         }
-         if (typeS == "long")
-         {
-            cFile << "#ifndef XDR_LONGLONG_MISSING"             << std::endl
-                  << "         if (! xdr_longlong_t(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "            XDRerror();"                  << std::endl
-                  << "#else"                                    << std::endl
-                  << "         {"                               << std::endl
-                  << "            int* " << nameStr << "_ = "
-                  << "(int*)&this1->" << nameStr << ";"         << std::endl
-                  << "# if __BIG_ENDIAN__"                      << std::endl
-                  << "            if (! xdr_int(xdrs,&"
-                  << nameStr << "_[0]))"                        << std::endl
-                  << "               XDRerror();"               << std::endl
-                  << "            if (! xdr_int(xdrs,&"
-                  << nameStr << "_[1]))"                        << std::endl
-                  << "               XDRerror();"               << std::endl
-                  << "# else"                                   << std::endl
-                  << "            if (! xdr_int(xdrs,&"
-                  << nameStr << "_[1]))"                        << std::endl
-                  << "               XDRerror();"               << std::endl
-                  << "            if (! xdr_int(xdrs,&"
-                  << nameStr << "_[0]))"                        << std::endl
-                  << "                 XDRerror();"             << std::endl
-                  << "# endif"                                  << std::endl
-                  << "         }"                               << std::endl
-                  << "#endif"                                   << std::endl;
-         }
-         else if (typeS == "float")
-         {
-            cFile << "      if (! xdr_float(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "         XDRerror();"                     << std::endl;
-         }
-         else if (typeS == "double")
-         {
-            cFile << "      if (! xdr_double(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "         XDRerror();"                     << std::endl;
-         }
-         else if (typeS == "boolean")
-         {
-            cFile << "      if (! xdr_bool(xdrs,&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "         XDRerror();"                     << std::endl;
-         }
-         else if (typeS == "Particle_t")
+         if (typeS == "int" || typeS == "long" ||
+             typeS == "float" || typeS == "double" ||
+             typeS == "boolean" || typeS == "Particle_t")
          {
-            cFile << "      if (! xdr_int(xdrs,(int*)&this1->"
-                  << nameStr << "))"                            << std::endl
-                  << "         XDRerror();"                     << std::endl;
+            run.push_back(std::pair<XtString,XtString>(typeS,nameStr));
          }
-         else if (typeS == "string")
+         else if (typeS == "string" || typeS == "anyURI")
          {
-            cFile << "      if (! xdr_string(xdrs,&this1->"
-                  << nameStr << ", hddm_" + classPrefix
+            writeFixedRun(run,0,"      ");
+            cFile << "      if (! hxdr_put_string(xdrs,this1->"
+                  << nameStr << ",hddm_" + classPrefix
                   << "_stringsize))"                            << std::endl
                   << "         XDRerror();"                     << std::endl;
             cFile << "      FREE(this1->" << nameStr << ");"    << std::endl;
          }
-         else if (typeS == "anyURI")
-         {
-            cFile << "      if (! xdr_string(xdrs,&this1->"
-                  << nameStr << ", hddm_" + classPrefix
-                  << "_stringsize))"                            << std::endl
-                  << "          XDRerror();"                    << std::endl;
-            cFile << "      FREE(this1->" << nameStr << ");"    << std::endl;
-         }
          else
          {
             /* ignore attributes with unrecognized values */
          }
       }
+      writeFixedRun(run,0,"      ");
 
       DOMNodeList* contList = tagEl->getChildNodes();
       for (unsigned int c = 0; c < contList->getLength(); c++)
@@ -1668,23 +2778,22 @@ void CodeBuilder::constructPackers()
 
                   << "         if (pack_" << contT << "(xdrs,this1->"
                   << ((rep > 1)? "in[m]." : "")
-                  << ((re > 1)? nameS.plural() : nameS) << ") < 0) {"
+                  << ((re > 1)? nameS.plural() : nameS) << ",pool) < 0) {"
                                                                 << std::endl
                   << "            return -1;"                   << std::endl
                   << "         }"                               << std::endl
                   << "      }"                                  << std::endl
                   << "      else"                               << std::endl
                   << "      {"                                  << std::endl
-                  << "         int zero=0;"                     << std::endl
-                  << "         if (! xdr_int(xdrs,&zero))"      << std::endl
+                  << "         if (! hxdr_put_u_int(xdrs,0))"   << std::endl
                   << "            XDRerror();"                  << std::endl
                   << "      }"                                  << std::endl;
          }
       }
 
       cFile << "   }"                                           << std::endl
-            << "   end = xdr_getpos64(xdrs);"                   << std::endl
-            << "   xdr_setpos64(xdrs,base);"                    << std::endl
+            << "   end = hxdr_getpos(xdrs);"                    << std::endl
+            << "   hxdr_setpos(xdrs,base);"                     << std::endl
             << "   size = (unsigned int)(end-start);"           << std::endl;
       if (tagT.find("_HDDM") != tagT.npos)
       {
@@ -1702,10 +2811,10 @@ void CodeBuilder::constructPackers()
             << "      exit(9);"                                 << std::endl
             << "   }"                                           << std::endl;
       }
-      cFile << "   if (! xdr_u_int(xdrs,&size))"                << std::endl
+      cFile << "   if (! hxdr_put_u_int(xdrs,size))"            << std::endl
             << "      XDRerror();"                              << std::endl
-            << "   xdr_setpos64(xdrs,end);"                     << std::endl
-            << "   FREE(this1);"                                << std::endl
+            << "   hxdr_setpos(xdrs,end);"                      << std::endl
+            << "   pool_free(pool,this1);"                      << std::endl
             << "   return size;"                                << std::endl
             << "}"                                              << std::endl;
    }
@@ -1731,51 +2840,64 @@ void CodeBuilder::constructFlushFunc(DOMElement* el)
          << "int flush_" << topT << "(" << topType << "* this1,"
          << classPrefix << "_iostream_t* fp" << ")"             << std::endl
          << "{"                                                 << std::endl
+         << "   struct hddm_pool_s* pool;"                      << std::endl
          << "   if (this1 == 0)"                                << std::endl
          << "   {"                                              << std::endl
          << "      return 0;"                                   << std::endl
          << "   }"                                              << std::endl
-         << "   else if (fp == 0)"                              << std::endl
+         << "   pool = this1->pool;"                            << std::endl
+         << "   if (fp == 0)"                                   << std::endl
          << "   {"                                              << std::endl
-         << "      XDR* xdrs = (XDR*)malloc(sizeof(XDR));"      << std::endl
+         << "      hddm_xdr_t xdrs;"                            << std::endl
          << "      char* dump = (char*)malloc(hddm_"
                    + classPrefix + "_buffersize);"              << std::endl
-         << "      xdrmem_create(xdrs,dump,hddm_"
-                   + classPrefix + "_buffersize,XDR_ENCODE);"   << std::endl
-         << "      pack_" << topT << "(xdrs,this1);"            << std::endl
-         << "      xdr_destroy(xdrs);"                          << std::endl
-         << "      free(xdrs);"                                 << std::endl
+         << "      hxdr_create(&xdrs,dump,hddm_"
+                   + classPrefix + "_buffersize);"              << std::endl
+         << "      pack_" << topT << "(&xdrs,this1,pool);"      << std::endl
          << "      free(dump);"                                 << std::endl
+         << "      if (pool)"                                   << std::endl
+         << "      {"                                           << std::endl
+         << "         pool_release(pool);"                      << std::endl
+         << "      }"                                           << std::endl
          << "   }"                                              << std::endl
          << "   else if (fp->iomode == HDDM_STREAM_OUTPUT)"     << std::endl
          << "   {"                                              << std::endl
          << "      int size;"                                   << std::endl
-         << "      xdrmem_create(fp->xdrs,fp->iobuffer,"
-                   "fp->iobuffer_size,XDR_ENCODE);"             << std::endl
-         << "      size = pack_" + classPrefix + "_HDDM(fp->xdrs,this1);"
+         << "      hxdr_create(fp->xdrs,fp->iobuffer,"
+                   "fp->iobuffer_size);"                        << std::endl
+         << "      size = pack_" + classPrefix + "_HDDM(fp->xdrs,this1,pool);"
                                                                 << std::endl
+         << "      if (pool)"                                   << std::endl
+         << "      {"                                           << std::endl
+         << "         pool_release(pool);"                      << std::endl
+         << "      }"                                           << std::endl
          << "      if (size < 0)"                               << std::endl
          << "      {"                                           << std::endl
          << "         fp->lerrno = errno;"                      << std::endl
-         << "         xdr_destroy(fp->xdrs);"                   << std::endl
          << "         return -1;"                               << std::endl
          << "      }"                                           << std::endl
          << "      else if (size > 0)"                          << std::endl
          << "      {"                                           << std::endl
-         << "         size_t wsize = fwrite(fp->iobuffer,1,size+4,fp->fd);"
+         << "         int limit = (fp->status_bits & HDDM_BZ2_COMPRESSION)? 900000 : 32000;"
                                                                 << std::endl
-         << "         if (wsize != size + 4)"                   << std::endl
-         << "         {"                                        << std::endl
-         << "            fprintf(stderr,\"HDDM Error: error writing to \""
+         << "         write_bytes(fp,fp->iobuffer,size+4);"     << std::endl
+         << "         if (fp->status_bits & HDDM_CRC32_INTEGRITY)"
                                                                 << std::endl
-         << "                    \"output hddm file.\\n\");"    << std::endl
-         << "            fprintf(stderr,\"%zd bytes of %d "
-                                 "actually written.\\n\","      << std::endl
-         << "                    wsize, size+4);"               << std::endl
-         << "            exit(9);"                              << std::endl
+         << "         {"                                        << std::endl
+         << "            unsigned long crc = crc32(0,(unsigned char*)fp->iobuffer,size+4);"
+                                                                << std::endl
+         << "            char crcbuf[4];"                       << std::endl
+         << "            crcbuf[0] = (char)(crc >> 24);"        << std::endl
+         << "            crcbuf[1] = (char)(crc >> 16);"        << std::endl
+         << "            crcbuf[2] = (char)(crc >> 8);"         << std::endl
+         << "            crcbuf[3] = (char)crc;"                << std::endl
+         << "            write_bytes(fp,crcbuf,4);"             << std::endl
+         << "         }"                                        << std::endl
+         << "         if (fp->dbuffer_len > limit)"             << std::endl
+         << "         {"                                        << std::endl
+         << "            write_block(fp);"                      << std::endl
          << "         }"                                        << std::endl
          << "      }"                                           << std::endl
-         << "      xdr_destroy(fp->xdrs);"                      << std::endl
          << "   }"                                              << std::endl
          << "   return 0;"                                      << std::endl
          << "}"                                                 << std::endl;
@@ -1926,7 +3048,7 @@ void CodeBuilder::writeMatcher()
             << "(strcmp(btag,\"" << tagS << "\") == 0)"         << std::endl
             << "         {"                                     << std::endl
             << "            this1->unpacker = "
-            << "(void*(*)(XDR*,popNode*))"
+            << "(void*(*)(hddm_xdr_t*,popNode*))"
             << "unpack_" << tagT << ";"                         << std::endl
             << "         }"                                     << std::endl;
    }
@@ -2004,6 +3126,19 @@ void CodeBuilder::constructOpenFunc(DOMElement* el)
          << "      return 0;"                                   << std::endl
          << "   }"                                              << std::endl
          << "   fp->iomode = HDDM_STREAM_INPUT;"                << std::endl
+         << "   fp->status_bits = 0;"                           << std::endl
+         << "   fp->codec = 0;"                                 << std::endl
+         << "   fp->cbuffer = 0;"                               << std::endl
+         << "   fp->cbuffer_size = 0;"                          << std::endl
+         << "   fp->dbuffer = 0;"                               << std::endl
+         << "   fp->dbuffer_size = 0;"                          << std::endl
+         << "   fp->dbuffer_len = 0;"                           << std::endl
+         << "   fp->dbuffer_pos = 0;"                           << std::endl
+         << "   fp->rbuffer = 0;"                               << std::endl
+         << "   fp->rbuffer_size = 0;"                          << std::endl
+         << "   fp->rbuffer_len = 0;"                           << std::endl
+         << "   fp->rbuffer_pos = 0;"                           << std::endl
+         << "   fp->rbuffer_mode = HDDM_READ_STDIO;"            << std::endl
          << "   head = (char*)malloc(hddm_" + classPrefix + "_headersize);"
                                                                 << std::endl
          << "   while ((fgets(head,7,fp->fd) != 0) &&"          << std::endl
@@ -2056,7 +3191,8 @@ void CodeBuilder::constructOpenFunc(DOMElement* el)
          << "   int len = (int)strlen(filename);"               << std::endl
          << "   fp->filename = (char*)malloc(len + 1);"         << std::endl
          << "   strncpy_s(fp->filename,len+1,filename,len+1);"  << std::endl
-         << "   fp->xdrs = (XDR*)malloc(sizeof(XDR));"          << std::endl
+         << "   fp->xdrs = (hddm_xdr_t*)malloc(sizeof(hddm_xdr_t));"
+                                                                << std::endl
          << "   fp->iobuffer = (char*)malloc(fp->iobuffer_size"
             " = hddm_" + classPrefix + "_buffersize);"          << std::endl
          << "   return fp;"                                     << std::endl
@@ -2100,6 +3236,19 @@ void CodeBuilder::constructInitFunc(DOMElement* el)
          << "      return 0;"                                   << std::endl
          << "   }"                                              << std::endl
          << "   fp->iomode = HDDM_STREAM_OUTPUT;"               << std::endl
+         << "   fp->status_bits = 0;"                           << std::endl
+         << "   fp->codec = 0;"                                 << std::endl
+         << "   fp->cbuffer = 0;"                               << std::endl
+         << "   fp->cbuffer_size = 0;"                          << std::endl
+         << "   fp->dbuffer = 0;"                               << std::endl
+         << "   fp->dbuffer_size = 0;"                          << std::endl
+         << "   fp->dbuffer_len = 0;"                           << std::endl
+         << "   fp->dbuffer_pos = 0;"                           << std::endl
+         << "   fp->rbuffer = 0;"                               << std::endl
+         << "   fp->rbuffer_size = 0;"                          << std::endl
+         << "   fp->rbuffer_len = 0;"                           << std::endl
+         << "   fp->rbuffer_pos = 0;"                           << std::endl
+         << "   fp->rbuffer_mode = HDDM_READ_STDIO;"            << std::endl
          << "   len = (int)strlen(HDDM_"
          << classPrefix << "_DocumentString);"                  << std::endl
          << "   head = (char*)malloc(len+1);"                   << std::endl
@@ -2116,7 +3265,8 @@ void CodeBuilder::constructInitFunc(DOMElement* el)
          << "   fp->filename = (char*)malloc(len + 1);"         << std::endl
          << "   strncpy_s(fp->filename,len+1,filename,len+1);"  << std::endl
          << "   fp->popTop = 0;"                                << std::endl
-         << "   fp->xdrs = (XDR*)malloc(sizeof(XDR));"          << std::endl
+         << "   fp->xdrs = (hddm_xdr_t*)malloc(sizeof(hddm_xdr_t));"
+                                                                << std::endl
          << "   fp->iobuffer = (char*)malloc(fp->iobuffer_size"
             " = hddm_" + classPrefix + "_buffersize);"          << std::endl
          << "   free(head);"                                    << std::endl
@@ -2153,6 +3303,24 @@ void CodeBuilder::constructCloseFunc(DOMElement* el)
          << "void close_" << tagT
          << "(" << classPrefix << "_iostream_t* fp)"            << std::endl
          << "{"                                                 << std::endl
+         << "   if (fp->iomode == HDDM_STREAM_OUTPUT &&"        << std::endl
+         << "       fp->status_bits & HDDM_BITS_COMPRESSION)"   << std::endl
+         << "   {"                                              << std::endl
+         << "      write_block(fp);"                            << std::endl
+         << "   }"                                              << std::endl
+         << "   set_stream_bits(fp,0);"                         << std::endl
+         << "#ifndef _WIN32"                                    << std::endl
+         << "   if (fp->rbuffer_mode == HDDM_READ_MMAP)"        << std::endl
+         << "   {"                                              << std::endl
+         << "      munmap(fp->rbuffer,fp->rbuffer_size);"       << std::endl
+         << "   }"                                              << std::endl
+         << "#endif"                                            << std::endl
+         << "   if (fp->rbuffer_mode == HDDM_READ_OWNED)"       << std::endl
+         << "   {"                                              << std::endl
+         << "      free(fp->rbuffer);"                          << std::endl
+         << "   }"                                              << std::endl
+         << "   free(fp->cbuffer);"                             << std::endl
+         << "   free(fp->dbuffer);"                             << std::endl
          << "   free(fp->xdrs);"                                << std::endl
          << "   free(fp->iobuffer);"                            << std::endl
          << "   fclose(fp->fd);"                                << std::endl
@@ -2162,6 +3330,350 @@ void CodeBuilder::constructCloseFunc(DOMElement* el)
          << "}"                                                 << std::endl;
 }
 
+/* Generate c functions for a reader that feeds framed records from one
+ * input stream to several consumer threads, which unpack them in parallel
+ */
+
+void CodeBuilder::constructReaderFuncs()
+{
+   hFile                                                        << std::endl
+         << "typedef struct " << classPrefix << "_reader_s " << classPrefix << "_reader_t;"
+                                                                << std::endl
+         << classPrefix << "_reader_t* open_" << classPrefix << "_HDDM_reader(" << classPrefix << "_iostream_t* fp, int depth);"
+                                                                << std::endl
+         << classPrefix << "_HDDM_t* read_" << classPrefix << "_HDDM_reader(" << classPrefix << "_reader_t* rd, popNode* pop, long* seqno);"
+                                                                << std::endl
+         << "popNode* select_" << classPrefix << "_HDDM_reader(" << classPrefix << "_reader_t* rd, const char* tags);"
+                                                                << std::endl
+         << "void close_" << classPrefix << "_HDDM_reader(" << classPrefix << "_reader_t* rd);"
+                                                                << std::endl;
+
+   cFile                                                        << std::endl
+         << "/* The parallel reader hands out framed records from one input stream"
+                                                                << std::endl
+         << " * to any number of consumer threads. A background thread pulls records"
+                                                                << std::endl
+         << " * off the stream, through decompression and crc checks, into a ring of"
+                                                                << std::endl
+         << " * frame buffers, and each consumer unpacks the frames it takes into its"
+                                                                << std::endl
+         << " * own record tree, so the unpacking proceeds in parallel."
+                                                                << std::endl
+         << " */"                                               << std::endl
+                                                                << std::endl
+         << "typedef struct " << classPrefix << "_frame_s {"    << std::endl
+         << "   struct " << classPrefix << "_frame_s* next;"    << std::endl
+         << "   char* buffer;"                                  << std::endl
+         << "   int size;"                                      << std::endl
+         << "   int capacity;"                                  << std::endl
+         << "   long seqno;"                                    << std::endl
+         << "} " << classPrefix << "_frame_t;"                  << std::endl
+                                                                << std::endl
+         << "typedef struct " << classPrefix << "_selection_s {"
+                                                                << std::endl
+         << "   struct " << classPrefix << "_selection_s* next;"
+                                                                << std::endl
+         << "   popNode* popTop;"                               << std::endl
+         << "} " << classPrefix << "_selection_t;"              << std::endl
+                                                                << std::endl
+         << "struct " << classPrefix << "_reader_s {"           << std::endl
+         << "   " << classPrefix << "_iostream_t* fp;"          << std::endl
+         << "   pthread_t thread;"                              << std::endl
+         << "   pthread_mutex_t lock;"                          << std::endl
+         << "   pthread_cond_t filled;"                         << std::endl
+         << "   pthread_cond_t emptied;"                        << std::endl
+         << "   " << classPrefix << "_frame_t* ready_head;"     << std::endl
+         << "   " << classPrefix << "_frame_t* ready_tail;"     << std::endl
+         << "   " << classPrefix << "_frame_t* spare;"          << std::endl
+         << "   int depth;"                                     << std::endl
+         << "   int nframes;"                                   << std::endl
+         << "   int eof;"                                       << std::endl
+         << "   int stop;"                                      << std::endl
+         << "   long seqno;"                                    << std::endl
+         << "   " << classPrefix << "_selection_t* selections;" << std::endl
+         << "};"                                                << std::endl
+                                                                << std::endl
+         << "static void* reader_thread(void* arg)"             << std::endl
+         << "{"                                                 << std::endl
+         << "   " << classPrefix << "_reader_t* rd = (" << classPrefix << "_reader_t*)arg;"
+                                                                << std::endl
+         << "   while (1)"                                      << std::endl
+         << "   {"                                              << std::endl
+         << "      " << classPrefix << "_frame_t* frame;"       << std::endl
+         << "      int size;"                                   << std::endl
+         << "      pthread_mutex_lock(&rd->lock);"              << std::endl
+         << "      while (rd->spare == 0 && rd->nframes >= rd->depth && ! rd->stop)"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         pthread_cond_wait(&rd->emptied,&rd->lock);"
+                                                                << std::endl
+         << "      }"                                           << std::endl
+         << "      if (rd->stop)"                               << std::endl
+         << "      {"                                           << std::endl
+         << "         pthread_mutex_unlock(&rd->lock);"         << std::endl
+         << "         break;"                                   << std::endl
+         << "      }"                                           << std::endl
+         << "      frame = rd->spare;"                          << std::endl
+         << "      if (frame != 0)"                             << std::endl
+         << "      {"                                           << std::endl
+         << "         rd->spare = frame->next;"                 << std::endl
+         << "      }"                                           << std::endl
+         << "      else"                                        << std::endl
+         << "      {"                                           << std::endl
+         << "         frame = (" << classPrefix << "_frame_t*)calloc(1,sizeof(" << classPrefix << "_frame_t));"
+                                                                << std::endl
+         << "         rd->nframes++;"                           << std::endl
+         << "      }"                                           << std::endl
+         << "      pthread_mutex_unlock(&rd->lock);"            << std::endl
+                                                                << std::endl
+         << "      size = read_record(rd->fp);"                 << std::endl
+         << "      if (size >= 0)"                              << std::endl
+         << "      {"                                           << std::endl
+         << "         need_buffer(&frame->buffer,&frame->capacity,size + 4);"
+                                                                << std::endl
+         << "         memcpy(frame->buffer,rd->fp->iobuffer,size + 4);"
+                                                                << std::endl
+         << "         frame->size = size + 4;"                  << std::endl
+         << "      }"                                           << std::endl
+                                                                << std::endl
+         << "      pthread_mutex_lock(&rd->lock);"              << std::endl
+         << "      if (size < 0)"                               << std::endl
+         << "      {"                                           << std::endl
+         << "         frame->next = rd->spare;"                 << std::endl
+         << "         rd->spare = frame;"                       << std::endl
+         << "         rd->eof = 1;"                             << std::endl
+         << "         pthread_cond_broadcast(&rd->filled);"     << std::endl
+         << "         pthread_mutex_unlock(&rd->lock);"         << std::endl
+         << "         break;"                                   << std::endl
+         << "      }"                                           << std::endl
+         << "      frame->seqno = rd->seqno++;"                 << std::endl
+         << "      frame->next = 0;"                            << std::endl
+         << "      if (rd->ready_tail)"                         << std::endl
+         << "      {"                                           << std::endl
+         << "         rd->ready_tail->next = frame;"            << std::endl
+         << "      }"                                           << std::endl
+         << "      else"                                        << std::endl
+         << "      {"                                           << std::endl
+         << "         rd->ready_head = frame;"                  << std::endl
+         << "      }"                                           << std::endl
+         << "      rd->ready_tail = frame;"                     << std::endl
+         << "      pthread_cond_signal(&rd->filled);"           << std::endl
+         << "      pthread_mutex_unlock(&rd->lock);"            << std::endl
+         << "   }"                                              << std::endl
+         << "   return 0;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << classPrefix << "_reader_t* open_" << classPrefix << "_HDDM_reader(" << classPrefix << "_iostream_t* fp, int depth)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   " << classPrefix << "_reader_t* rd;"            << std::endl
+         << "   if (fp == 0 || fp->iomode != HDDM_STREAM_INPUT)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   rd = (" << classPrefix << "_reader_t*)calloc(1,sizeof(" << classPrefix << "_reader_t));"
+                                                                << std::endl
+         << "   rd->fp = fp;"                                   << std::endl
+         << "   rd->depth = (depth > 0)? depth : 1;"            << std::endl
+         << "   pthread_mutex_init(&rd->lock,0);"               << std::endl
+         << "   pthread_cond_init(&rd->filled,0);"              << std::endl
+         << "   pthread_cond_init(&rd->emptied,0);"             << std::endl
+         << "   if (pthread_create(&rd->thread,0,reader_thread,rd) != 0)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      fp->lerrno = errno;"                         << std::endl
+         << "      pthread_mutex_destroy(&rd->lock);"           << std::endl
+         << "      pthread_cond_destroy(&rd->filled);"          << std::endl
+         << "      pthread_cond_destroy(&rd->emptied);"         << std::endl
+         << "      free(rd);"                                   << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   return rd;"                                     << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << classPrefix << "_HDDM_t* read_" << classPrefix << "_HDDM_reader(" << classPrefix << "_reader_t* rd, popNode* pop, long* seqno)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Takes the next framed record off the reader and unpacks it in the"
+                                                                << std::endl
+         << "    * calling thread, using the pop tree given or else the stream's own."
+                                                                << std::endl
+         << "    * May be called concurrently from several threads. Returns 0 at the"
+                                                                << std::endl
+         << "    * end of the input."                           << std::endl
+         << "    */"                                            << std::endl
+         << "   " << classPrefix << "_frame_t* frame;"          << std::endl
+         << "   " << classPrefix << "_HDDM_t* record;"          << std::endl
+         << "   hddm_xdr_t xdrs;"                               << std::endl
+         << "   pthread_mutex_lock(&rd->lock);"                 << std::endl
+         << "   while (rd->ready_head == 0 && ! rd->eof)"       << std::endl
+         << "   {"                                              << std::endl
+         << "      pthread_cond_wait(&rd->filled,&rd->lock);"   << std::endl
+         << "   }"                                              << std::endl
+         << "   frame = rd->ready_head;"                        << std::endl
+         << "   if (frame == 0)"                                << std::endl
+         << "   {"                                              << std::endl
+         << "      pthread_mutex_unlock(&rd->lock);"            << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   rd->ready_head = frame->next;"                  << std::endl
+         << "   if (rd->ready_head == 0)"                       << std::endl
+         << "   {"                                              << std::endl
+         << "      rd->ready_tail = 0;"                         << std::endl
+         << "   }"                                              << std::endl
+         << "   pthread_mutex_unlock(&rd->lock);"               << std::endl
+                                                                << std::endl
+         << "   if (seqno)"                                     << std::endl
+         << "   {"                                              << std::endl
+         << "      *seqno = frame->seqno;"                      << std::endl
+         << "   }"                                              << std::endl
+         << "   hxdr_create(&xdrs,frame->buffer,frame->size);"  << std::endl
+         << "   record = unpack_" << classPrefix << "_HDDM(&xdrs,(pop)? pop : rd->fp->popTop);"
+                                                                << std::endl
+                                                                << std::endl
+         << "   pthread_mutex_lock(&rd->lock);"                 << std::endl
+         << "   frame->next = rd->spare;"                       << std::endl
+         << "   rd->spare = frame;"                             << std::endl
+         << "   pthread_cond_signal(&rd->emptied);"             << std::endl
+         << "   pthread_mutex_unlock(&rd->lock);"               << std::endl
+         << "   return (record == HDDM_NULL)? 0 : record;"      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl;
+
+   cFile << "static const char* unpacker_tag"
+         << "(void* (*unpacker)(hddm_xdr_t*, popNode*))"        << std::endl
+         << "{"                                                 << std::endl;
+   std::vector<DOMElement*>::iterator iter;
+   for (iter = tagList.begin(); iter != tagList.end(); iter++)
+   {
+      XtString tagS((*iter)->getTagName());
+      XtString repS((*iter)->getAttribute(X("maxOccurs")));
+      int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
+      XtString tagType = (rep > 1)? tagS.listType() : tagS.simpleType();
+      XtString tagT(tagType);
+      tagT.erase(tagT.rfind('_'));
+      cFile << "   if (unpacker == "
+            << "(void*(*)(hddm_xdr_t*,popNode*))"
+            << "unpack_" << tagT << ")"                         << std::endl
+            << "      return \"" << tagS << "\";"                << std::endl;
+   }
+   cFile << "   return \"\";"                                    << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static int tag_listed(const char* tag, const char* tags)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   size_t len = strlen(tag);"                      << std::endl
+         << "   const char* p;"                                 << std::endl
+         << "   for (p = strstr(tags,tag); p; p = strstr(p + 1,tag))"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      if ((p == tags || strchr(\" ,\",p[-1])) && strchr(\" ,\",p[len]))"
+                                                                << std::endl
+         << "      {"                                           << std::endl
+         << "         return 1;"                                << std::endl
+         << "      }"                                           << std::endl
+         << "   }"                                              << std::endl
+         << "   return 0;"                                      << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "static popNode* select_copy(popNode* p, const char* tags)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   popNode* copy;"                                 << std::endl
+         << "   int n;"                                         << std::endl
+         << "   if (p == 0 || tag_listed(unpacker_tag(p->unpacker),tags))"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      return 0;"                                   << std::endl
+         << "   }"                                              << std::endl
+         << "   copy = (popNode*)malloc(sizeof(popNode));"      << std::endl
+         << "   *copy = *p;"                                    << std::endl
+         << "   for (n = 0; n < p->popListLength; n++)"         << std::endl
+         << "   {"                                              << std::endl
+         << "      copy->popList[n] = select_copy(p->popList[n],tags);"
+                                                                << std::endl
+         << "   }"                                              << std::endl
+         << "   return copy;"                                   << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "popNode* select_" << classPrefix << "_HDDM_reader(" << classPrefix << "_reader_t* rd, const char* tags)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Returns a copy of the stream's pop tree in which the listed tags,"
+                                                                << std::endl
+         << "    * separated by spaces or commas, are skipped over together with all"
+                                                                << std::endl
+         << "    * of their contents. The copy belongs to the reader and is freed by"
+                                                                << std::endl
+         << "    * close_" << classPrefix << "_HDDM_reader()."  << std::endl
+         << "    */"                                            << std::endl
+         << "   " << classPrefix << "_selection_t* sel = (" << classPrefix << "_selection_t*)malloc(sizeof(" << classPrefix << "_selection_t));"
+                                                                << std::endl
+         << "   int n;"                                         << std::endl
+         << "   sel->popTop = (popNode*)malloc(sizeof(popNode));"
+                                                                << std::endl
+         << "   *sel->popTop = *rd->fp->popTop;"                << std::endl
+         << "   for (n = 0; n < sel->popTop->popListLength; n++)"
+                                                                << std::endl
+         << "   {"                                              << std::endl
+         << "      sel->popTop->popList[n] = select_copy(rd->fp->popTop->popList[n],tags);"
+                                                                << std::endl
+         << "   }"                                              << std::endl
+         << "   pthread_mutex_lock(&rd->lock);"                 << std::endl
+         << "   sel->next = rd->selections;"                    << std::endl
+         << "   rd->selections = sel;"                          << std::endl
+         << "   pthread_mutex_unlock(&rd->lock);"               << std::endl
+         << "   return sel->popTop;"                            << std::endl
+         << "}"                                                 << std::endl
+                                                                << std::endl
+         << "void close_" << classPrefix << "_HDDM_reader(" << classPrefix << "_reader_t* rd)"
+                                                                << std::endl
+         << "{"                                                 << std::endl
+         << "   /* Stops the reader thread and frees its frames. Records read ahead"
+                                                                << std::endl
+         << "    * but not yet taken are discarded. The input stream stays open, and"
+                                                                << std::endl
+         << "    * must still be closed with close_" << classPrefix << "_HDDM()."
+                                                                << std::endl
+         << "    */"                                            << std::endl
+         << "   pthread_mutex_lock(&rd->lock);"                 << std::endl
+         << "   rd->stop = 1;"                                  << std::endl
+         << "   pthread_cond_broadcast(&rd->emptied);"          << std::endl
+         << "   pthread_mutex_unlock(&rd->lock);"               << std::endl
+         << "   pthread_join(rd->thread,0);"                    << std::endl
+         << "   while (rd->ready_head)"                         << std::endl
+         << "   {"                                              << std::endl
+         << "      " << classPrefix << "_frame_t* frame = rd->ready_head;"
+                                                                << std::endl
+         << "      rd->ready_head = frame->next;"               << std::endl
+         << "      frame->next = rd->spare;"                    << std::endl
+         << "      rd->spare = frame;"                          << std::endl
+         << "   }"                                              << std::endl
+         << "   while (rd->spare)"                              << std::endl
+         << "   {"                                              << std::endl
+         << "      " << classPrefix << "_frame_t* frame = rd->spare;"
+                                                                << std::endl
+         << "      rd->spare = frame->next;"                    << std::endl
+         << "      free(frame->buffer);"                        << std::endl
+         << "      free(frame);"                                << std::endl
+         << "   }"                                              << std::endl
+         << "   while (rd->selections)"                         << std::endl
+         << "   {"                                              << std::endl
+         << "      " << classPrefix << "_selection_t* sel = rd->selections;"
+                                                                << std::endl
+         << "      rd->selections = sel->next;"                 << std::endl
+         << "      popaway(sel->popTop);"                       << std::endl
+         << "      free(sel);"                                  << std::endl
+         << "   }"                                              << std::endl
+         << "   pthread_mutex_destroy(&rd->lock);"              << std::endl
+         << "   pthread_cond_destroy(&rd->filled);"             << std::endl
+         << "   pthread_cond_destroy(&rd->emptied);"            << std::endl
+         << "   free(rd);"                                      << std::endl
+         << "}"                                                 << std::endl;
+}
+
 /* Generate the xml template in normal form and store in a string */
 
 void CodeBuilder::constructDocument(DOMElement* el)
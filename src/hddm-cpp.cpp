@@ -84,6 +84,7 @@
 
 #include <particleType.h>
 #include <errno.h>
+#include <stdint.h>
 #ifdef _WIN32
 #include <unistd_win32.h>
 #else
@@ -93,6 +94,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
@@ -102,20 +104,23 @@
 using namespace xercesc;
 
 XString classPrefix;
+bool compactLayout = false;
 
 void usage()
 {
    std::cerr
         << "\nUsage:\n"
-        << "    hddm-cpp [-v | -o <filename>] {HDDM file}\n\n"
+        << "    hddm-cpp [-v | -c | -o <filename>] {HDDM file}\n\n"
         << "Options:\n"
         <<  "    -v			validate only\n"
+        <<  "    -c			pack element data members, allocate elements from slabs\n"
         <<  "    -o <filename>	write to <filename>.hpp, <filename>++.cpp"
         << "Version: " << HDDM_VERSION_MAJOR << "." << HDDM_VERSION_MINOR
         << std::endl;
 }
 
 std::string guessType(const std::string &literal);
+int memberGroup(const std::string &type);
 Particle_t lookupParticle(const std::string &name);
 
 class XtString : public XString
@@ -155,10 +160,14 @@ class CodeBuilder
    void writeClassimp(DOMElement* el);
    void constructDocument(DOMElement* el);
    void constructGroup(DOMElement* el);
+   void constructAttributeIDs(DOMElement* el);
    void constructIOstreams(DOMElement* el);
    void constructMethods(DOMElement* el);
    void constructStreamers(DOMElement* el);
    void writeStreamers(DOMElement* el);
+   void constructViews();
+   void writeViewdef(DOMElement* el);
+   void writeViewimp(DOMElement* el);
 
  private:
    std::vector<DOMElement*> tagList;
@@ -167,7 +176,10 @@ class CodeBuilder
    parentList_t parentList;
    parentTable_t parents;
    parentTable_t children;
+   std::map<const XtString,int> contexts;
+   std::vector<XtString> attrNames;
    int element_in_list(XtString &name, parentList_t list);
+   XtString ancestorPath(XtString &tagS, XtString &attrS);
 };
 
 
@@ -211,6 +223,10 @@ int main(int argC, char* argV[])
       {
          verifyOnly = true;
       }
+      else if (strcmp(argV[argInd],"-c") == 0)
+      {
+         compactLayout = true;
+      }
       else if (strcmp(argV[argInd],"-o") == 0)
       {
          hFilename = XtString(argV[++argInd]);
@@ -394,16 +410,25 @@ int main(int argC, char* argV[])
    "#include <map>\n"
    "#include <list>\n"
    "#include <deque>\n"
+   "#include <memory>\n"
    "#include <vector>\n"
    "#include <string>\n"
+   "#include <string_view>\n"
+   "#include <cstring>\n"
    "#include <atomic>\n"
+   "#include <chrono>\n"
+   "#include <iterator>\n"
+   "#include <algorithm>\n"
    "#include <sstream>\n"
+   "#include <charconv>\n"
    "#include <stdexcept>\n"
+   "#include <type_traits>\n"
    "#include <streambuf>\n"
    "#include <xstream/z.h>\n"
    "#include <xstream/bz.h>\n"
    "#include <xstream/xdr.h>\n"
    "#include <xstream/digest.h>\n"
+   "#include <xstream/fd.h>\n"
    "#include <particleType.h>\n"
    "#include <pthread.h>\n"
    "#include <assert.h>\n"
@@ -452,6 +477,11 @@ int main(int argC, char* argV[])
    "   k_hddm_Particle_t\n"
    "};\n"
    "\n"
+   ;
+
+   builder.constructAttributeIDs(rootEl);
+
+   builder.hFile <<
    "#ifdef HDF5_SUPPORT\n"
    "#define HDF5_DEFAULT_CHUNK_SIZE 100\n"
    "// gzip standard compression provided by hdf5\n"
@@ -477,6 +507,7 @@ int main(int argC, char* argV[])
    "#endif\n"
    "\n"
    "class HDDM;\n"
+   "class HDDMView;\n"
    "class istream;\n"
    "class ostream;\n"
    "\n"
@@ -524,18 +555,76 @@ int main(int argC, char* argV[])
    "   static int getID() {\n"
    "      // protected access to the ID tls data member\n"
    "      if (ID == 0) {\n"
-   "         if (ID >= max_threads) {\n"
-   "            throw std::runtime_error(\"hddm_" 
-                                       << classPrefix << "::threads::getID - \"\n"
-   "                                     \"thread count exceeds max_threads\");\n"
-   "         }\n"
-   "         ID = ++next_unique_ID;\n"
+   "         ID = assignID();\n"
    "      }\n"
    "      return ID;\n"
    "   }\n"
+   "   // Hands the ID of the calling thread back for reuse by threads\n"
+   "   // started later. Only for threads about to exit that hold no\n"
+   "   // stream state under their ID any more.\n"
+   "   static void releaseID();\n"
    "   static const int max_threads = 999;\n"
    " protected:\n"
+   "   static int assignID();\n"
    "   static std::atomic<int> next_unique_ID;\n"
+   "   static std::vector<int> spare_IDs;\n"
+   "   static pthread_mutex_t spare_IDs_mutex;\n"
+   "};\n"
+   "\n"
+   "class bufferpool {\n"
+   " public:\n"
+   "   // Event buffers are shared by all streams in the process; each\n"
+   "   // stream thread checks one out only while a record is in flight.\n"
+   "   // Idle buffers are kept for reuse up to the memory budget, and\n"
+   "   // are released once they have sat unused for the idle timeout.\n"
+   "   // Each thread also holds on to a few small idle buffers of its\n"
+   "   // own, which count as idle and are given back to the shared pool\n"
+   "   // when the thread exits, or at its next checkout or checkin after\n"
+   "   // trim() or setBudget(); trim() empties the caller's own at once.\n"
+   "   // Expiry runs on the shared pool at most once a second, on the\n"
+   "   // first call to reach it, so a pool nobody calls stays as it is\n"
+   "   // until the next call or trim().\n"
+   "   static char *checkout(int &size);\n"
+   "   static void checkin(char *buffer, int size);\n"
+   "   static void setBudget(size_t bytes);\n"
+   "   static size_t getBudget();\n"
+   "   static void setIdleTimeout(int seconds);\n"
+   "   static int getIdleTimeout();\n"
+   "   static size_t getBytesIdle();\n"
+   "   static size_t getBytesInUse();\n"
+   "   static void trim();\n"
+   "   static const int k_min_buffer_size = 0x20000;\n"
+   "   static const int k_size_classes = 14;\n"
+   " private:\n"
+   "   static const int k_local_classes = 4;\n"
+   "   static const int k_local_buffers = 2;\n"
+   "   static constexpr int k_expire_period = 1;\n"
+   "   typedef struct {\n"
+   "      char *m_buffer;\n"
+   "      std::chrono::steady_clock::time_point m_since;\n"
+   "   } idle_buffer;\n"
+   "   typedef std::deque<idle_buffer> idle_list;\n"
+   "   class local_cache {\n"
+   "    public:\n"
+   "      local_cache() : m_count(), m_epoch(0) {}\n"
+   "      ~local_cache();\n"
+   "      void flush();\n"
+   "      char *m_buffer[k_local_classes][k_local_buffers];\n"
+   "      int m_count[k_local_classes];\n"
+   "      int m_epoch;\n"
+   "   };\n"
+   "   static int size_class(int size);\n"
+   "   static void release(char *buffer, int size);\n"
+   "   static void expire(size_t budget);\n"
+   "   static idle_list *s_idle;\n"
+   "   static thread_local local_cache s_local;\n"
+   "   static std::atomic<size_t> s_budget;\n"
+   "   static int s_idle_timeout;\n"
+   "   static std::atomic<int> s_epoch;\n"
+   "   static std::chrono::steady_clock::time_point s_next_expiry;\n"
+   "   static std::atomic<size_t> s_bytes_idle;\n"
+   "   static std::atomic<size_t> s_bytes_in_use;\n"
+   "   static pthread_mutex_t s_mutex;\n"
    "};\n"
    "\n"
    "class istreambuffer : public std::streambuf {\n"
@@ -565,6 +654,10 @@ int main(int argC, char* argV[])
    "      setg(gbegin, gbegin, gend);\n"
    "   }\n"
    "\n"
+   "   void setbuffer(char* buffer, std::streamsize bufferLength) {\n"
+   "      setg(buffer, buffer, buffer + bufferLength);\n"
+   "   }\n"
+   "\n"
    "   char *getbuf() {\n"
    "      return eback();\n"
    "   }\n"
@@ -597,16 +690,97 @@ int main(int argC, char* argV[])
    "      setp(pbegin, pend);\n"
    "   }\n"
    "\n"
+   "   void setbuffer(char* buffer, std::streamsize bufferLength) {\n"
+   "      setp(buffer, buffer + bufferLength);\n"
+   "   }\n"
+   "\n"
    "   char *getbuf() {\n"
    "      return pbase();\n"
    "   }\n"
+   "\n"
+   "   int capacity() {\n"
+   "      return int(epptr() - pbase());\n"
+   "   }\n"
+   "\n"
+   " protected:\n"
+   "   // A record that outgrows the buffer is moved into one twice the\n"
+   "   // size taken from the buffer pool, and serialization carries on\n"
+   "   // from where it stopped, so each record is encoded exactly once.\n"
+   "   int_type overflow(int_type c) {\n"
+   "      std::streamoff used = size();\n"
+   "      if (capacity() > INT_MAX / 2)\n"
+   "         throw std::runtime_error(\"ostreambuffer error - \"\n"
+   "                                  \"record exceeds the maximum size of 1GB\");\n"
+   "      int newsize = std::max(capacity() * 2,\n"
+   "                             int(bufferpool::k_min_buffer_size));\n"
+   "      char *buffer = bufferpool::checkout(newsize);\n"
+   "      if (pbase() != 0) {\n"
+   "         memcpy(buffer, pbase(), used);\n"
+   "         bufferpool::checkin(pbase(), capacity());\n"
+   "      }\n"
+   "      setbuffer(buffer, newsize);\n"
+   "      seekp(used);\n"
+   "      if (!traits_type::eq_int_type(c, traits_type::eof())) {\n"
+   "         *pptr() = traits_type::to_char_type(c);\n"
+   "         pbump(1);\n"
+   "      }\n"
+   "      return traits_type::not_eof(c);\n"
+   "   }\n"
+   "};\n"
+   "\n"
+   "class asyncsink : public std::streambuf {\n"
+   " public:\n"
+   "   // Output written to an asyncsink is collected into blocks that\n"
+   "   // are handed to a background thread for writing to the target\n"
+   "   // streambuf, so the producer does not wait on slow storage. At\n"
+   "   // most max_blocks full blocks are queued at any time, after that\n"
+   "   // the producer waits for the writer to catch up. A write error in\n"
+   "   // the background is reported by the next overflow or sync call.\n"
+   "   asyncsink(std::streambuf *target, int max_blocks);\n"
+   "   ~asyncsink();\n"
+   "   int close();\n"
+   "   bool failed();\n"
+   "   static const int k_block_size = bufferpool::k_min_buffer_size * 8;\n"
+   " protected:\n"
+   "   int_type overflow(int_type c);\n"
+   "   int sync();\n"
+   "   std::streampos seekoff(std::streamoff off, std::ios_base::seekdir dir,\n"
+   "                          std::ios_base::openmode which);\n"
+   " private:\n"
+   "   typedef struct {\n"
+   "      char *m_buffer;\n"
+   "      int m_size;\n"
+   "      int m_used;\n"
+   "   } block;\n"
+   "   void enqueue();\n"
+   "   void drain();\n"
+   "   static void *writer(void *sink);\n"
+   "   std::streambuf *m_target;\n"
+   "   std::streamoff m_base;\n"
+   "   std::streamoff m_queued;\n"
+   "   std::deque<block> m_queue;\n"
+   "   int m_max_blocks;\n"
+   "   int m_block_size;\n"
+   "   bool m_running;\n"
+   "   bool m_busy;\n"
+   "   bool m_stop;\n"
+   "   bool m_failed;\n"
+   "   pthread_t m_thread;\n"
+   "   pthread_mutex_t m_mutex;\n"
+   "   pthread_cond_t m_ready;\n"
+   "   pthread_cond_t m_drained;\n"
    "};\n"
    "\n"
    "class ostream {\n"
    " public:\n"
-   "   ostream(std::ostream &src);\n"
+   "   // If async_blocks > 0 the output is written to src by a\n"
+   "   // background thread, with up to async_blocks blocks of\n"
+   "   // asyncsink::k_block_size bytes queued behind it.\n"
+   "   ostream(std::ostream &src, int async_blocks=0);\n"
    "   ~ostream();\n"
    "   ostream &operator<<(HDDM &record);\n"
+   "   void flush();\n"
+   "   void close();\n"
    "   int getCompression() const;\n"
    "   void setCompression(int flags);\n"
    "   int getIntegrityChecks() const;\n"
@@ -625,6 +799,8 @@ int main(int argC, char* argV[])
    "   void lock_streambufs();\n"
    "   void unlock_streambufs();\n"
    "   std::ostream &m_ostr;\n"
+   "   asyncsink *m_async;\n"
+   "   std::streambuf *m_sink;\n"
    "   std::atomic<int> m_status_bits;\n"
    "   pthread_mutex_t m_streambuf_mutex;\n"
    "\n"
@@ -633,8 +809,6 @@ int main(int argC, char* argV[])
    "      std::ostream *m_ostr;\n"
    "      ostreambuffer *m_sbuf;\n"
    "      std::streambuf *m_xcmp;\n"
-   "      char *m_event_buffer;\n"
-   "      int m_event_buffer_size;\n"
    "      std::streampos m_last_start;\n"
    "      std::streamoff m_last_offset;\n"
    "      int m_status_bits;\n"
@@ -646,15 +820,23 @@ int main(int argC, char* argV[])
    "   thread_private_data *my_thread_private[threads::max_threads];\n"
    "   thread_private_data *lookup_private_data();\n"
    "   void init_private_data();\n"
+   "   void acquire_event_buffer(int size);\n"
+   "   void release_event_buffer();\n"
    "};\n"
    "\n"
+   "// The decode plan matching the tags in the header of an input file\n"
+   "// to the classes in this library. It is built once per distinct\n"
+   "// header and shared read-only by all streams and threads using it.\n"
+   "// A codon whose subtree matches the library exactly is marked as an\n"
+   "// identity, and is decoded directly without reordering children.\n"
+   "\n"
    "class codon {\n"
    " public:\n"
-   "   codon(): m_order(0) {}\n"
+   "   codon(): m_order(0), m_identity(false) {}\n"
    "   int m_order;\n"
+   "   bool m_identity;\n"
    "   std::string m_tagname;\n"
    "   std::vector<codon> m_sequence;\n"
-   "   std::deque<streamable*> m_target;\n"
    "};\n"
    "\n"
    "typedef std::vector<codon> chromosome;\n"
@@ -662,8 +844,23 @@ int main(int argC, char* argV[])
    "class istream {\n"
    " public:\n"
    "   istream(std::istream &src);\n"
+   "   // Reads only the records that begin within bytes [begin,end) of\n"
+   "   // the input file, so a set of contiguous ranges that covers the\n"
+   "   // file delivers each record exactly once. A negative end means\n"
+   "   // read to the end of the file.\n"
+   "   istream(std::istream &src, std::streamoff begin, std::streamoff end);\n"
    "   ~istream();\n"
    "   istream &operator>>(HDDM &record);\n"
+   "   istream &operator>>(HDDMView &view);\n"
+   "   // True if the input file has the same data model as this library,\n"
+   "   // which is what reading records as views requires.\n"
+   "   bool viewable() const;\n"
+   "   // Copies the next record without decoding it, as the bytes that\n"
+   "   // ostream::operator<< writes for it on an uncompressed stream\n"
+   "   // without integrity checks. Like views, this needs an input file\n"
+   "   // with the same data model as this library. bytes is left empty\n"
+   "   // at the end of the input.\n"
+   "   istream &readRaw(std::string &bytes);\n"
    "   void skip(int count);\n"
    "   int getCompression() const;\n"
    "   int getIntegrityChecks() const;\n"
@@ -674,6 +871,11 @@ int main(int argC, char* argV[])
    "   bool eof();\n"
    "   bool operator!();\n"
    "   operator void*();\n"
+   "   // Moves the reading state of this stream held for one thread,\n"
+   "   // its position and any input already decompressed, over to\n"
+   "   // another thread, which then continues from where the first\n"
+   "   // one stopped. Neither thread may be using the stream meanwhile.\n"
+   "   void handover(int from_thread, int to_thread);\n"
    " //protected:\n"
    "   void reset_sequencer();\n"
    "   void sequencer(streamable &object);\n"
@@ -684,8 +886,16 @@ int main(int argC, char* argV[])
    "\n"
    " private:\n"
    "   std::string m_documentString;\n"
-   "   chromosome synthesize(const std::string &src, size_t p_src,\n"
-   "                         const std::string &ref, size_t p_ref);\n"
+   "   std::shared_ptr<const codon> m_genome;\n"
+   "   std::shared_ptr<const codon> lookup_genome();\n"
+   "   void synthesize(codon &gene, const std::string &src, size_t p_src,\n"
+   "                   const std::string &ref, size_t p_ref);\n"
+   "   bool load_record();\n"
+   "   int pread_record();\n"
+   "   void verify_crc(char *crcbuf);\n"
+   "   void set_range(std::streamoff begin, std::streamoff end);\n"
+   "   std::streamoff find_record(std::streamoff start, std::streamoff begin);\n"
+   "   std::streamoff find_block(std::streamoff begin);\n"
    "   size_t getTag(const std::string &src, size_t p_src, std::string &tag, int &level);\n"
    "   size_t getEndTag(const std::string &src, size_t p_src, const std::string &tag);\n"
    "   void collide(const std::string &itag, const std::string &rtag);\n"
@@ -694,13 +904,15 @@ int main(int argC, char* argV[])
    "   void lock_streambufs();\n"
    "   void unlock_streambufs();\n"
    "   std::istream &m_istr;\n"
+   "   xstream::fd::preadbuf *m_pread;\n"
+   "   std::streamoff m_range_end;\n"
    "   std::atomic<int> m_status_bits;\n"
    "   pthread_mutex_t m_streambuf_mutex;\n"
    "   int m_leftovers[100];\n"
    "\n"
    "   typedef struct {\n"
-   "      codon m_genome;\n"
-   "      codon *m_codon;\n"
+   "      const codon *m_codon;\n"
+   "      std::vector<streamable*> m_targets;\n"
    "      int m_sequencing;\n"
    "      xstream::xdr::istream *m_xstr;\n"
    "      std::istream *m_istr;\n"
@@ -723,22 +935,294 @@ int main(int argC, char* argV[])
    "   thread_private_data *my_thread_private[threads::max_threads];\n"
    "   thread_private_data *lookup_private_data();\n"
    "   void init_private_data();\n"
+   "   void free_private_data(int threadID);\n"
+   "   void acquire_event_buffer(int size);\n"
+   "   void release_event_buffer();\n"
+   "   friend class chain;\n"
+   "};\n"
+   "\n"
+   "// Reads the records from a list of input files as one stream. The\n"
+   "// files are read by a background thread, which keeps up to depth\n"
+   "// records decoded ahead of the caller. A second thread opens file\n"
+   "// n+1 and decodes its first depth records as soon as reading of\n"
+   "// file n is under way, so the header parsing, decompression and\n"
+   "// cold start of the next file overlap with the records of file n.\n"
+   "// Every file must have the same data model as the first, anything\n"
+   "// else is reported as an error. Files are opened with std::ifstream\n"
+   "// unless an opener is given, eg. one returning an httpIstream or\n"
+   "// xrootdIstream for urls. Any error opening or reading a file is\n"
+   "// thrown to the caller when the chain reaches that point in the\n"
+   "// input.\n"
+   "\n"
+   "class chain {\n"
+   " public:\n"
+   "   typedef std::istream *(*opener)(const std::string &path);\n"
+   "   chain(const std::vector<std::string> &paths, opener open=0,\n"
+   "         int depth=64);\n"
+   "   ~chain();\n"
+   "   chain &operator>>(HDDM &record);\n"
+   "   int getFileIndex() const;\n"
+   "   const std::string &getFileName(int index) const;\n"
+   "   int getFileCount() const;\n"
+   "   size_t getFileStart(int index) const;\n"
+   "   size_t getRecordsRead() const;\n"
+   "   bool eof();\n"
+   "   bool operator!();\n"
+   "   operator void*();\n"
+   "   static constexpr size_t k_not_reached = (size_t)-1;\n"
+   " private:\n"
+   "   chain(const chain &src);\n"
+   "   chain &operator=(const chain &src);\n"
+   "   typedef struct {\n"
+   "      HDDM *m_record;\n"
+   "      int m_file;\n"
+   "   } entry;\n"
+   "   typedef struct {\n"
+   "      std::istream *m_stream;\n"
+   "      istream *m_hddm;\n"
+   "      int m_thread;\n"
+   "      std::vector<HDDM*> m_head;\n"
+   "      std::string m_error;\n"
+   "   } member;\n"
+   "   static void *reader(void *me);\n"
+   "   static void *prefetcher(void *me);\n"
+   "   void read_files();\n"
+   "   void prefetch_files();\n"
+   "   void open_file(int index, member &file);\n"
+   "   void close_file(member &file);\n"
+   "   void request_file(int index);\n"
+   "   bool collect_file(member &file);\n"
+   "   bool push(HDDM *record, int file);\n"
+   "   std::vector<std::string> m_paths;\n"
+   "   std::string m_header;\n"
+   "   std::vector<size_t> m_file_start;\n"
+   "   opener m_open;\n"
+   "   int m_depth;\n"
+   "   int m_file;\n"
+   "   size_t m_records_read;\n"
+   "   bool m_hit_eof;\n"
+   "   std::deque<entry> m_queue;\n"
+   "   std::vector<HDDM*> m_spares;\n"
+   "   std::string m_error;\n"
+   "   bool m_done;\n"
+   "   bool m_stop;\n"
+   "   member m_ahead;\n"
+   "   int m_ahead_index;\n"
+   "   bool m_ahead_ready;\n"
+   "   pthread_t m_thread;\n"
+   "   pthread_t m_prefetch_thread;\n"
+   "   pthread_mutex_t m_mutex;\n"
+   "   pthread_cond_t m_filled;\n"
+   "   pthread_cond_t m_drained;\n"
+   "   pthread_cond_t m_ahead_changed;\n"
+   "};\n"
+   "\n"
+   "// Growable output buffer used by the writeXML and writeString methods,\n"
+   "// which format records directly into it instead of building strings\n"
+   "// for each element and concatenating them on the way back up the tree.\n"
+   "// If constructed on a std::ostream, it drains into the stream whenever\n"
+   "// the buffer passes k_flush_size and again when it goes out of scope.\n"
+   "\n"
+   "class buffersink {\n"
+   " public:\n"
+   "   static const size_t k_flush_size = 0x10000;\n"
+   "\n"
+   "   buffersink() : m_ostr(0) {}\n"
+   "   explicit buffersink(std::ostream &ostr) : m_ostr(&ostr) {}\n"
+   "   ~buffersink() { flush(); }\n"
+   "\n"
+   "   buffersink &operator<<(const char *str) {\n"
+   "      m_buffer.append(str);\n"
+   "      return drain();\n"
+   "   }\n"
+   "   buffersink &operator<<(const std::string &str) {\n"
+   "      m_buffer.append(str);\n"
+   "      return drain();\n"
+   "   }\n"
+   "   buffersink &operator<<(char c) {\n"
+   "      m_buffer.push_back(c);\n"
+   "      return drain();\n"
+   "   }\n"
+   "   buffersink &operator<<(bool value) {\n"
+   "      m_buffer.push_back((value)? '1' : '0');\n"
+   "      return drain();\n"
+   "   }\n"
+   "   buffersink &operator<<(int value) { return format(value); }\n"
+   "   buffersink &operator<<(int64_t value) { return format(value); }\n"
+   "   buffersink &operator<<(float value) { return format(value); }\n"
+   "   buffersink &operator<<(double value) { return format(value); }\n"
+   "\n"
+   "   buffersink &indent(int count) {\n"
+   "      if (count > 0)\n"
+   "         m_buffer.append(count, ' ');\n"
+   "      return *this;\n"
+   "   }\n"
+   "   const char *data() const { return m_buffer.data(); }\n"
+   "   size_t size() const { return m_buffer.size(); }\n"
+   "   std::string str() const { return m_buffer; }\n"
+   "   void flush() {\n"
+   "      if (m_ostr != 0 && m_buffer.size() > 0) {\n"
+   "         m_ostr->write(m_buffer.data(), m_buffer.size());\n"
+   "         m_buffer.clear();\n"
+   "      }\n"
+   "   }\n"
+   "\n"
+   " private:\n"
+   "   // floating point values are formatted like the default std::ostream\n"
+   "   // conversion (%g with 6 significant digits) so that the output of\n"
+   "   // writeXML matches what operator<< has always produced\n"
+   "   template <typename V>\n"
+   "   buffersink &format(V value) {\n"
+   "      char digits[32];\n"
+   "      std::to_chars_result res;\n"
+   "      if constexpr (std::is_floating_point<V>::value)\n"
+   "         res = std::to_chars(digits, digits + sizeof(digits), value,\n"
+   "                             std::chars_format::general, 6);\n"
+   "      else\n"
+   "         res = std::to_chars(digits, digits + sizeof(digits), value);\n"
+   "      m_buffer.append(digits, res.ptr - digits);\n"
+   "      return drain();\n"
+   "   }\n"
+   "   buffersink &drain() {\n"
+   "      if (m_ostr != 0 && m_buffer.size() > k_flush_size)\n"
+   "         flush();\n"
+   "      return *this;\n"
+   "   }\n"
+   "\n"
+   "   std::ostream *m_ostr;\n"
+   "   std::string m_buffer;\n"
+   "};\n"
+   "\n"
+   "class elementpools {\n"
+   " public:\n"
+   "   // Hands back to the heap every slab of the element pools that has\n"
+   "   // all of its slots free, for all element types in use.\n"
+   "   static void trim();\n"
+   " protected:\n"
+   "   static void enroll(void (*trim_slabs)());\n"
+   "   static std::vector<void (*)()> *s_pools;\n"
+   "   static pthread_mutex_t s_mutex;\n"
+   "};\n"
+   "\n"
+   "template <class T>\n"
+   "class elementpool: public elementpools {\n"
+   " public:\n"
+   "   // Classes generated with the compact layout (hddm-cpp -c) take\n"
+   "   // their elements from fixed-size slots carved out of large slabs,\n"
+   "   // which saves the per-allocation overhead of the heap and keeps\n"
+   "   // elements of the same type together. Free slots are recycled,\n"
+   "   // and slabs left with no element in them are only returned to\n"
+   "   // the heap by elementpools::trim().\n"
+   "   static const int k_slab_slots = 1024;\n"
+   "\n"
+   "   static void *allocate(size_t size) {\n"
+   "      if (size != sizeof(T))\n"
+   "         return ::operator new(size);\n"
+   "      pthread_mutex_lock(&s_slab_mutex);\n"
+   "      if (s_free == 0) {\n"
+   "         slot *slab = (slot*)::operator new(sizeof(slot) * k_slab_slots);\n"
+   "         for (int n = k_slab_slots - 1; n >= 0; --n) {\n"
+   "            slab[n].m_next = s_free;\n"
+   "            s_free = &slab[n];\n"
+   "         }\n"
+   "         if (s_slabs.size() == 0)\n"
+   "            enroll(trim_slabs);\n"
+   "         s_slabs.insert(std::upper_bound(s_slabs.begin(), s_slabs.end(),\n"
+   "                                         slab), slab);\n"
+   "      }\n"
+   "      slot *next = s_free;\n"
+   "      s_free = next->m_next;\n"
+   "      pthread_mutex_unlock(&s_slab_mutex);\n"
+   "      return next;\n"
+   "   }\n"
+   "\n"
+   "   static void release(void *ptr, size_t size) {\n"
+   "      if (ptr == 0)\n"
+   "         return;\n"
+   "      else if (size != sizeof(T))\n"
+   "         return ::operator delete(ptr);\n"
+   "      pthread_mutex_lock(&s_slab_mutex);\n"
+   "      ((slot*)ptr)->m_next = s_free;\n"
+   "      s_free = (slot*)ptr;\n"
+   "      pthread_mutex_unlock(&s_slab_mutex);\n"
+   "   }\n"
+   "\n"
+   " private:\n"
+   "   union slot {\n"
+   "      slot *m_next;\n"
+   "      alignas(T) char m_data[sizeof(T)];\n"
+   "   };\n"
+   "\n"
+   "   static int slab_of(slot *s) {\n"
+   "      return int(std::upper_bound(s_slabs.begin(), s_slabs.end(), s) -\n"
+   "                 s_slabs.begin()) - 1;\n"
+   "   }\n"
+   "\n"
+   "   static void trim_slabs() {\n"
+   "      // counts the free slots of each slab, then unlinks and deletes\n"
+   "      // the slabs where every slot is free\n"
+   "      pthread_mutex_lock(&s_slab_mutex);\n"
+   "      std::vector<int> nfree(s_slabs.size(), 0);\n"
+   "      for (slot *s = s_free; s != 0; s = s->m_next)\n"
+   "         ++nfree[slab_of(s)];\n"
+   "      slot **link = &s_free;\n"
+   "      while (*link != 0) {\n"
+   "         if (nfree[slab_of(*link)] == k_slab_slots)\n"
+   "            *link = (*link)->m_next;\n"
+   "         else\n"
+   "            link = &(*link)->m_next;\n"
+   "      }\n"
+   "      size_t kept = 0;\n"
+   "      for (size_t n = 0; n < s_slabs.size(); ++n) {\n"
+   "         if (nfree[n] == k_slab_slots)\n"
+   "            ::operator delete(s_slabs[n]);\n"
+   "         else\n"
+   "            s_slabs[kept++] = s_slabs[n];\n"
+   "      }\n"
+   "      s_slabs.resize(kept);\n"
+   "      pthread_mutex_unlock(&s_slab_mutex);\n"
+   "   }\n"
+   "\n"
+   "   static slot *s_free;\n"
+   "   static std::vector<slot*> s_slabs;\n"
+   "   static pthread_mutex_t s_slab_mutex;\n"
    "};\n"
    "\n"
+   "template <class T>\n"
+   "typename elementpool<T>::slot *elementpool<T>::s_free = 0;\n"
+   "template <class T>\n"
+   "std::vector<typename elementpool<T>::slot*> elementpool<T>::s_slabs;\n"
+   "template <class T>\n"
+   "pthread_mutex_t elementpool<T>::s_slab_mutex = PTHREAD_MUTEX_INITIALIZER;\n"
+   "\n"
    "template <class T> class HDDM_ElementList;\n"
    "\n"
    "class HDDM_Element: public streamable {\n"
    " public:\n"
    "   virtual ~HDDM_Element() = default;\n"
    "   virtual void clear() {}\n"
-   "   virtual const void *getAttribute(const std::string &name,\n"
+   "   virtual const void *getAttribute(attr_id id,\n"
    "                                    hddm_type *atype=0) const {\n"
-   "      (void)name;\n"
+   "      (void)id;\n"
    "      (void)atype;\n"
    "      return 0;\n"
    "   }\n"
+   "   virtual const void *getAttribute(const std::string &name,\n"
+   "                                    hddm_type *atype=0) const {\n"
+   "      return getAttribute(lookupAttribute(name), atype);\n"
+   "   }\n"
    "   virtual std::string toString(int /* indent=0 */) { return \"\"; }\n"
    "   virtual std::string toXML(int /* indent=0 */) { return \"\"; }\n"
+   "   virtual void writeString(buffersink & /* sink */, int /* indent=0 */) {}\n"
+   "   virtual void writeXML(buffersink & /* sink */, int /* indent=0 */) {}\n"
+   "   void writeString(std::ostream &ostr, int indent=0) {\n"
+   "      buffersink sink(ostr);\n"
+   "      writeString(sink, indent);\n"
+   "   }\n"
+   "   void writeXML(std::ostream &ostr, int indent=0) {\n"
+   "      buffersink sink(ostr);\n"
+   "      writeXML(sink, indent);\n"
+   "   }\n"
    "   friend class HDDM_ElementList<HDDM_Element>;\n"
    " protected:\n"
    "   HDDM_Element() : m_parent(0), m_host(0), m_owner(0) {}\n"
@@ -752,6 +1236,18 @@ int main(int argC, char* argV[])
    "      m_host(src.m_host),\n"
    "      m_owner(0)\n"
    "   {}\n"
+   "   void adopt(HDDM_Element *parent) {\n"
+   "      m_parent = parent;\n"
+   "      if (m_host != parent->m_host)\n"
+   "         rehost(parent->m_host);\n"
+   "   }\n"
+   "   virtual void rehost(HDDM *host) { m_host = host; }\n"
+   "   const HDDM_Element *ancestor(int generations) const {\n"
+   "      const HDDM_Element *elem = this;\n"
+   "      for (; generations > 0; --generations)\n"
+   "         elem = elem->m_parent;\n"
+   "      return elem;\n"
+   "   }\n"
    "   HDDM_Element *m_parent;\n"
    "   HDDM *m_host;\n"
    "   int m_owner;\n"
@@ -760,7 +1256,21 @@ int main(int argC, char* argV[])
    "template <class T>\n"
    "class HDDM_ElementList: public streamable {\n"
    " public:\n"
-   "   HDDM_ElementList() : m_host_plist(0), m_parent(0) {}\n"
+   "   typedef std::vector<typename std::list<T*>::iterator> index_t;\n"
+   "   static const int k_min_indexed_size = 16;\n"
+   "\n"
+   "   // The index holds only the nodes of the list itself. The node just\n"
+   "   // past the end belongs to whatever follows in the host list, which\n"
+   "   // a sibling list sharing the host list can insert or erase at any\n"
+   "   // time, so it is always found live from the last node.\n"
+   "   static typename std::list<T*>::iterator index_node(const index_t &index,\n"
+   "                                                     int pos) {\n"
+   "      if (pos < (int)index.size())\n"
+   "         return index[pos];\n"
+   "      return std::next(index[pos - 1]);\n"
+   "   }\n"
+   "\n"
+   "   HDDM_ElementList() : m_host_plist(0), m_parent(0), m_index_ptr(0) {}\n"
    "   HDDM_ElementList(typename std::list<T*> *plist,\n"
    "                    typename std::list<T*>::iterator begin,\n"
    "                    typename std::list<T*>::iterator end,\n"
@@ -769,7 +1279,8 @@ int main(int argC, char* argV[])
    "      m_first_iter(begin),\n"
    "      m_last_iter(end),\n"
    "      m_parent(parent),\n"
-   "      m_ref(0)\n"
+   "      m_ref(0),\n"
+   "      m_index_ptr(0)\n"
    "   {\n"
    "      for (m_size = 0; begin != end; ++m_size, ++begin) {}\n"
    "      if (m_size) {\n"
@@ -783,8 +1294,15 @@ int main(int argC, char* argV[])
    "      m_last_iter(src.m_last_iter),\n"
    "      m_parent(src.m_parent),\n"
    "      m_size(src.m_size),\n"
-   "      m_ref(src.m_ref)\n"
-   "   {}\n"
+   "      m_ref(src.m_ref),\n"
+   "      m_index_ptr(0)\n"
+   "   {\n"
+   "      share_index(src);\n"
+   "   }\n"
+   "\n"
+   "   ~HDDM_ElementList() {\n"
+   "      drop_index();\n"
+   "   }\n"
    "\n"
    "   HDDM_ElementList& operator=(const HDDM_ElementList<T> &src)\n"
    "   {\n"
@@ -794,36 +1312,58 @@ int main(int argC, char* argV[])
    "      m_parent = src.m_parent;\n"
    "      m_size = src.m_size;\n"
    "      m_ref = src.m_ref;\n"
+   "      drop_index();\n"
+   "      share_index(src);\n"
    "      return *this;\n"
    "   }\n"
    "\n"
    "   bool empty() const { return (m_size == 0); }\n"
    "   int size() const { return m_size; }\n"
-   "   T &front() const { return *m_first_iter; }\n"
-   "   T &back() const { return *m_last_iter; }\n"
-   "   T &operator()() { return *m_first_iter; }\n"
+   "   T &front() const { return **m_first_iter; }\n"
+   "   T &back() const { return **m_last_iter; }\n"
+   "   T &operator()() { return **m_first_iter; }\n"
    "   T &operator()(int index) {\n"
    "      if (index == 0) {\n"
-   "         return *m_first_iter;\n"
+   "         return **m_first_iter;\n"
    "      }\n"
    "      else if (index == -1) {\n"
-   "         return *m_last_iter;\n"
-   "      }\n"
-   "      else if (index > 0) {\n"
-   "         return *(m_first_iter + index);\n"
+   "         return **m_last_iter;\n"
    "      }\n"
-   "      else {\n"
-   "         return *(m_last_iter + (++index));\n"
+   "      if (m_size > k_min_indexed_size) {\n"
+   "         build_index();\n"
    "      }\n"
+   "      return **position((index < 0)? index + m_size : index);\n"
    "   }\n"
    "\n"
+   "   // Iterators know their position in the list they came from, and\n"
+   "   // lists longer than k_min_indexed_size hand out iterators that\n"
+   "   // carry a shared table of node positions, so that all of the\n"
+   "   // random-access operations below take constant time. Elements\n"
+   "   // cannot be copied or moved, so algorithms that reorder a range,\n"
+   "   // like std::sort, are given the range of element pointers from\n"
+   "   // pointers() instead, eg.\n"
+   "   //    auto ptrs = list.pointers();\n"
+   "   //    std::sort(ptrs.begin(), ptrs.end(),\n"
+   "   //              [](const T *a, const T *b) { return ...; });\n"
+   "\n"
    "   class iterator: public std::list<T*>::iterator {\n"
    "    public:\n"
-   "      iterator() {}\n"
+   "      typedef std::random_access_iterator_tag iterator_category;\n"
+   "      typedef T value_type;\n"
+   "      typedef int difference_type;\n"
+   "      typedef T *pointer;\n"
+   "      typedef T &reference;\n"
+   "\n"
+   "      iterator() : m_pos(INT_MIN) {}\n"
    "      iterator(typename std::list<T*>::iterator src)\n"
-   "       : std::list<T*>::iterator(src) {}\n"
+   "       : std::list<T*>::iterator(src), m_pos(INT_MIN) {}\n"
+   "      iterator(typename std::list<T*>::iterator src, int pos)\n"
+   "       : std::list<T*>::iterator(src), m_pos(pos) {}\n"
+   "      iterator(const std::shared_ptr<const index_t> &index, int pos)\n"
+   "       : std::list<T*>::iterator(index_node(*index, pos)), m_index(index),\n"
+   "         m_pos(pos) {}\n"
    "\n"
-   "      T *operator->() const { \n"
+   "      T *operator->() const {\n"
    "         return *(typename std::list<T*>::iterator)(*this);\n"
    "      }\n"
    "\n"
@@ -831,8 +1371,42 @@ int main(int argC, char* argV[])
    "         return **(typename std::list<T*>::iterator)(*this);\n"
    "      }\n"
    "\n"
-   "      iterator operator+=(int offset) {\n"
-   "         if (offset > 0) {\n"
+   "      T &operator[](int offset) const {\n"
+   "         return *(*this + offset);\n"
+   "      }\n"
+   "\n"
+   "      iterator &operator++() {\n"
+   "         std::list<T*>::iterator::operator++();\n"
+   "         if (m_pos != INT_MIN)\n"
+   "            ++m_pos;\n"
+   "         return *this;\n"
+   "      }\n"
+   "\n"
+   "      iterator operator++(int) {\n"
+   "         iterator iter(*this);\n"
+   "         ++(*this);\n"
+   "         return iter;\n"
+   "      }\n"
+   "\n"
+   "      iterator &operator--() {\n"
+   "         std::list<T*>::iterator::operator--();\n"
+   "         if (m_pos != INT_MIN)\n"
+   "            --m_pos;\n"
+   "         return *this;\n"
+   "      }\n"
+   "\n"
+   "      iterator operator--(int) {\n"
+   "         iterator iter(*this);\n"
+   "         --(*this);\n"
+   "         return iter;\n"
+   "      }\n"
+   "\n"
+   "      iterator &operator+=(int offset) {\n"
+   "         if (m_index) {\n"
+   "            m_pos += offset;\n"
+   "            std::list<T*>::iterator::operator=(index_node(*m_index, m_pos));\n"
+   "         }\n"
+   "         else if (offset > 0) {\n"
    "            for (int i=0; i<offset; ++i, ++(*this)) {}\n"
    "         }\n"
    "         else if (offset < 0) {\n"
@@ -841,14 +1415,8 @@ int main(int argC, char* argV[])
    "         return *this;\n"
    "      }\n"
    "\n"
-   "      iterator operator-=(int offset) {\n"
-   "         if (offset > 0) {\n"
-   "            for (int i=0; i<offset; ++i, --(*this)) {}\n"
-   "         }\n"
-   "         else if (offset < 0) {\n"
-   "            for (int i=0; i>offset; --i, ++(*this)) {}\n"
-   "         }\n"
-   "         return *this;\n"
+   "      iterator &operator-=(int offset) {\n"
+   "         return *this += -offset;\n"
    "      }\n"
    "\n"
    "      iterator operator+(int offset) const {\n"
@@ -856,13 +1424,20 @@ int main(int argC, char* argV[])
    "         return iter += offset;\n"
    "      }\n"
    "\n"
+   "      friend iterator operator+(int offset, const iterator &iter) {\n"
+   "         return iter + offset;\n"
+   "      }\n"
+   "\n"
    "      iterator operator-(int offset) const {\n"
    "         iterator iter(*this);\n"
    "         return iter -= offset;\n"
    "      }\n"
    "\n"
    "      int operator-(iterator iter) const {\n"
-   "         if (*this == iter) {\n"
+   "         if (m_pos != INT_MIN && iter.m_pos != INT_MIN) {\n"
+   "            return m_pos - iter.m_pos;\n"
+   "         }\n"
+   "         else if (*this == iter) {\n"
    "            return 0;\n"
    "         }\n"
    "         iterator iter2(iter);\n"
@@ -876,30 +1451,85 @@ int main(int argC, char* argV[])
    "         }\n"
    "         return INT_MAX;\n"
    "      }\n"
+   "\n"
+   "      bool operator<(const iterator &iter) const { return (*this - iter) < 0; }\n"
+   "      bool operator>(const iterator &iter) const { return (*this - iter) > 0; }\n"
+   "      bool operator<=(const iterator &iter) const { return (*this - iter) <= 0; }\n"
+   "      bool operator>=(const iterator &iter) const { return (*this - iter) >= 0; }\n"
+   "\n"
    "      void *address() const {\n"
    "         return &*(typename std::list<T*>::iterator)(*this);\n"
    "      }\n"
+   "    private:\n"
+   "      std::shared_ptr<const index_t> m_index;\n"
+   "      int m_pos;\n"
    "   };\n"
    "\n"
    "   class const_iterator: public std::list<T*>::const_iterator {\n"
    "    public:\n"
-   "      const_iterator() {}\n"
+   "      typedef std::random_access_iterator_tag iterator_category;\n"
+   "      typedef const T value_type;\n"
+   "      typedef int difference_type;\n"
+   "      typedef const T *pointer;\n"
+   "      typedef const T &reference;\n"
+   "\n"
+   "      const_iterator() : m_pos(INT_MIN) {}\n"
    "      const_iterator(const typename std::list<T*>::const_iterator src)\n"
-   "       : std::list<T*>::const_iterator(src) {}\n"
+   "       : std::list<T*>::const_iterator(src), m_pos(INT_MIN) {}\n"
    "\n"
    "      const_iterator(const typename std::list<T*>::iterator src)\n"
-   "       : std::list<T*>::const_iterator(src) {}\n"
+   "       : std::list<T*>::const_iterator(src), m_pos(INT_MIN) {}\n"
+   "\n"
+   "      const_iterator(const typename std::list<T*>::const_iterator src, int pos)\n"
+   "       : std::list<T*>::const_iterator(src), m_pos(pos) {}\n"
+   "      const_iterator(const std::shared_ptr<const index_t> &index, int pos)\n"
+   "       : std::list<T*>::const_iterator(index_node(*index, pos)), m_index(index),\n"
+   "         m_pos(pos) {}\n"
    "\n"
-   "      const T *operator->() const { \n"
+   "      const T *operator->() const {\n"
    "         return *(typename std::list<T*>::const_iterator)(*this);\n"
    "      }\n"
    "\n"
-   "      const T &operator*() const { \n"
+   "      const T &operator*() const {\n"
    "         return **(typename std::list<T*>::const_iterator)(*this);\n"
    "      }\n"
    "\n"
-   "      const const_iterator operator+=(int offset) {\n"
-   "         if (offset > 0) {\n"
+   "      const T &operator[](int offset) const {\n"
+   "         return *(*this + offset);\n"
+   "      }\n"
+   "\n"
+   "      const_iterator &operator++() {\n"
+   "         std::list<T*>::const_iterator::operator++();\n"
+   "         if (m_pos != INT_MIN)\n"
+   "            ++m_pos;\n"
+   "         return *this;\n"
+   "      }\n"
+   "\n"
+   "      const_iterator operator++(int) {\n"
+   "         const_iterator iter(*this);\n"
+   "         ++(*this);\n"
+   "         return iter;\n"
+   "      }\n"
+   "\n"
+   "      const_iterator &operator--() {\n"
+   "         std::list<T*>::const_iterator::operator--();\n"
+   "         if (m_pos != INT_MIN)\n"
+   "            --m_pos;\n"
+   "         return *this;\n"
+   "      }\n"
+   "\n"
+   "      const_iterator operator--(int) {\n"
+   "         const_iterator iter(*this);\n"
+   "         --(*this);\n"
+   "         return iter;\n"
+   "      }\n"
+   "\n"
+   "      const_iterator &operator+=(int offset) {\n"
+   "         if (m_index) {\n"
+   "            m_pos += offset;\n"
+   "            std::list<T*>::const_iterator::operator=(index_node(*m_index, m_pos));\n"
+   "         }\n"
+   "         else if (offset > 0) {\n"
    "            for (int i=0; i<offset; ++i, ++(*this)) {}\n"
    "         }\n"
    "         else if (offset < 0) {\n"
@@ -908,32 +1538,33 @@ int main(int argC, char* argV[])
    "         return *this;\n"
    "      }\n"
    "\n"
-   "      const const_iterator operator-=(int offset) {\n"
-   "         if (offset > 0) {\n"
-   "            for (int i=0; i<offset; ++i, --(*this)) {}\n"
-   "         }\n"
-   "         else if (offset > 0) {\n"
-   "            for (int i=0; i>offset; --i, ++(*this)) {}\n"
-   "         }\n"
-   "         return *this;\n"
+   "      const_iterator &operator-=(int offset) {\n"
+   "         return *this += -offset;\n"
    "      }\n"
    "\n"
-   "      const const_iterator operator+(int offset) const {\n"
+   "      const_iterator operator+(int offset) const {\n"
    "         const_iterator iter(*this);\n"
    "         return iter += offset;\n"
    "      }\n"
    "\n"
-   "      const const_iterator operator-(int offset) const {\n"
+   "      friend const_iterator operator+(int offset, const const_iterator &iter) {\n"
+   "         return iter + offset;\n"
+   "      }\n"
+   "\n"
+   "      const_iterator operator-(int offset) const {\n"
    "         const_iterator iter(*this);\n"
    "         return iter -= offset;\n"
    "      }\n"
    "\n"
    "      int operator-(const_iterator iter) const {\n"
-   "         if (*this == iter) {\n"
+   "         if (m_pos != INT_MIN && iter.m_pos != INT_MIN) {\n"
+   "            return m_pos - iter.m_pos;\n"
+   "         }\n"
+   "         else if (*this == iter) {\n"
    "            return 0;\n"
    "         }\n"
    "         const_iterator iter2(iter);\n"
-   "         for (int n=1; n < m_size; ++n) {\n"
+   "         for (int n=1; n < INT_MAX; ++n) {\n"
    "            if (++iter == *this) {\n"
    "               return n;\n"
    "            }\n"
@@ -941,15 +1572,124 @@ int main(int argC, char* argV[])
    "               return -n;\n"
    "            }\n"
    "         }\n"
-   "         return m_size;\n"
+   "         return INT_MAX;\n"
    "      }\n"
+   "\n"
+   "      bool operator<(const const_iterator &iter) const { return (*this - iter) < 0; }\n"
+   "      bool operator>(const const_iterator &iter) const { return (*this - iter) > 0; }\n"
+   "      bool operator<=(const const_iterator &iter) const { return (*this - iter) <= 0; }\n"
+   "      bool operator>=(const const_iterator &iter) const { return (*this - iter) >= 0; }\n"
+   "\n"
    "      void *address() const {\n"
-   "         return &*(typename std::list<T*>::iterator)(*this);\n"
+   "         return (void*)&*(typename std::list<T*>::const_iterator)(*this);\n"
+   "      }\n"
+   "    private:\n"
+   "      std::shared_ptr<const index_t> m_index;\n"
+   "      int m_pos;\n"
+   "   };\n"
+   "\n"
+   "   class pointer_iterator: public iterator {\n"
+   "    public:\n"
+   "      typedef T *value_type;\n"
+   "      typedef T **pointer;\n"
+   "      typedef T *&reference;\n"
+   "\n"
+   "      pointer_iterator() {}\n"
+   "      pointer_iterator(const iterator &src) : iterator(src) {}\n"
+   "\n"
+   "      T *&operator*() const {\n"
+   "         return *(typename std::list<T*>::iterator)(*this);\n"
+   "      }\n"
+   "\n"
+   "      T *&operator[](int offset) const {\n"
+   "         return *(*this + offset);\n"
+   "      }\n"
+   "\n"
+   "      pointer_iterator &operator++() {\n"
+   "         iterator::operator++();\n"
+   "         return *this;\n"
+   "      }\n"
+   "\n"
+   "      pointer_iterator operator++(int) {\n"
+   "         pointer_iterator iter(*this);\n"
+   "         ++(*this);\n"
+   "         return iter;\n"
+   "      }\n"
+   "\n"
+   "      pointer_iterator &operator--() {\n"
+   "         iterator::operator--();\n"
+   "         return *this;\n"
+   "      }\n"
+   "\n"
+   "      pointer_iterator operator--(int) {\n"
+   "         pointer_iterator iter(*this);\n"
+   "         --(*this);\n"
+   "         return iter;\n"
+   "      }\n"
+   "\n"
+   "      pointer_iterator &operator+=(int offset) {\n"
+   "         iterator::operator+=(offset);\n"
+   "         return *this;\n"
+   "      }\n"
+   "\n"
+   "      pointer_iterator &operator-=(int offset) {\n"
+   "         iterator::operator-=(offset);\n"
+   "         return *this;\n"
+   "      }\n"
+   "\n"
+   "      pointer_iterator operator+(int offset) const {\n"
+   "         pointer_iterator iter(*this);\n"
+   "         return iter += offset;\n"
+   "      }\n"
+   "\n"
+   "      friend pointer_iterator operator+(int offset,\n"
+   "                                        const pointer_iterator &iter) {\n"
+   "         return iter + offset;\n"
+   "      }\n"
+   "\n"
+   "      pointer_iterator operator-(int offset) const {\n"
+   "         pointer_iterator iter(*this);\n"
+   "         return iter -= offset;\n"
+   "      }\n"
+   "\n"
+   "      int operator-(const pointer_iterator &iter) const {\n"
+   "         return iterator::operator-((const iterator&)iter);\n"
    "      }\n"
    "   };\n"
    "\n"
-   "   iterator begin() const { return m_first_iter; }\n"
-   "   iterator end() const { return (m_size)? m_last_iter + 1 : m_last_iter; }\n"
+   "   // The pointers may be reordered among the nodes of the list, but\n"
+   "   // not replaced by pointers to elements from anywhere else.\n"
+   "   class pointer_range {\n"
+   "    public:\n"
+   "      pointer_range(const pointer_iterator &begin,\n"
+   "                    const pointer_iterator &end)\n"
+   "       : m_begin(begin), m_end(end) {}\n"
+   "      pointer_iterator begin() const { return m_begin; }\n"
+   "      pointer_iterator end() const { return m_end; }\n"
+   "    private:\n"
+   "      pointer_iterator m_begin;\n"
+   "      pointer_iterator m_end;\n"
+   "   };\n"
+   "\n"
+   "   pointer_range pointers() const {\n"
+   "      return pointer_range(begin(), end());\n"
+   "   }\n"
+   "\n"
+   "   iterator begin() const {\n"
+   "      if (m_size > k_min_indexed_size) {\n"
+   "         build_index();\n"
+   "         return iterator(*m_index_ptr.load(std::memory_order_acquire), 0);\n"
+   "      }\n"
+   "      return iterator(m_first_iter, 0);\n"
+   "   }\n"
+   "   iterator end() const {\n"
+   "      if (m_size > k_min_indexed_size) {\n"
+   "         build_index();\n"
+   "         return iterator(*m_index_ptr.load(std::memory_order_acquire),\n"
+   "                         m_size);\n"
+   "      }\n"
+   "      return iterator(position(m_size), m_size);\n"
+   "   }\n"
    "   void clear() { del(); }\n"
    "\n"
    "   HDDM_ElementList add(int count=1, int start=-1) {\n"
@@ -958,11 +1698,12 @@ int main(int argC, char* argV[])
    "                                  \"attempt to add to immutable list\");\n"
    "      }\n"
    "      iterator it = insert(start, count);\n"
+   "      drop_index();\n"
    "      typename std::list<T*>::iterator iter(it);\n"
    "      for (int n=0; n<count; ++n, ++iter) {\n"
    "         *iter = new T(m_parent, 1);\n"
    "      }\n"
-   "      return HDDM_ElementList(m_host_plist, it, it+count, m_parent);\n"
+   "      return HDDM_ElementList(m_host_plist, it, iter, m_parent);\n"
    "   }\n"
    "\n"
    "   void del(int count=-1, int start=0) {\n"
@@ -973,41 +1714,94 @@ int main(int argC, char* argV[])
    "         throw std::runtime_error(\"HDDM_ElementList error - \"\n"
    "                                  \"attempt to delete from immutable list\");\n"
    "      }\n"
-   "      iterator iter_begin(begin());\n"
-   "      iterator iter_end(end());\n"
-   "      if (start < 0) {\n"
-   "         iter_begin = iter_end + start;\n"
-   "         if (count >= 0) {\n"
-   "            iter_end = iter_begin + count;\n"
-   "         }\n"
-   "      }\n"
-   "      else {\n"
-   "         iter_begin += start;\n"
-   "         if (count >= 0) {\n"
-   "            iter_end = iter_begin + count;\n"
-   "         }\n"
-   "      }\n"
-   "      typename std::list<T*>::iterator iter;\n"
-   "      for (iter = iter_begin; iter != iter_end; ++iter) {\n"
+   "      int first = (start < 0)? start + m_size : start;\n"
+   "      int last = (count < 0)? m_size : first + count;\n"
+   "      typename std::list<T*>::iterator iter(position(first));\n"
+   "      for (int n = first; n < last; ++n, ++iter) {\n"
    "         if ((*iter)->m_owner)\n"
    "            delete *iter;\n"
    "         else\n"
    "            (*iter)->clear();\n"
    "      }\n"
    "      erase(start, count);\n"
+   "      drop_index();\n"
+   "   }\n"
+   "\n"
+   "   HDDM_ElementList splice(HDDM_ElementList<T> &src,\n"
+   "                           int count=-1, int start=0) {\n"
+   "      if (m_parent == 0 || src.m_parent == 0) {\n"
+   "         throw std::runtime_error(\"HDDM_ElementList error - \"\n"
+   "                                  \"attempt to splice immutable list\");\n"
+   "      }\n"
+   "      int first = (start < 0)? start + src.m_size : start;\n"
+   "      count = (count < 0)? src.m_size - first : count;\n"
+   "      if (first < 0 || first + count > src.m_size) {\n"
+   "         throw std::runtime_error(\"HDDM_ElementList error - \"\n"
+   "                                  \"splice range out of bounds\");\n"
+   "      }\n"
+   "      else if (count == 0) {\n"
+   "         return HDDM_ElementList(m_host_plist, end(), end(), m_parent);\n"
+   "      }\n"
+   "      else if (m_size && m_first_iter == src.m_first_iter) {\n"
+   "         throw std::runtime_error(\"HDDM_ElementList error - \"\n"
+   "                                  \"attempt to splice list into itself\");\n"
+   "      }\n"
+   "      std::vector<T*> moved;\n"
+   "      moved.reserve(count);\n"
+   "      typename std::list<T*>::iterator iter(src.position(first));\n"
+   "      for (int n=0; n < count; ++n, ++iter) {\n"
+   "         moved.push_back(*iter);\n"
+   "      }\n"
+   "      src.erase(first, count);\n"
+   "      src.drop_index();\n"
+   "      iterator it = insert(-1, count);\n"
+   "      drop_index();\n"
+   "      typename std::list<T*>::iterator pos(it);\n"
+   "      for (int n=0; n < count; ++n, ++pos) {\n"
+   "         *pos = moved[n];\n"
+   "         moved[n]->adopt(m_parent);\n"
+   "      }\n"
+   "      return HDDM_ElementList(m_host_plist, it, pos, m_parent);\n"
+   "   }\n"
+   "\n"
+   "   void assign(const HDDM_ElementList<T> &src) {\n"
+   "      del();\n"
+   "      if (src.m_size) {\n"
+   "         typename std::list<T*>::iterator dst(add(src.m_size).m_first_iter);\n"
+   "         typename std::list<T*>::iterator iter(src.m_first_iter);\n"
+   "         for (int n=0; n < src.m_size; ++n, ++iter, ++dst) {\n"
+   "            (*dst)->assign(**iter);\n"
+   "         }\n"
+   "      }\n"
+   "   }\n"
+   "\n"
+   "   template <class Compare>\n"
+   "   void sort(Compare comp) {\n"
+   "      if (m_parent == 0) {\n"
+   "         throw std::runtime_error(\"HDDM_ElementList error - \"\n"
+   "                                  \"attempt to sort immutable list\");\n"
+   "      }\n"
+   "      std::vector<T*> elems;\n"
+   "      elems.reserve(m_size);\n"
+   "      typename std::list<T*>::iterator iter(m_first_iter);\n"
+   "      for (int n=0; n < m_size; ++n, ++iter) {\n"
+   "         elems.push_back(*iter);\n"
+   "      }\n"
+   "      std::stable_sort(elems.begin(), elems.end(),\n"
+   "                       [&comp](T *a, T *b) { return comp(*a, *b); });\n"
+   "      iter = m_first_iter;\n"
+   "      for (int n=0; n < m_size; ++n, ++iter) {\n"
+   "         *iter = elems[n];\n"
+   "      }\n"
    "   }\n"
    "\n"
    "   HDDM_ElementList slice(int first=0, int last=-1) {\n"
    "      int n1 = (first < 0)? first + m_size : first;\n"
    "      int n2 = (last < 0)? last + m_size + 1 : last + 1;\n"
-   "      int count = n2 - n1;\n"
-   "      iterator iter_begin;\n"
-   "      if (first >= 0)\n"
-   "         iter_begin = begin() + first;\n"
-   "      else\n"
-   "         iter_begin = end() + first;\n"
-   "      iterator iter_end(iter_begin + count);\n"
-   "      return HDDM_ElementList(m_host_plist, iter_begin, iter_end);\n"
+   "      if (m_size > k_min_indexed_size) {\n"
+   "         build_index();\n"
+   "      }\n"
+   "      return HDDM_ElementList(m_host_plist, position(n1), position(n2));\n"
    "   }\n"
    "   void debug_print() {\n"
    "      std::cout << \"HDDM_ElementList<T> contents printout:\"\n"
@@ -1017,9 +1811,9 @@ int main(int argC, char* argV[])
    "                << \"    m_host_plist = \" << m_host_plist << std::endl\n"
    "                << \"    m_size       = \" << m_size << std::endl\n"
    "                << \"    m_ref        = \" << m_ref << std::endl\n"
-   "                << \"    m_first_iter = \" << m_first_iter.address()\n"
+   "                << \"    m_first_iter = \" << iterator(m_first_iter).address()\n"
    "                << std::endl\n"
-   "                << \"    m_last_iter  = \" << m_last_iter.address()\n"
+   "                << \"    m_last_iter  = \" << iterator(m_last_iter).address()\n"
    "                << std::endl;\n"
    "   }\n"
    "\n"
@@ -1028,9 +1822,9 @@ int main(int argC, char* argV[])
    "      int size;\n"
    "      *istr.getXDRistream() >> size;\n"
    "      if (size) {\n"
-   "         iterator iter = add(size).begin();\n"
+   "         typename std::list<T*>::iterator iter(add(size).m_first_iter);\n"
    "         for (int n=0; n < size; ++n, ++iter) {\n"
-   "            istr.sequencer(*iter);\n"
+   "            istr.sequencer(**iter);\n"
    "         }\n"
    "      }\n"
    "      istr.reset_sequencer();\n"
@@ -1039,28 +1833,33 @@ int main(int argC, char* argV[])
    "   void streamer(ostream &ostr) {\n"
    "      if (m_size) {\n"
    "         *ostr.getXDRostream() << m_size;\n"
-   "         for (iterator iter = begin(); iter != end(); ++iter) {\n"
-   "            iter->streamer(ostr);\n"
+   "         typename std::list<T*>::iterator iter(m_first_iter);\n"
+   "         for (int n=0; n < m_size; ++n, ++iter) {\n"
+   "            (*iter)->streamer(ostr);\n"
    "         }\n"
    "      }\n"
    "   }\n"
-   "   std::string toString(int indent=0) {\n"
-   "      std::string result;\n"
-   "      if (m_size) {\n"
-   "         for (iterator iter = begin(); iter != end(); ++iter) {\n"
-   "            result += iter->toString(indent);\n"
-   "         }\n"
+   "   void writeString(buffersink &sink, int indent=0) {\n"
+   "      typename std::list<T*>::iterator iter(m_first_iter);\n"
+   "      for (int n=0; n < m_size; ++n, ++iter) {\n"
+   "         (*iter)->writeString(sink, indent);\n"
    "      }\n"
-   "      return result;\n"
    "   }\n"
-   "   std::string toXML(int indent=0) {\n"
-   "      std::string result;\n"
-   "      if (m_size) {\n"
-   "         for (iterator iter = begin(); iter != end(); ++iter) {\n"
-   "            result += iter->toXML(indent);\n"
-   "         }\n"
+   "   void writeXML(buffersink &sink, int indent=0) {\n"
+   "      typename std::list<T*>::iterator iter(m_first_iter);\n"
+   "      for (int n=0; n < m_size; ++n, ++iter) {\n"
+   "         (*iter)->writeXML(sink, indent);\n"
    "      }\n"
-   "      return result;\n"
+   "   }\n"
+   "   std::string toString(int indent=0) {\n"
+   "      buffersink sink;\n"
+   "      writeString(sink, indent);\n"
+   "      return sink.str();\n"
+   "   }\n"
+   "   std::string toXML(int indent=0) {\n"
+   "      buffersink sink;\n"
+   "      writeXML(sink, indent);\n"
+   "      return sink.str();\n"
    "   }\n"
    "\n"
    " private:\n"
@@ -1106,8 +1905,8 @@ int main(int argC, char* argV[])
    "      }\n"
    "      else if (start > 0) {\n"
    "         if (count > 0) {\n"
-   "            iterator pos(m_first_iter);\n"
-   "            iterator pos2(pos += start-1);\n"
+   "            typename std::list<T*>::iterator pos2(position(start-1));\n"
+   "            typename std::list<T*>::iterator pos(pos2);\n"
    "            m_host_plist->insert(++pos,count,(T*)0);\n"
    "            if (m_last_iter == pos2) {\n"
    "               m_last_iter = --pos;\n"
@@ -1115,17 +1914,17 @@ int main(int argC, char* argV[])
    "            m_size += count;\n"
    "            return ++pos2;\n"
    "         }\n"
-   "         return m_first_iter + start;\n"
+   "         return position(start);\n"
    "      }\n"
    "      else {\n"
    "         if (count > 0) {\n"
-   "            iterator pos(m_last_iter);\n"
-   "            iterator pos2(pos += start+1);\n"
+   "            typename std::list<T*>::iterator pos2(position(m_size + start));\n"
+   "            typename std::list<T*>::iterator pos(pos2);\n"
    "            m_host_plist->insert(++pos,count,(T*)0);\n"
    "            m_size += count;\n"
    "            return ++pos2;\n"
    "         }\n"
-   "         return m_last_iter + (start+1);\n"
+   "         return position(m_size + start);\n"
    "      }\n"
    "   }\n"
    "\n"
@@ -1135,43 +1934,123 @@ int main(int argC, char* argV[])
    "      count = (count == -1)? m_size - start : count;\n"
    "      assert(start >= 0 && count > 0 && start + count <= m_size);\n"
    "      if (count == m_size) {\n"
-   "         m_first_iter = m_host_plist->erase(m_first_iter,++m_last_iter);\n"
+   "         m_host_plist->erase(m_first_iter,++m_last_iter);\n"
+   "         m_first_iter = m_host_plist->end();\n"
    "         m_last_iter = m_first_iter;\n"
    "         m_size = 0;\n"
    "         return m_first_iter;\n"
    "      }\n"
    "      else if (start > 0 && count + start == m_size) {\n"
-   "         iterator pos(m_first_iter + start);\n"
-   "         m_last_iter = m_host_plist->erase(pos,pos+count);\n"
+   "         typename std::list<T*>::iterator pos(position(start));\n"
+   "         m_last_iter = m_host_plist->erase(pos,position(m_size));\n"
    "         iterator pos2(m_last_iter);\n"
-   "         if (m_last_iter != m_first_iter) {\n"
-   "            --m_last_iter;\n"
-   "         }\n"
+   "         --m_last_iter;\n"
    "         m_size -= count;\n"
    "         return pos2;\n"
    "      }\n"
    "      else if (start == 0) {\n"
-   "         iterator pos(m_first_iter);\n"
-   "         m_first_iter = m_host_plist->erase(pos,pos+count);\n"
+   "         m_first_iter = m_host_plist->erase(m_first_iter,position(count));\n"
    "         m_size -= count;\n"
    "         return m_first_iter;\n"
    "      }\n"
    "      else {\n"
-   "         iterator pos(m_first_iter + start);\n"
-   "         iterator pos2 = m_host_plist->erase(pos,pos+count);\n"
+   "         typename std::list<T*>::iterator pos(position(start));\n"
+   "         iterator pos2 = m_host_plist->erase(pos,position(start + count));\n"
    "         m_size -= count;\n"
    "         return pos2;\n"
    "      }\n"
    "   }\n"
    "\n"
+   "   // Returns the host list node at offset n from the start of this\n"
+   "   // list, where n == m_size refers to the node just past the end.\n"
+   "   // The index table is used if one exists, otherwise the node is\n"
+   "   // reached by stepping from whichever end of the list is closer.\n"
+   "   // The node past the end is never taken from the index, see above.\n"
+   "\n"
+   "   typename std::list<T*>::iterator position(int n) const {\n"
+   "      index_ref *index = m_index_ptr.load(std::memory_order_acquire);\n"
+   "      if (m_size == 0) {\n"
+   "         return m_first_iter;\n"
+   "      }\n"
+   "      else if (n == m_size) {\n"
+   "         return std::next(m_last_iter);\n"
+   "      }\n"
+   "      else if (index != 0) {\n"
+   "         return (**index)[n];\n"
+   "      }\n"
+   "      typename std::list<T*>::iterator iter;\n"
+   "      if (n <= m_size / 2) {\n"
+   "         iter = m_first_iter;\n"
+   "         for (int i=0; i < n; ++i, ++iter) {}\n"
+   "      }\n"
+   "      else {\n"
+   "         iter = m_last_iter;\n"
+   "         for (int i=m_size; i > n; --i, --iter) {}\n"
+   "         ++iter;\n"
+   "      }\n"
+   "      return iter;\n"
+   "   }\n"
+   "\n"
+   "   // The index table is built on demand and shared with the iterators\n"
+   "   // handed out by this list, so it survives as long as any of them.\n"
+   "   // It is built under a lock so that concurrent readers of the same\n"
+   "   // list are safe; any change to the list contents discards it.\n"
+   "\n"
+   "   void build_index() const {\n"
+   "      if (m_index_ptr.load(std::memory_order_acquire) != 0) {\n"
+   "         return;\n"
+   "      }\n"
+   "      pthread_mutex_lock(&s_index_mutex);\n"
+   "      if (m_index_ptr.load(std::memory_order_relaxed) == 0) {\n"
+   "         index_t *index = new index_t(m_size);\n"
+   "         typename std::list<T*>::iterator iter(m_first_iter);\n"
+   "         for (int n=0; n < m_size; ++n, ++iter) {\n"
+   "            (*index)[n] = iter;\n"
+   "         }\n"
+   "         m_index_ptr.store(new index_ref(index), std::memory_order_release);\n"
+   "      }\n"
+   "      pthread_mutex_unlock(&s_index_mutex);\n"
+   "   }\n"
+   "\n"
+   "   void share_index(const HDDM_ElementList<T> &src) {\n"
+   "      index_ref *index = src.m_index_ptr.load(std::memory_order_acquire);\n"
+   "      if (index != 0) {\n"
+   "         m_index_ptr.store(new index_ref(*index), std::memory_order_release);\n"
+   "      }\n"
+   "   }\n"
+   "\n"
+   "   void drop_index() {\n"
+   "      delete m_index_ptr.exchange(0, std::memory_order_acq_rel);\n"
+   "   }\n"
+   "\n"
    " public:\n"
+   "   void rehost(HDDM *host, std::list<T*> *host_plist) {\n"
+   "      if (host_plist == m_host_plist) {\n"
+   "         return;\n"
+   "      }\n"
+   "      else if (m_size) {\n"
+   "         iterator next(m_last_iter);\n"
+   "         host_plist->splice(host_plist->end(), *m_host_plist,\n"
+   "                            m_first_iter, ++next);\n"
+   "         iterator iter(m_first_iter);\n"
+   "         for (int n=0; n < m_size; ++n, ++iter) {\n"
+   "            iter->rehost(host);\n"
+   "         }\n"
+   "      }\n"
+   "      else {\n"
+   "         m_first_iter = host_plist->end();\n"
+   "         m_last_iter = m_first_iter;\n"
+   "      }\n"
+   "      m_host_plist = host_plist;\n"
+   "      drop_index();\n"
+   "   }\n"
    "   void inflate(HDDM *host, std::list<T*> *host_plist, HDDM_Element *parent) {\n"
    "      m_parent = parent;\n"
    "      m_host_plist = host_plist;\n"
    "      m_first_iter = m_host_plist->begin();\n"
-   "      m_first_iter += m_ref;\n"
+   "      std::advance(m_first_iter, m_ref);\n"
    "      m_last_iter = m_first_iter;\n"
-   "      m_last_iter += m_size;\n"
+   "      std::advance(m_last_iter, m_size);\n"
    "      for (iterator iter = m_first_iter; iter != m_last_iter; ++iter) {\n"
    "         iter->m_parent = parent;\n"
    "         iter->m_host = host;\n"
@@ -1179,6 +2058,7 @@ int main(int argC, char* argV[])
    "      if (m_size) {\n"
    "         --m_last_iter;\n"
    "      }\n"
+   "      drop_index();\n"
    "   }\n"
    "   void deflate() {\n"
    "      iterator iter = m_host_plist->begin();\n"
@@ -1187,15 +2067,22 @@ int main(int argC, char* argV[])
    "\n"
    " protected:\n"
    "   std::list<T*> *m_host_plist;\n"
-   "   iterator m_first_iter;\n"
-   "   iterator m_last_iter;\n"
+   "   typename std::list<T*>::iterator m_first_iter;\n"
+   "   typename std::list<T*>::iterator m_last_iter;\n"
    "   HDDM_Element *m_parent;\n"
    " public:\n"
    "   int m_size;\n"
    "   int m_ref;\n"
+   " private:\n"
+   "   typedef std::shared_ptr<const index_t> index_ref;\n"
+   "   mutable std::atomic<index_ref*> m_index_ptr;\n"
+   "   static pthread_mutex_t s_index_mutex;\n"
    "};\n"
    "\n"
    "template <class T>\n"
+   "pthread_mutex_t HDDM_ElementList<T>::s_index_mutex = PTHREAD_MUTEX_INITIALIZER;\n"
+   "\n"
+   "template <class T>\n"
    "class HDDM_ElementLink: public HDDM_ElementList<T> {\n"
    " public:\n"
    "   HDDM_ElementLink() {}\n"
@@ -1221,6 +2108,132 @@ int main(int argC, char* argV[])
    "   }\n"
    "};\n"
    "\n"
+   "// Read-only views look at a record in its serialized form, as it sits\n"
+   "// in the input buffer, without building any objects. Attributes are\n"
+   "// decoded from the XDR bytes on each call, and child lists are found by\n"
+   "// following the byte-count prefixes that precede them in the stream.\n"
+   "// A view is only valid as long as the buffer it looks into; for views\n"
+   "// obtained from an istream this means until the next read.\n"
+   "\n"
+   "class HDDM_View {\n"
+   " public:\n"
+   "   HDDM_View() : m_data(0) {}\n"
+   "   explicit HDDM_View(const char *data) : m_data(data) {}\n"
+   "   bool empty() const { return (m_data == 0); }\n"
+   "   const char *data() const { return m_data; }\n"
+   "   template <class V> friend class HDDM_ViewList;\n"
+   "\n"
+   " protected:\n"
+   "   static uint32_t get_uint(const char *p) {\n"
+   "      const unsigned char *c = (const unsigned char*)p;\n"
+   "      return (uint32_t(c[0]) << 24) | (uint32_t(c[1]) << 16) |\n"
+   "             (uint32_t(c[2]) << 8) | uint32_t(c[3]);\n"
+   "   }\n"
+   "   static int get_int(const char *p) {\n"
+   "      return int32_t(get_uint(p));\n"
+   "   }\n"
+   "   static int64_t get_long(const char *p) {\n"
+   "      return int64_t((uint64_t(get_uint(p)) << 32) | get_uint(p + 4));\n"
+   "   }\n"
+   "   static float get_float(const char *p) {\n"
+   "      uint32_t bits = get_uint(p);\n"
+   "      float value;\n"
+   "      memcpy(&value, &bits, sizeof(value));\n"
+   "      return value;\n"
+   "   }\n"
+   "   static double get_double(const char *p) {\n"
+   "      uint64_t bits = (uint64_t(get_uint(p)) << 32) | get_uint(p + 4);\n"
+   "      double value;\n"
+   "      memcpy(&value, &bits, sizeof(value));\n"
+   "      return value;\n"
+   "   }\n"
+   "   static std::string_view get_string(const char *p) {\n"
+   "      return std::string_view(p + 4, get_uint(p));\n"
+   "   }\n"
+   "   static const char *skip_string(const char *p) {\n"
+   "      return p + 4 + ((get_uint(p) + 3) & ~3u);\n"
+   "   }\n"
+   "   static const char *skip_sized(const char *p) {\n"
+   "      return p + 4 + get_uint(p);\n"
+   "   }\n"
+   "   template <class V>\n"
+   "   static V get_link(const char *p) {\n"
+   "      return (get_uint(p) == 0)? V() : V(p + 4);\n"
+   "   }\n"
+   "\n"
+   "   const char *m_data;\n"
+   "};\n"
+   "\n"
+   "template <class V>\n"
+   "class HDDM_ViewList {\n"
+   " public:\n"
+   "   HDDM_ViewList() : m_first(0), m_size(0) {}\n"
+   "   HDDM_ViewList(const char *first, int size)\n"
+   "    : m_first(first), m_size(size) {}\n"
+   "   explicit HDDM_ViewList(const char *sized)\n"
+   "    : m_first(0), m_size(0)\n"
+   "   {\n"
+   "      if (sized != 0 && HDDM_View::get_uint(sized) > 0) {\n"
+   "         m_size = HDDM_View::get_int(sized + 4);\n"
+   "         m_first = sized + 8;\n"
+   "      }\n"
+   "   }\n"
+   "\n"
+   "   bool empty() const { return (m_size == 0); }\n"
+   "   int size() const { return m_size; }\n"
+   "   V front() const { return V(m_first); }\n"
+   "   V operator()(int index=0) const {\n"
+   "      const char *p = m_first;\n"
+   "      for (index = (index < 0)? index + m_size : index; index > 0; --index)\n"
+   "         p = V::skip(p);\n"
+   "      return V(p);\n"
+   "   }\n"
+   "\n"
+   "   // Elements in a list are stored back to back with no offsets,\n"
+   "   // so views can only be visited in order; iterating is the cheap\n"
+   "   // way to go through a list, indexing walks it from the start.\n"
+   "\n"
+   "   class iterator {\n"
+   "    public:\n"
+   "      typedef std::forward_iterator_tag iterator_category;\n"
+   "      typedef V value_type;\n"
+   "      typedef int difference_type;\n"
+   "      typedef const V *pointer;\n"
+   "      typedef V reference;\n"
+   "\n"
+   "      iterator() : m_ptr(0), m_remaining(0) {}\n"
+   "      iterator(const char *ptr, int remaining)\n"
+   "       : m_ptr(ptr), m_remaining(remaining) {}\n"
+   "      V operator*() const { return V(m_ptr); }\n"
+   "      iterator &operator++() {\n"
+   "         if (--m_remaining > 0)\n"
+   "            m_ptr = V::skip(m_ptr);\n"
+   "         return *this;\n"
+   "      }\n"
+   "      iterator operator++(int) {\n"
+   "         iterator it(*this);\n"
+   "         ++*this;\n"
+   "         return it;\n"
+   "      }\n"
+   "      bool operator==(const iterator &it) const {\n"
+   "         return (m_remaining == it.m_remaining);\n"
+   "      }\n"
+   "      bool operator!=(const iterator &it) const {\n"
+   "         return (m_remaining != it.m_remaining);\n"
+   "      }\n"
+   "    private:\n"
+   "      const char *m_ptr;\n"
+   "      int m_remaining;\n"
+   "   };\n"
+   "\n"
+   "   iterator begin() const { return iterator(m_first, m_size); }\n"
+   "   iterator end() const { return iterator(0, 0); }\n"
+   "\n"
+   " private:\n"
+   "   const char *m_first;\n"
+   "   int m_size;\n"
+   "};\n"
+   "\n"
    "#ifdef HDF5_SUPPORT\n"
    "typedef struct {\n"
    "   size_t len;\n"
@@ -1248,6 +2261,7 @@ int main(int argC, char* argV[])
    " */\n"
    "\n"
    "#include <sstream>\n"
+   "#include <fstream>\n"
    "#include \"hddm_" << classPrefix << ".hpp\"\n"
    "\n"
    "#ifndef _FILE_OFFSET_BITS\n"
@@ -1259,6 +2273,427 @@ int main(int argC, char* argV[])
    "\n"
    "std::atomic<int> threads::next_unique_ID(0);\n"
    "thread_local int threads::ID(0);\n"
+   "std::vector<int> threads::spare_IDs;\n"
+   "pthread_mutex_t threads::spare_IDs_mutex = PTHREAD_MUTEX_INITIALIZER;\n"
+   "\n"
+   "int threads::assignID()\n"
+   "{\n"
+   "   int id = 0;\n"
+   "   pthread_mutex_lock(&spare_IDs_mutex);\n"
+   "   if (spare_IDs.size() > 0) {\n"
+   "      id = spare_IDs.back();\n"
+   "      spare_IDs.pop_back();\n"
+   "   }\n"
+   "   else if (next_unique_ID < max_threads - 1) {\n"
+   "      id = ++next_unique_ID;\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&spare_IDs_mutex);\n"
+   "   if (id == 0) {\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::threads::getID - \"\n"
+   "                               \"thread count exceeds max_threads\");\n"
+   "   }\n"
+   "   return id;\n"
+   "}\n"
+   "\n"
+   "void threads::releaseID()\n"
+   "{\n"
+   "   if (ID != 0) {\n"
+   "      pthread_mutex_lock(&spare_IDs_mutex);\n"
+   "      spare_IDs.push_back(ID);\n"
+   "      pthread_mutex_unlock(&spare_IDs_mutex);\n"
+   "      ID = 0;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "std::vector<void (*)()> *elementpools::s_pools(0);\n"
+   "pthread_mutex_t elementpools::s_mutex = PTHREAD_MUTEX_INITIALIZER;\n"
+   "\n"
+   "void elementpools::enroll(void (*trim_slabs)())\n"
+   "{\n"
+   "   pthread_mutex_lock(&s_mutex);\n"
+   "   if (s_pools == 0) {\n"
+   "      s_pools = new std::vector<void (*)()>;\n"
+   "   }\n"
+   "   if (std::find(s_pools->begin(), s_pools->end(), trim_slabs) ==\n"
+   "       s_pools->end())\n"
+   "   {\n"
+   "      s_pools->push_back(trim_slabs);\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&s_mutex);\n"
+   "}\n"
+   "\n"
+   "void elementpools::trim()\n"
+   "{\n"
+   "   // each pool takes its own lock, so call them without holding s_mutex\n"
+   "   std::vector<void (*)()> pools;\n"
+   "   pthread_mutex_lock(&s_mutex);\n"
+   "   if (s_pools != 0) {\n"
+   "      pools = *s_pools;\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&s_mutex);\n"
+   "   for (size_t n = 0; n < pools.size(); ++n) {\n"
+   "      pools[n]();\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "bufferpool::idle_list *bufferpool::s_idle(0);\n"
+   "thread_local bufferpool::local_cache bufferpool::s_local;\n"
+   "std::atomic<size_t> bufferpool::s_budget(0x4000000);\n"
+   "int bufferpool::s_idle_timeout(30);\n"
+   "std::atomic<int> bufferpool::s_epoch(0);\n"
+   "std::chrono::steady_clock::time_point bufferpool::s_next_expiry;\n"
+   "std::atomic<size_t> bufferpool::s_bytes_idle(0);\n"
+   "std::atomic<size_t> bufferpool::s_bytes_in_use(0);\n"
+   "pthread_mutex_t bufferpool::s_mutex = PTHREAD_MUTEX_INITIALIZER;\n"
+   "\n"
+   "int bufferpool::size_class(int size)\n"
+   "{\n"
+   "   // size classes are successive powers of 2 starting from\n"
+   "   // k_min_buffer_size, larger requests are allocated exactly\n"
+   "   int sclass = 0;\n"
+   "   for (int csize = k_min_buffer_size; csize < size; csize *= 2) {\n"
+   "      if (++sclass == k_size_classes)\n"
+   "         break;\n"
+   "   }\n"
+   "   return sclass;\n"
+   "}\n"
+   "\n"
+   "void bufferpool::expire(size_t budget)\n"
+   "{\n"
+   "   // caller must hold s_mutex\n"
+   "   std::chrono::steady_clock::time_point now =\n"
+   "                                  std::chrono::steady_clock::now();\n"
+   "   std::chrono::seconds timeout(s_idle_timeout);\n"
+   "   s_next_expiry = now + std::chrono::seconds(k_expire_period);\n"
+   "   for (int sclass = k_size_classes-1; sclass >= 0; --sclass) {\n"
+   "      idle_list &idle = s_idle[sclass];\n"
+   "      while (idle.size() > 0 &&\n"
+   "             (s_bytes_idle > budget || now - idle.front().m_since > timeout))\n"
+   "      {\n"
+   "         delete [] idle.front().m_buffer;\n"
+   "         idle.pop_front();\n"
+   "         s_bytes_idle -= k_min_buffer_size << sclass;\n"
+   "      }\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "bufferpool::local_cache::~local_cache()\n"
+   "{\n"
+   "   flush();\n"
+   "}\n"
+   "\n"
+   "void bufferpool::local_cache::flush()\n"
+   "{\n"
+   "   // hands every cached buffer back to the shared pool\n"
+   "   m_epoch = s_epoch;\n"
+   "   for (int sclass = 0; sclass < k_local_classes; ++sclass) {\n"
+   "      int size = k_min_buffer_size << sclass;\n"
+   "      while (m_count[sclass] > 0) {\n"
+   "         s_bytes_idle -= size;\n"
+   "         s_bytes_in_use += size;\n"
+   "         release(m_buffer[sclass][--m_count[sclass]], size);\n"
+   "      }\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "char *bufferpool::checkout(int &size)\n"
+   "{\n"
+   "   int sclass = size_class(size);\n"
+   "   if (s_local.m_epoch != s_epoch)\n"
+   "      s_local.flush();\n"
+   "   if (sclass < k_local_classes && s_local.m_count[sclass] > 0) {\n"
+   "      size = k_min_buffer_size << sclass;\n"
+   "      s_bytes_idle -= size;\n"
+   "      s_bytes_in_use += size;\n"
+   "      return s_local.m_buffer[sclass][--s_local.m_count[sclass]];\n"
+   "   }\n"
+   "   char *buffer = 0;\n"
+   "   pthread_mutex_lock(&s_mutex);\n"
+   "   if (s_idle == 0) {\n"
+   "      s_idle = new idle_list[k_size_classes];\n"
+   "   }\n"
+   "   if (sclass < k_size_classes) {\n"
+   "      size = k_min_buffer_size << sclass;\n"
+   "      if (s_idle[sclass].size() > 0) {\n"
+   "         buffer = s_idle[sclass].back().m_buffer;\n"
+   "         s_idle[sclass].pop_back();\n"
+   "         s_bytes_idle -= size;\n"
+   "      }\n"
+   "   }\n"
+   "   s_bytes_in_use += size;\n"
+   "   if (std::chrono::steady_clock::now() >= s_next_expiry)\n"
+   "      expire(s_budget);\n"
+   "   pthread_mutex_unlock(&s_mutex);\n"
+   "   if (buffer == 0) {\n"
+   "      buffer = new char[size];\n"
+   "   }\n"
+   "   return buffer;\n"
+   "}\n"
+   "\n"
+   "void bufferpool::checkin(char *buffer, int size)\n"
+   "{\n"
+   "   int sclass = size_class(size);\n"
+   "   if (s_local.m_epoch != s_epoch)\n"
+   "      s_local.flush();\n"
+   "   if (sclass < k_local_classes &&\n"
+   "       s_local.m_count[sclass] < k_local_buffers &&\n"
+   "       s_bytes_idle + size <= s_budget)\n"
+   "   {\n"
+   "      s_local.m_buffer[sclass][s_local.m_count[sclass]++] = buffer;\n"
+   "      s_bytes_idle += size;\n"
+   "      s_bytes_in_use -= size;\n"
+   "      return;\n"
+   "   }\n"
+   "   release(buffer, size);\n"
+   "}\n"
+   "\n"
+   "void bufferpool::release(char *buffer, int size)\n"
+   "{\n"
+   "   // returns a buffer to the shared pool, bypassing the thread cache\n"
+   "   int sclass = size_class(size);\n"
+   "   pthread_mutex_lock(&s_mutex);\n"
+   "   if (s_idle == 0) {\n"
+   "      s_idle = new idle_list[k_size_classes];\n"
+   "   }\n"
+   "   s_bytes_in_use -= size;\n"
+   "   if (sclass < k_size_classes && s_bytes_idle + size <= s_budget) {\n"
+   "      idle_buffer entry;\n"
+   "      entry.m_buffer = buffer;\n"
+   "      entry.m_since = std::chrono::steady_clock::now();\n"
+   "      s_idle[sclass].push_back(entry);\n"
+   "      s_bytes_idle += size;\n"
+   "      buffer = 0;\n"
+   "   }\n"
+   "   if (std::chrono::steady_clock::now() >= s_next_expiry)\n"
+   "      expire(s_budget);\n"
+   "   pthread_mutex_unlock(&s_mutex);\n"
+   "   if (buffer != 0) {\n"
+   "      delete [] buffer;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "void bufferpool::setBudget(size_t bytes)\n"
+   "{\n"
+   "   pthread_mutex_lock(&s_mutex);\n"
+   "   s_budget = bytes;\n"
+   "   if (s_idle != 0) {\n"
+   "      expire(s_budget);\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&s_mutex);\n"
+   "   ++s_epoch;\n"
+   "}\n"
+   "\n"
+   "size_t bufferpool::getBudget()\n"
+   "{\n"
+   "   return s_budget;\n"
+   "}\n"
+   "\n"
+   "void bufferpool::setIdleTimeout(int seconds)\n"
+   "{\n"
+   "   pthread_mutex_lock(&s_mutex);\n"
+   "   s_idle_timeout = seconds;\n"
+   "   if (s_idle != 0) {\n"
+   "      expire(s_budget);\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&s_mutex);\n"
+   "}\n"
+   "\n"
+   "int bufferpool::getIdleTimeout()\n"
+   "{\n"
+   "   return s_idle_timeout;\n"
+   "}\n"
+   "\n"
+   "size_t bufferpool::getBytesIdle()\n"
+   "{\n"
+   "   return s_bytes_idle;\n"
+   "}\n"
+   "\n"
+   "size_t bufferpool::getBytesInUse()\n"
+   "{\n"
+   "   return s_bytes_in_use;\n"
+   "}\n"
+   "\n"
+   "void bufferpool::trim()\n"
+   "{\n"
+   "   // other threads empty their caches at their next call\n"
+   "   ++s_epoch;\n"
+   "   s_local.flush();\n"
+   "   pthread_mutex_lock(&s_mutex);\n"
+   "   if (s_idle != 0) {\n"
+   "      expire(0);\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&s_mutex);\n"
+   "}\n"
+   "\n"
+   "asyncsink::asyncsink(std::streambuf *target, int max_blocks)\n"
+   " : m_target(target),\n"
+   "   m_queued(0),\n"
+   "   m_max_blocks(std::max(max_blocks, 1)),\n"
+   "   m_block_size(k_block_size),\n"
+   "   m_running(false),\n"
+   "   m_busy(false),\n"
+   "   m_stop(false),\n"
+   "   m_failed(false)\n"
+   "{\n"
+   "   m_base = m_target->pubseekoff(0, std::ios_base::cur, std::ios_base::out);\n"
+   "   pthread_mutex_init(&m_mutex, 0);\n"
+   "   pthread_cond_init(&m_ready, 0);\n"
+   "   pthread_cond_init(&m_drained, 0);\n"
+   "   if (pthread_create(&m_thread, 0, writer, this) != 0) {\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::asyncsink::asyncsink \"\n"
+   "                               \"error - unable to start writer thread\");\n"
+   "   }\n"
+   "   m_running = true;\n"
+   "   char *buffer = bufferpool::checkout(m_block_size);\n"
+   "   setp(buffer, buffer + m_block_size);\n"
+   "}\n"
+   "\n"
+   "asyncsink::~asyncsink()\n"
+   "{\n"
+   "   close();\n"
+   "   if (pbase() != 0) {\n"
+   "      bufferpool::checkin(pbase(), m_block_size);\n"
+   "   }\n"
+   "   pthread_cond_destroy(&m_drained);\n"
+   "   pthread_cond_destroy(&m_ready);\n"
+   "   pthread_mutex_destroy(&m_mutex);\n"
+   "}\n"
+   "\n"
+   "void *asyncsink::writer(void *sink)\n"
+   "{\n"
+   "   asyncsink *me = (asyncsink*)sink;\n"
+   "   pthread_mutex_lock(&me->m_mutex);\n"
+   "   while (true) {\n"
+   "      while (me->m_queue.empty() && !me->m_stop) {\n"
+   "         pthread_cond_wait(&me->m_ready, &me->m_mutex);\n"
+   "      }\n"
+   "      if (me->m_queue.empty()) {\n"
+   "         break;\n"
+   "      }\n"
+   "      block blk = me->m_queue.front();\n"
+   "      me->m_queue.pop_front();\n"
+   "      me->m_busy = true;\n"
+   "      bool failed = me->m_failed;\n"
+   "      pthread_mutex_unlock(&me->m_mutex);\n"
+   "      if (!failed) {\n"
+   "         failed = (me->m_target->sputn(blk.m_buffer, blk.m_used) != blk.m_used);\n"
+   "      }\n"
+   "      bufferpool::checkin(blk.m_buffer, blk.m_size);\n"
+   "      pthread_mutex_lock(&me->m_mutex);\n"
+   "      me->m_busy = false;\n"
+   "      me->m_failed |= failed;\n"
+   "      pthread_cond_broadcast(&me->m_drained);\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&me->m_mutex);\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
+   "void asyncsink::enqueue()\n"
+   "{\n"
+   "   // hand the current block to the writer and start a new one,\n"
+   "   // blocking here while the queue is full\n"
+   "   block blk;\n"
+   "   blk.m_buffer = pbase();\n"
+   "   blk.m_size = m_block_size;\n"
+   "   blk.m_used = int(pptr() - pbase());\n"
+   "   if (blk.m_used == 0) {\n"
+   "      return;\n"
+   "   }\n"
+   "   m_queued += blk.m_used;\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   if (!m_running) {\n"
+   "      pthread_mutex_unlock(&m_mutex);\n"
+   "      if (m_target->sputn(blk.m_buffer, blk.m_used) != blk.m_used) {\n"
+   "         m_failed = true;\n"
+   "      }\n"
+   "      setp(blk.m_buffer, blk.m_buffer + blk.m_size);\n"
+   "      return;\n"
+   "   }\n"
+   "   while (int(m_queue.size()) >= m_max_blocks && !m_failed) {\n"
+   "      pthread_cond_wait(&m_drained, &m_mutex);\n"
+   "   }\n"
+   "   m_queue.push_back(blk);\n"
+   "   pthread_cond_signal(&m_ready);\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "   char *buffer = bufferpool::checkout(m_block_size);\n"
+   "   setp(buffer, buffer + m_block_size);\n"
+   "}\n"
+   "\n"
+   "void asyncsink::drain()\n"
+   "{\n"
+   "   enqueue();\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   while (!m_queue.empty() || m_busy) {\n"
+   "      pthread_cond_wait(&m_drained, &m_mutex);\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "}\n"
+   "\n"
+   "asyncsink::int_type asyncsink::overflow(int_type c)\n"
+   "{\n"
+   "   enqueue();\n"
+   "   if (failed()) {\n"
+   "      return traits_type::eof();\n"
+   "   }\n"
+   "   if (!traits_type::eq_int_type(c, traits_type::eof())) {\n"
+   "      *pptr() = traits_type::to_char_type(c);\n"
+   "      pbump(1);\n"
+   "   }\n"
+   "   return traits_type::not_eof(c);\n"
+   "}\n"
+   "\n"
+   "int asyncsink::sync()\n"
+   "{\n"
+   "   drain();\n"
+   "   int res = m_target->pubsync();\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   m_failed |= (res != 0);\n"
+   "   res = (m_failed)? -1 : 0;\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "   return res;\n"
+   "}\n"
+   "\n"
+   "std::streampos asyncsink::seekoff(std::streamoff off,\n"
+   "                                  std::ios_base::seekdir dir,\n"
+   "                                  std::ios_base::openmode which)\n"
+   "{\n"
+   "   // only reports the current output position, as the target\n"
+   "   // will see it once everything written so far has been drained\n"
+   "   if (off != 0 || dir != std::ios_base::cur || m_base < 0 ||\n"
+   "       !(which & std::ios_base::out))\n"
+   "      return std::streampos(std::streamoff(-1));\n"
+   "   return m_base + m_queued + (pptr() - pbase());\n"
+   "}\n"
+   "\n"
+   "bool asyncsink::failed()\n"
+   "{\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   bool failed = m_failed;\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "   return failed;\n"
+   "}\n"
+   "\n"
+   "int asyncsink::close()\n"
+   "{\n"
+   "   // writes out everything queued and stops the writer thread,\n"
+   "   // any later output goes to the target directly\n"
+   "   drain();\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   bool running = m_running;\n"
+   "   m_running = false;\n"
+   "   m_stop = true;\n"
+   "   pthread_cond_signal(&m_ready);\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "   if (running) {\n"
+   "      pthread_join(m_thread, 0);\n"
+   "   }\n"
+   "   if (m_target->pubsync() != 0) {\n"
+   "      m_failed = true;\n"
+   "   }\n"
+   "   return (m_failed)? -1 : 0;\n"
+   "}\n"
    "\n"
    "static int tags_match(const std::string &a, const std::string &b)\n"
    "{\n"
@@ -1287,6 +2722,7 @@ int main(int argC, char* argV[])
    builder.constructIOstreams(rootEl);
    builder.constructMethods(rootEl);
    builder.constructStreamers(rootEl);
+   builder.constructViews();
 
    builder.hFile <<
    "inline std::string HDDM::DocumentString() {\n"
@@ -1311,6 +2747,8 @@ int main(int argC, char* argV[])
    "\n"
    "istream::istream(std::istream &src)\n"
    " : m_istr(src),\n"
+   "   m_pread(0),\n"
+   "   m_range_end(-1),\n"
    "   m_status_bits(0)\n"
    "{\n"
    "   char hdr[1000];\n"
@@ -1339,31 +2777,213 @@ int main(int argC, char* argV[])
    "      throw std::runtime_error(\"hddm_" + classPrefix +
    "::istream::istream error - hddm header invalid\");\n"
    "   }\n"
+   "   // Input from a positional reader is shared between threads\n"
+   "   // by claiming records or compressed blocks from its cursor,\n"
+   "   // without holding m_streambuf_mutex while reading them.\n"
+   "   m_pread = dynamic_cast<xstream::fd::preadbuf*>(src.rdbuf());\n"
+   "   if (m_pread) {\n"
+   "      m_pread->pubseekpos(m_pread->tell(), std::ios_base::in);\n"
+   "   }\n"
    "   pthread_mutex_init(&m_streambuf_mutex,0);\n"
    "   for (int i=0; i<threads::max_threads; ++i) {\n"
    "      my_thread_private[i] = 0;\n"
    "   }\n"
    "   m_leftovers[0] = 0;\n"
+   "   m_genome = lookup_genome();\n"
    "   init_private_data();\n"
    "}\n"
    "\n"
+   "istream::istream(std::istream &src, std::streamoff begin, std::streamoff end)\n"
+   " : istream(src)\n"
+   "{\n"
+   "   set_range(begin,end);\n"
+   "}\n"
+   "\n"
+   "void istream::set_range(std::streamoff begin, std::streamoff end) {\n"
+   "   // Reads the first record to learn the stream settings in effect\n"
+   "   // for the data, then repositions the input at the first record\n"
+   "   // boundary at or after begin. Records in compressed streams are\n"
+   "   // never split across blocks, so the boundary is the first block\n"
+   "   // whose size prefix lies at or after begin. Uncompressed records\n"
+   "   // carry no sync marker that could not also be mistaken for the\n"
+   "   // size of an element nested inside a record, so their boundary\n"
+   "   // is found by hopping over the record size words from the first\n"
+   "   // record. Any change of compression after the first record is\n"
+   "   // not supported.\n"
+   "   MY_SETUP\n"
+   "   if (! load_record()) {\n"
+   "      return;\n"
+   "   }\n"
+   "   std::streamoff first = MY(last_start);\n"
+   "   int status = m_status_bits;\n"
+   "   std::streamoff start = first;\n"
+   "   if (status & (k_bz2_compression | k_z_compression)) {\n"
+   "      if ((status & k_can_reposition) == 0) {\n"
+   "         throw std::runtime_error(\"hddm_"
+                   << classPrefix << "::istream::istream error - \"\n"
+   "                                  \"old-format hddm input file does not support byte ranges.\");\n"
+   "      }\n"
+   "      if (begin > first) {\n"
+   "         start = find_block(begin);\n"
+   "      }\n"
+   "      // restart the decompressor from scratch at the new block\n"
+   "      m_status_bits = 0;\n"
+   "      configure_streambufs();\n"
+   "      m_status_bits = status;\n"
+   "      m_leftovers[0] = 0;\n"
+   "   }\n"
+   "   else if (begin > first) {\n"
+   "      start = find_record(first,begin);\n"
+   "   }\n"
+   "   m_istr.clear();\n"
+   "   m_istr.seekg(start, std::ios_base::beg);\n"
+   "   MY(istr)->clear();\n"
+   "   MY(next_start) = 0;\n"
+   "   MY(bytes_read) = 0;\n"
+   "   MY(records_read) = 0;\n"
+   "   MY(hit_eof) = 0;\n"
+   "   m_range_end = (end < 0)? -1 : end;\n"
+   "}\n"
+   "\n"
+   "std::streamoff istream::find_record(std::streamoff start,\n"
+   "                                    std::streamoff begin)\n"
+   "{\n"
+   "   // Follows the chain of uncompressed record frames from start up\n"
+   "   // to the first one at or after begin, picking up any changes to\n"
+   "   // the integrity checks along the way.\n"
+   "   std::streambuf *sb = m_istr.rdbuf();\n"
+   "   int status = m_status_bits;\n"
+   "   while (start < begin) {\n"
+   "      char word[16];\n"
+   "      sb->pubseekpos(start, std::ios_base::in);\n"
+   "      if (sb->sgetn(word,4) != 4) {\n"
+   "         break;\n"
+   "      }\n"
+   "      istreambuffer wbuf(word,16);\n"
+   "      xstream::xdr::istream xstr(&wbuf);\n"
+   "      int size;\n"
+   "      xstr >> size;\n"
+   "      if (size == 1) {\n"
+   "         if (sb->sgetn(word+4,12) != 12) {\n"
+   "            break;\n"
+   "         }\n"
+   "         int format, flags;\n"
+   "         xstr >> size >> format >> flags;\n"
+   "         if ((flags & k_bits_compression) != k_no_compression) {\n"
+   "            throw std::runtime_error(\"hddm_"
+                   << classPrefix << "::istream::istream error - \"\n"
+   "                                     \"compression switched on part way \"\n"
+   "                                     \"through the input, cannot apply byte range.\");\n"
+   "         }\n"
+   "         m_status_bits.store(flags);\n"
+   "         status = flags;\n"
+   "         start += size+8;\n"
+   "      }\n"
+   "      else if (size < 1) {\n"
+   "         throw std::runtime_error(\"hddm_"
+                   << classPrefix << "::istream::istream error - \"\n"
+   "                                  \"invalid record size found in input.\");\n"
+   "      }\n"
+   "      else {\n"
+   "         start += size + ((status & k_crc32_integrity)? 8 : 4);\n"
+   "      }\n"
+   "   }\n"
+   "   return start;\n"
+   "}\n"
+   "\n"
+   "std::streamoff istream::find_block(std::streamoff begin) {\n"
+   "   // Scans forward from begin for the size prefix of a compressed\n"
+   "   // block, recognized by the magic bytes that open every z or bz2\n"
+   "   // block, and confirmed by finding further block headers (or the\n"
+   "   // end of the file) at the offsets given by the size prefixes.\n"
+   "   // Returns the end of the file if there is no block after begin.\n"
+   "   const int max_size = 0x400000;\n"
+   "   const int hops = 4;\n"
+   "   const int chunk = 0x10000;\n"
+   "   int cmp = m_status_bits & k_bits_compression;\n"
+   "   std::streambuf *sb = m_istr.rdbuf();\n"
+   "   std::streamoff eof = sb->pubseekoff(0, std::ios_base::end, std::ios_base::in);\n"
+   "   std::vector<unsigned char> buf(chunk + 8);\n"
+   "   auto is_block = [&](const unsigned char *b, int n) {\n"
+   "      if (n < 8 || b[0] != 0)\n"
+   "         return -1;\n"
+   "      int size = (b[1] << 16) | (b[2] << 8) | b[3];\n"
+   "      if (size < 4 || size > max_size)\n"
+   "         return -1;\n"
+   "      if (cmp == k_z_compression) {\n"
+   "         if ((b[4] & 0x0f) != 8 || ((b[4] << 8) | b[5]) % 31 != 0)\n"
+   "            return -1;\n"
+   "      }\n"
+   "      else if (b[4] != 'B' || b[5] != 'Z' || b[6] != 'h' ||\n"
+   "               b[7] < '1' || b[7] > '9')\n"
+   "      {\n"
+   "         return -1;\n"
+   "      }\n"
+   "      return size;\n"
+   "   };\n"
+   "   for (std::streamoff pos = begin; pos < eof; pos += chunk) {\n"
+   "      sb->pubseekpos(pos, std::ios_base::in);\n"
+   "      int n = sb->sgetn((char*)buf.data(), chunk + 8);\n"
+   "      for (int i=0; i < std::min(n, chunk); ++i) {\n"
+   "         int size = is_block(&buf[i], n - i);\n"
+   "         if (size < 0)\n"
+   "            continue;\n"
+   "         std::streamoff next = pos + i + size + 4;\n"
+   "         int hop = 1;\n"
+   "         for (; hop < hops && next < eof; ++hop) {\n"
+   "            unsigned char b[8];\n"
+   "            sb->pubseekpos(next, std::ios_base::in);\n"
+   "            int bsize = is_block(b, sb->sgetn((char*)b, 8));\n"
+   "            if (bsize < 0)\n"
+   "               break;\n"
+   "            next += bsize + 4;\n"
+   "         }\n"
+   "         if (hop == hops || next == eof) {\n"
+   "            return pos + i;\n"
+   "         }\n"
+   "      }\n"
+   "   }\n"
+   "   return eof;\n"
+   "}\n"
+   "\n"
    "istream::~istream() {\n"
    "   pthread_mutex_destroy(&m_streambuf_mutex);\n"
    "   for (int i=0; i<threads::max_threads; ++i) {\n"
-   "      thread_private_data *my_private = my_thread_private[i];\n"
-   "      if (my_private != 0) {\n"
-   "         if (MY(istr))\n"
-   "            delete MY(istr);\n"
-   "         if (MY(xcmp))\n"
-   "            delete MY(xcmp);\n"
-   "         if (MY(xstr))\n"
-   "            delete MY(xstr);\n"
-   "         if (MY(sbuf))\n"
-   "            delete MY(sbuf);\n"
-   "         delete [] MY(event_buffer);\n"
-   "         delete my_private;\n"
-   "      }\n"
+   "      free_private_data(i);\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "void istream::free_private_data(int threadID) {\n"
+   "   thread_private_data *my_private = my_thread_private[threadID];\n"
+   "   if (my_private != 0) {\n"
+   "      if (MY(istr))\n"
+   "         delete MY(istr);\n"
+   "      if (MY(xcmp))\n"
+   "         delete MY(xcmp);\n"
+   "      if (MY(xstr))\n"
+   "         delete MY(xstr);\n"
+   "      if (MY(sbuf))\n"
+   "         delete MY(sbuf);\n"
+   "      if (MY(event_buffer))\n"
+   "         bufferpool::checkin(MY(event_buffer),MY(event_buffer_size));\n"
+   "      delete my_private;\n"
+   "      my_thread_private[threadID] = 0;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "void istream::handover(int from_thread, int to_thread) {\n"
+   "   if (from_thread < 1 || from_thread >= threads::max_threads ||\n"
+   "       to_thread < 1 || to_thread >= threads::max_threads)\n"
+   "   {\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::istream::handover error - \"\n"
+   "                               \"invalid thread id\");\n"
    "   }\n"
+   "   if (from_thread == to_thread)\n"
+   "      return;\n"
+   "   free_private_data(to_thread);\n"
+   "   my_thread_private[to_thread] = my_thread_private[from_thread];\n"
+   "   my_thread_private[from_thread] = 0;\n"
    "}\n"
    "\n"
    "void istream::init_private_data() {\n"
@@ -1372,9 +2992,10 @@ int main(int argC, char* argV[])
    "      my_thread_private[threadID] = new thread_private_data;\n"
    "   }\n"
    "   MY_SETUP\n"
-   "   MY(genome).m_tagname = \"HDDM\";\n"
-   "   MY(genome).m_sequence = synthesize(m_documentString,0,HDDM::DocumentString(),0);\n"
-   "   MY(event_buffer) = new char[MY(event_buffer_size) = 100000];\n"
+   "   MY(codon) = m_genome.get();\n"
+   "   MY(targets).reserve(64);\n"
+   "   MY(event_buffer) = 0;\n"
+   "   MY(event_buffer_size) = 0;\n"
    "   MY(sbuf) = new istreambuffer(MY(event_buffer),MY(event_buffer_size));\n"
    "   MY(xstr) = new xstream::xdr::istream(MY(sbuf));\n"
    "   MY(istr) = new std::istream(m_istr.rdbuf());\n"
@@ -1392,6 +3013,28 @@ int main(int argC, char* argV[])
    "   MY(hit_eof) = 0;\n"
    "}\n"
    "\n"
+   "void istream::acquire_event_buffer(int size) {\n"
+   "   MY_SETUP\n"
+   "   char *newbuf = bufferpool::checkout(size);\n"
+   "   if (MY(event_buffer)) {\n"
+   "      memcpy(newbuf,MY(event_buffer),4);\n"
+   "      bufferpool::checkin(MY(event_buffer),MY(event_buffer_size));\n"
+   "   }\n"
+   "   MY(event_buffer) = newbuf;\n"
+   "   MY(event_buffer_size) = size;\n"
+   "   MY(sbuf)->setbuffer(MY(event_buffer),MY(event_buffer_size));\n"
+   "}\n"
+   "\n"
+   "void istream::release_event_buffer() {\n"
+   "   MY_SETUP\n"
+   "   if (MY(event_buffer)) {\n"
+   "      bufferpool::checkin(MY(event_buffer),MY(event_buffer_size));\n"
+   "      MY(event_buffer) = 0;\n"
+   "      MY(event_buffer_size) = 0;\n"
+   "      MY(sbuf)->setbuffer(0,0);\n"
+   "   }\n"
+   "}\n"
+   "\n"
    "streamposition istream::getPosition() {\n"
    "   MY_SETUP\n"
    "   streamposition pos;\n"
@@ -1516,9 +3159,29 @@ int main(int argC, char* argV[])
    "   MY(mutex_lock) = 0;\n"
    "}\n"
    "\n"
-   "istream &istream::operator>>(HDDM &record) {\n"
+   "bool istream::load_record() {\n"
    "   MY_SETUP\n"
+   "   if (MY(event_buffer) == 0) {\n"
+   "      acquire_event_buffer(bufferpool::k_min_buffer_size);\n"
+   "   }\n"
    "   while (1 == 1) {\n"
+   "      if (m_pread != 0) {\n"
+   "         update_streambufs();\n"
+   "         if ((MY(status_bits) & k_bits_compression) == k_no_compression) {\n"
+   "            int res = pread_record();\n"
+   "            if (res < 0) {\n"
+   "               return false;\n"
+   "            }\n"
+   "            else if (res == 0) {\n"
+   "               continue;\n"
+   "            }\n"
+   "            else if (MY(events_to_skip) > 0) {\n"
+   "               --MY(events_to_skip);\n"
+   "               continue;\n"
+   "            }\n"
+   "            break;\n"
+   "         }\n"
+   "      }\n"
    "      lock_streambufs();\n"
    "      MY(event_size) = 0;\n"
    "      while (MY(event_size) == 0) {\n"
@@ -1530,8 +3193,9 @@ int main(int argC, char* argV[])
    "               MY(bytes_read) += MY(istr)->gcount();\n"
    "               if (!MY(istr)->good()) {\n"
    "                  unlock_streambufs();\n"
+   "                  release_event_buffer();\n"
    "                  MY(hit_eof) = 1;\n"
-   "                  return *this;\n"
+   "                  return false;\n"
    "               }\n"
    "               if (MY(status_bits) & k_bz2_compression) {\n"
    "                  MY(last_start)  = dynamic_cast<xstream::bz::istreambuf*>\n"
@@ -1568,10 +3232,17 @@ int main(int argC, char* argV[])
    "            MY(bytes_read) += MY(istr)->gcount();\n"
    "            if (!MY(istr)->good()) {\n"
    "               unlock_streambufs();\n"
+   "               release_event_buffer();\n"
    "               MY(hit_eof) = 1;\n"
-   "               return *this;\n"
+   "               return false;\n"
    "            }\n"
    "         }\n"
+   "         if (m_range_end >= 0 && MY(last_start) >= m_range_end) {\n"
+   "            unlock_streambufs();\n"
+   "            release_event_buffer();\n"
+   "            MY(hit_eof) = 1;\n"
+   "            return false;\n"
+   "         }\n"
    "         MY(hit_eof) = 0;\n"
    "         MY(sbuf)->reset();\n"
    "         *MY(xstr) >> MY(event_size);\n"
@@ -1606,69 +3277,564 @@ int main(int argC, char* argV[])
    "            MY(event_size) = 0;\n"
    "         }\n"
    "      }\n"
-   "      if (MY(event_size)+8 > MY(event_buffer_size)) {\n"
-   "         delete MY(xstr);\n"
-   "         delete MY(sbuf);\n"
-   "         char *newbuf = new char[MY(event_buffer_size) = MY(event_size)+1000];\n"
-   "         MY(sbuf) = new istreambuffer(newbuf, MY(event_buffer_size));\n"
-   "         MY(xstr) = new xstream::xdr::istream(MY(sbuf));\n"
-   "         memcpy(newbuf,MY(event_buffer),4);\n"
-   "         delete [] MY(event_buffer);\n"
-   "         MY(event_buffer) = newbuf;\n"
+   "      if (MY(event_size)+8 > MY(event_buffer_size)) {\n"
+   "         acquire_event_buffer(MY(event_size)+8);\n"
+   "      }\n"
+   "      MY(istr)->read(MY(event_buffer)+4,MY(event_size));\n"
+   "      MY(bytes_read) += MY(istr)->gcount();\n"
+   "      MY(records_read)++;\n"
+   "      if (!MY(istr)->good()) {\n"
+   "         unlock_streambufs();\n"
+   "         throw std::runtime_error(\"hddm_"
+                    << classPrefix << "::istream::operator>> error -\"\n"
+   "                                  \" read error in mid-record!\");\n"
+   "      }\n"
+   "      if ((MY(status_bits) & k_crc32_integrity) != 0) {\n"
+   "         char crcbuf[10];\n"
+   "         MY(istr)->read(crcbuf,4);\n"
+   "         MY(bytes_read) += MY(istr)->gcount();\n"
+   "         verify_crc(crcbuf);\n"
+   "      }\n"
+   "      unlock_streambufs();\n"
+   "      if (MY(events_to_skip) > 0) {\n"
+   "         --MY(events_to_skip);\n"
+   "      }\n"
+   "      else {\n"
+   "         break;\n"
+   "      }\n"
+   "   }\n"
+   "   MY(sbuf)->reset();\n"
+   "   return true;\n"
+   "}\n"
+   "\n"
+   "int istream::pread_record() {\n"
+   "   // Claims the next record from the shared cursor of m_pread\n"
+   "   // and reads it into the event buffer. The size word is read\n"
+   "   // first and the claim retried if another thread got there\n"
+   "   // first. Returns 1 if a record was loaded, 0 if a stream token\n"
+   "   // was consumed instead, or -1 at end of input.\n"
+   "   MY_SETUP\n"
+   "   if (MY(next_start) > 0) {\n"
+   "      m_pread->pubseekpos(MY(next_start), std::ios_base::in);\n"
+   "      MY(next_start) = 0;\n"
+   "   }\n"
+   "   while (1 == 1) {\n"
+   "      std::streamoff start = m_pread->tell();\n"
+   "      int status = m_status_bits;\n"
+   "      if ((m_range_end >= 0 && start >= m_range_end) ||\n"
+   "          m_pread->pread(MY(event_buffer),4,start) != 4)\n"
+   "      {\n"
+   "         release_event_buffer();\n"
+   "         MY(hit_eof) = 1;\n"
+   "         return -1;\n"
+   "      }\n"
+   "      MY(hit_eof) = 0;\n"
+   "      MY(sbuf)->reset();\n"
+   "      *MY(xstr) >> MY(event_size);\n"
+   "      if (MY(event_size) == 1) {\n"
+   "         int size;\n"
+   "         if (m_pread->pread(MY(event_buffer)+4,4,start+4) != 4) {\n"
+   "            throw std::runtime_error(\"hddm_"
+                      << classPrefix << "::istream::operator>> error -\"\n"
+   "                                     \" read error on token input!\");\n"
+   "         }\n"
+   "         *MY(xstr) >> size;\n"
+   "         if (size+8 > MY(event_buffer_size)) {\n"
+   "            acquire_event_buffer(size+8);\n"
+   "         }\n"
+   "         if (m_pread->pread(MY(event_buffer)+8,size,start+8) != size) {\n"
+   "            throw std::runtime_error(\"hddm_"
+                      << classPrefix << "::istream::operator>> error -\"\n"
+   "                                     \" read error on token input!\");\n"
+   "         }\n"
+   "         int format, flags;\n"
+   "         *MY(xstr) >> format >> flags;\n"
+   "         if (format != 0) {\n"
+   "            throw std::runtime_error(\"hddm_"
+                      << classPrefix << "::istream::operator>> error - \"\n"
+   "                                     \"unsupported compression format!\");\n"
+   "         }\n"
+   "         // the cursor is held at the token until the new flags are\n"
+   "         // published, so nothing after it is claimed with the old ones\n"
+   "         if (m_pread->lock(start)) {\n"
+   "            m_status_bits.store(flags);\n"
+   "            m_pread->unlock(start+size+8);\n"
+   "            MY(bytes_read) += size+8;\n"
+   "         }\n"
+   "         return 0;\n"
+   "      }\n"
+   "      int crcsize = (status & k_crc32_integrity)? 4 : 0;\n"
+   "      if (! m_pread->claim(start,MY(event_size)+crcsize+4)) {\n"
+   "         continue;\n"
+   "      }\n"
+   "      MY(last_start) = start;\n"
+   "      MY(last_offset) = 0;\n"
+   "      if (MY(event_size)+8 > MY(event_buffer_size)) {\n"
+   "         acquire_event_buffer(MY(event_size)+8);\n"
+   "      }\n"
+   "      if (m_pread->pread(MY(event_buffer)+4,MY(event_size),start+4)\n"
+   "          != MY(event_size))\n"
+   "      {\n"
+   "         throw std::runtime_error(\"hddm_"
+                   << classPrefix << "::istream::operator>> error -\"\n"
+   "                                  \" read error in mid-record!\");\n"
+   "      }\n"
+   "      MY(bytes_read) += MY(event_size)+crcsize+4;\n"
+   "      MY(records_read)++;\n"
+   "      if (crcsize > 0) {\n"
+   "         char crcbuf[10];\n"
+   "         m_pread->pread(crcbuf,4,start+MY(event_size)+4);\n"
+   "         verify_crc(crcbuf);\n"
+   "      }\n"
+   "      MY(sbuf)->reset();\n"
+   "      return 1;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "void istream::verify_crc(char *crcbuf) {\n"
+   "   MY_SETUP\n"
+   "   unsigned int recorded_crc;\n"
+   "   istreambuffer sbuf(crcbuf,10);\n"
+   "   xstream::xdr::istream xstr(&sbuf);\n"
+   "   xstr >> recorded_crc;\n"
+   "   xstream::digest::crc32 crc;\n"
+   "   std::ostream out(&crc);\n"
+   "   out.write(MY(event_buffer),MY(event_size)+4);\n"
+   "   out.flush();\n"
+   "   if (crc.digest() != recorded_crc) {\n"
+   "      char errmsg[] = \n"
+   "           \"WARNING: crc data integrity check failed\"\n"
+   "           \" on hddm_" << classPrefix << " input stream!\";\n"
+   "      if ((MY(status_bits) & 0x02) == 0) {\n"
+   "         std::cerr << errmsg << std::endl;\n"
+   "         MY(status_bits) |= 0x02;\n"
+   "      }\n"
+   "      //throw std::runtime_error(\"hddm_"
+                  << classPrefix << "::istream::operator>> error -\"\n"
+   "      //                 \" crc check error on input stream!\");\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "istream &istream::operator>>(HDDM &record) {\n"
+   "   MY_SETUP\n"
+   "   if (! load_record()) {\n"
+   "      return *this;\n"
+   "   }\n"
+   "   MY(sequencing) = 0;\n"
+   "   MY(codon) = m_genome.get();\n"
+   "   MY(targets).clear();\n"
+   "   record.clear();\n"
+   "   *this >> (streamable&)record;\n"
+   "   release_event_buffer();\n"
+   "   return *this;\n"
+   "}\n"
+   "\n"
+   "istream &istream::operator>>(HDDMView &view) {\n"
+   "   MY_SETUP\n"
+   "   if (! viewable()) {\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::istream::operator>> error - \"\n"
+   "                               \"record views require an input file \"\n"
+   "                               \"with the same data model as this library\");\n"
+   "   }\n"
+   "   else if (! load_record()) {\n"
+   "      view = HDDMView();\n"
+   "      return *this;\n"
+   "   }\n"
+   "   view = HDDMView(MY(event_buffer) + 4);\n"
+   "   return *this;\n"
+   "}\n"
+   "\n"
+   "istream &istream::readRaw(std::string &bytes) {\n"
+   "   MY_SETUP\n"
+   "   if (! viewable()) {\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::istream::readRaw error - \"\n"
+   "                               \"raw records require an input file \"\n"
+   "                               \"with the same data model as this library\");\n"
+   "   }\n"
+   "   else if (! load_record()) {\n"
+   "      bytes.clear();\n"
+   "      return *this;\n"
+   "   }\n"
+   "   bytes.assign(MY(event_buffer), MY(event_size) + 4);\n"
+   "   release_event_buffer();\n"
+   "   return *this;\n"
+   "}\n"
+   "\n"
+   "chain::chain(const std::vector<std::string> &paths, opener open, int depth)\n"
+   " : m_paths(paths),\n"
+   "   m_file_start(paths.size(), k_not_reached),\n"
+   "   m_open(open),\n"
+   "   m_depth(std::max(depth, 1)),\n"
+   "   m_file(-1),\n"
+   "   m_records_read(0),\n"
+   "   m_hit_eof(false),\n"
+   "   m_done(false),\n"
+   "   m_stop(false),\n"
+   "   m_ahead_index(-1),\n"
+   "   m_ahead_ready(false)\n"
+   "{\n"
+   "   m_ahead.m_stream = 0;\n"
+   "   m_ahead.m_hddm = 0;\n"
+   "   m_ahead.m_thread = 0;\n"
+   "   pthread_mutex_init(&m_mutex,0);\n"
+   "   pthread_cond_init(&m_filled,0);\n"
+   "   pthread_cond_init(&m_drained,0);\n"
+   "   pthread_cond_init(&m_ahead_changed,0);\n"
+   "   if (pthread_create(&m_prefetch_thread,0,prefetcher,this) != 0) {\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::chain::chain error - \"\n"
+   "                               \"unable to start prefetch thread\");\n"
+   "   }\n"
+   "   if (pthread_create(&m_thread,0,reader,this) != 0) {\n"
+   "      pthread_mutex_lock(&m_mutex);\n"
+   "      m_stop = true;\n"
+   "      pthread_cond_signal(&m_ahead_changed);\n"
+   "      pthread_mutex_unlock(&m_mutex);\n"
+   "      pthread_join(m_prefetch_thread,0);\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::chain::chain error - \"\n"
+   "                               \"unable to start reader thread\");\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "chain::~chain() {\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   m_stop = true;\n"
+   "   pthread_cond_signal(&m_drained);\n"
+   "   pthread_cond_broadcast(&m_ahead_changed);\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "   pthread_join(m_thread,0);\n"
+   "   pthread_join(m_prefetch_thread,0);\n"
+   "   close_file(m_ahead);\n"
+   "   for (size_t i=0; i < m_queue.size(); ++i) {\n"
+   "      delete m_queue[i].m_record;\n"
+   "   }\n"
+   "   for (size_t i=0; i < m_spares.size(); ++i) {\n"
+   "      delete m_spares[i];\n"
+   "   }\n"
+   "   pthread_cond_destroy(&m_ahead_changed);\n"
+   "   pthread_cond_destroy(&m_drained);\n"
+   "   pthread_cond_destroy(&m_filled);\n"
+   "   pthread_mutex_destroy(&m_mutex);\n"
+   "}\n"
+   "\n"
+   "void *chain::reader(void *me) {\n"
+   "   chain *self = (chain*)me;\n"
+   "   try {\n"
+   "      self->read_files();\n"
+   "   }\n"
+   "   catch (std::exception &e) {\n"
+   "      pthread_mutex_lock(&self->m_mutex);\n"
+   "      self->m_error = e.what();\n"
+   "      pthread_mutex_unlock(&self->m_mutex);\n"
+   "   }\n"
+   "   pthread_mutex_lock(&self->m_mutex);\n"
+   "   self->m_done = true;\n"
+   "   pthread_cond_signal(&self->m_filled);\n"
+   "   pthread_mutex_unlock(&self->m_mutex);\n"
+   "   threads::releaseID();\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
+   "void *chain::prefetcher(void *me) {\n"
+   "   chain *self = (chain*)me;\n"
+   "   self->prefetch_files();\n"
+   "   threads::releaseID();\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
+   "void chain::open_file(int index, member &file) {\n"
+   "   const std::string &path = m_paths[index];\n"
+   "   file.m_stream = 0;\n"
+   "   file.m_hddm = 0;\n"
+   "   if (m_open)\n"
+   "      file.m_stream = m_open(path);\n"
+   "   else\n"
+   "      file.m_stream = new std::ifstream(path.c_str());\n"
+   "   if (file.m_stream == 0 || !file.m_stream->good()) {\n"
+   "      close_file(file);\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::chain error - \"\n"
+   "                               \"cannot open input file \" + path);\n"
+   "   }\n"
+   "   try {\n"
+   "      file.m_hddm = new istream(*file.m_stream);\n"
+   "   }\n"
+   "   catch (std::exception &e) {\n"
+   "      close_file(file);\n"
+   "      throw std::runtime_error(path + \": \" + e.what());\n"
+   "   }\n"
+   "   if (index == 0) {\n"
+   "      m_header = file.m_hddm->m_documentString;\n"
+   "   }\n"
+   "   else if (file.m_hddm->m_documentString != m_header) {\n"
+   "      close_file(file);\n"
+   "      throw std::runtime_error(\"hddm_" + classPrefix +
+   "::chain error - \"\n"
+   "                               \"input file \" + path + \" has a different \"\n"
+   "                               \"data model than \" + m_paths[0]);\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "void chain::close_file(member &file) {\n"
+   "   if (file.m_hddm)\n"
+   "      delete file.m_hddm;\n"
+   "   if (file.m_stream)\n"
+   "      delete file.m_stream;\n"
+   "   file.m_hddm = 0;\n"
+   "   file.m_stream = 0;\n"
+   "   for (size_t i=0; i < file.m_head.size(); ++i) {\n"
+   "      delete file.m_head[i];\n"
+   "   }\n"
+   "   file.m_head.clear();\n"
+   "}\n"
+   "\n"
+   "void chain::prefetch_files() {\n"
+   "   // Opens each file the reader asks for and decodes its first records\n"
+   "   // ahead of time. Only this thread ever touches m_header.\n"
+   "   member file;\n"
+   "   file.m_stream = 0;\n"
+   "   file.m_hddm = 0;\n"
+   "   file.m_thread = threads::getID();\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   while (true) {\n"
+   "      while ((m_ahead_index < 0 || m_ahead_ready) && !m_stop) {\n"
+   "         pthread_cond_wait(&m_ahead_changed,&m_mutex);\n"
+   "      }\n"
+   "      if (m_stop)\n"
+   "         break;\n"
+   "      int index = m_ahead_index;\n"
+   "      pthread_mutex_unlock(&m_mutex);\n"
+   "      file.m_error.clear();\n"
+   "      try {\n"
+   "         open_file(index,file);\n"
+   "      }\n"
+   "      catch (std::exception &e) {\n"
+   "         file.m_error = e.what();\n"
+   "      }\n"
+   "      while (file.m_hddm && int(file.m_head.size()) < m_depth) {\n"
+   "         HDDM *record = 0;\n"
+   "         pthread_mutex_lock(&m_mutex);\n"
+   "         if (m_spares.size() > 0) {\n"
+   "            record = m_spares.back();\n"
+   "            m_spares.pop_back();\n"
+   "         }\n"
+   "         pthread_mutex_unlock(&m_mutex);\n"
+   "         if (record == 0)\n"
+   "            record = new HDDM();\n"
+   "         try {\n"
+   "            if (!(*file.m_hddm >> *record)) {\n"
+   "               delete record;\n"
+   "               break;\n"
+   "            }\n"
+   "         }\n"
+   "         catch (std::exception &e) {\n"
+   "            delete record;\n"
+   "            file.m_error = m_paths[index] + \": \" + e.what();\n"
+   "            break;\n"
+   "         }\n"
+   "         file.m_head.push_back(record);\n"
+   "      }\n"
+   "      pthread_mutex_lock(&m_mutex);\n"
+   "      m_ahead = file;\n"
+   "      m_ahead_index = -1;\n"
+   "      m_ahead_ready = true;\n"
+   "      pthread_cond_broadcast(&m_ahead_changed);\n"
+   "      file.m_stream = 0;\n"
+   "      file.m_hddm = 0;\n"
+   "      file.m_head.clear();\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "}\n"
+   "\n"
+   "void chain::request_file(int index) {\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   m_ahead_index = index;\n"
+   "   pthread_cond_broadcast(&m_ahead_changed);\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "}\n"
+   "\n"
+   "bool chain::collect_file(member &file) {\n"
+   "   // waits for the file last requested from the prefetcher, returns\n"
+   "   // false if the chain is being destroyed and the reader should stop\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   while (!m_ahead_ready && !m_stop) {\n"
+   "      pthread_cond_wait(&m_ahead_changed,&m_mutex);\n"
+   "   }\n"
+   "   if (m_stop) {\n"
+   "      pthread_mutex_unlock(&m_mutex);\n"
+   "      return false;\n"
+   "   }\n"
+   "   file = m_ahead;\n"
+   "   m_ahead.m_stream = 0;\n"
+   "   m_ahead.m_hddm = 0;\n"
+   "   m_ahead.m_head.clear();\n"
+   "   m_ahead_ready = false;\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "   return true;\n"
+   "}\n"
+   "\n"
+   "bool chain::push(HDDM *record, int file) {\n"
+   "   // queues a record for the caller, returns false if the chain\n"
+   "   // is being destroyed and the reader should stop\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   while (int(m_queue.size()) >= m_depth && !m_stop) {\n"
+   "      pthread_cond_wait(&m_drained,&m_mutex);\n"
+   "   }\n"
+   "   if (m_stop) {\n"
+   "      pthread_mutex_unlock(&m_mutex);\n"
+   "      delete record;\n"
+   "      return false;\n"
+   "   }\n"
+   "   entry next;\n"
+   "   next.m_record = record;\n"
+   "   next.m_file = file;\n"
+   "   m_queue.push_back(next);\n"
+   "   pthread_cond_signal(&m_filled);\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "   return true;\n"
+   "}\n"
+   "\n"
+   "void chain::read_files() {\n"
+   "   int nfiles = m_paths.size();\n"
+   "   member file;\n"
+   "   file.m_stream = 0;\n"
+   "   file.m_hddm = 0;\n"
+   "   if (nfiles > 0) {\n"
+   "      request_file(0);\n"
+   "   }\n"
+   "   for (int index=0; index < nfiles; ++index) {\n"
+   "      if (! collect_file(file))\n"
+   "         return;\n"
+   "      if (index+1 < nfiles) {\n"
+   "         request_file(index+1);\n"
+   "      }\n"
+   "      std::vector<HDDM*> head;\n"
+   "      head.swap(file.m_head);\n"
+   "      for (size_t i=0; i < head.size(); ++i) {\n"
+   "         if (! push(head[i],index)) {\n"
+   "            for (++i; i < head.size(); ++i)\n"
+   "               delete head[i];\n"
+   "            close_file(file);\n"
+   "            return;\n"
+   "         }\n"
+   "      }\n"
+   "      if (file.m_error.size() > 0) {\n"
+   "         close_file(file);\n"
+   "         throw std::runtime_error(file.m_error);\n"
    "      }\n"
-   "      MY(istr)->read(MY(event_buffer)+4,MY(event_size));\n"
-   "      MY(bytes_read) += MY(istr)->gcount();\n"
-   "      MY(records_read)++;\n"
-   "      if (!MY(istr)->good()) {\n"
-   "         unlock_streambufs();\n"
-   "         throw std::runtime_error(\"hddm_"
-                    << classPrefix << "::istream::operator>> error -\"\n"
-   "                                  \" read error in mid-record!\");\n"
+   "      else if (int(head.size()) < m_depth) {\n"
+   "         close_file(file);\n"
+   "         continue;\n"
    "      }\n"
-   "      if ((MY(status_bits) & k_crc32_integrity) != 0) {\n"
-   "         unsigned int recorded_crc;\n"
-   "         char crcbuf[10];\n"
-   "         istreambuffer sbuf(crcbuf,10);\n"
-   "         xstream::xdr::istream xstr(&sbuf);\n"
-   "         MY(istr)->read(crcbuf,4);\n"
-   "         MY(bytes_read) += MY(istr)->gcount();\n"
-   "         xstr >> recorded_crc;\n"
-   "         xstream::digest::crc32 crc;\n"
-   "         std::ostream out(&crc);\n"
-   "         out.write(MY(event_buffer),MY(event_size)+4);\n"
-   "         out.flush();\n"
-   "         if (crc.digest() != recorded_crc) {\n"
-   "            char errmsg[] = \n"
-   "                 \"WARNING: crc data integrity check failed\"\n"
-   "                 \" on hddm_" << classPrefix << " input stream!\";\n"
-   "            if ((MY(status_bits) & 0x02) == 0) {\n"
-   "               std::cerr << errmsg << std::endl;\n"
-   "               MY(status_bits) |= 0x02;\n"
+   "      file.m_hddm->handover(file.m_thread, threads::getID());\n"
+   "      while (true) {\n"
+   "         HDDM *record = 0;\n"
+   "         pthread_mutex_lock(&m_mutex);\n"
+   "         if (m_spares.size() > 0) {\n"
+   "            record = m_spares.back();\n"
+   "            m_spares.pop_back();\n"
+   "         }\n"
+   "         pthread_mutex_unlock(&m_mutex);\n"
+   "         if (record == 0)\n"
+   "            record = new HDDM();\n"
+   "         try {\n"
+   "            if (!(*file.m_hddm >> *record)) {\n"
+   "               delete record;\n"
+   "               break;\n"
    "            }\n"
-   "            //unlock_streambufs();\n"
-   "            //throw std::runtime_error(\"hddm_"
-                        << classPrefix << "::istream::operator>> error -\"\n"
-   "            //                 \" crc check error on input stream!\");\n"
+   "         }\n"
+   "         catch (std::exception &e) {\n"
+   "            delete record;\n"
+   "            close_file(file);\n"
+   "            throw std::runtime_error(m_paths[index] + \": \" + e.what());\n"
+   "         }\n"
+   "         if (! push(record,index)) {\n"
+   "            close_file(file);\n"
+   "            return;\n"
    "         }\n"
    "      }\n"
-   "      unlock_streambufs();\n"
-   "      if (MY(events_to_skip) > 0) {\n"
-   "         --MY(events_to_skip);\n"
+   "      close_file(file);\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "chain &chain::operator>>(HDDM &record) {\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   while (m_queue.empty() && !m_done) {\n"
+   "      pthread_cond_wait(&m_filled,&m_mutex);\n"
+   "   }\n"
+   "   if (m_queue.empty()) {\n"
+   "      std::string error;\n"
+   "      error.swap(m_error);\n"
+   "      pthread_mutex_unlock(&m_mutex);\n"
+   "      m_hit_eof = true;\n"
+   "      record.clear();\n"
+   "      if (error.size() == 0) {\n"
+   "         while (m_file+1 < int(m_file_start.size())) {\n"
+   "            m_file_start[++m_file] = m_records_read;\n"
+   "         }\n"
    "      }\n"
    "      else {\n"
-   "         break;\n"
+   "         throw std::runtime_error(\"hddm_" + classPrefix +
+   "::chain::operator>> error - \" + error);\n"
    "      }\n"
+   "      return *this;\n"
    "   }\n"
-   "   MY(sbuf)->reset();\n"
-   "   MY(sequencing) = 0;\n"
-   "   MY(codon) = &MY(genome);\n"
-   "   record.clear();\n"
-   "   *this >> (streamable&)record;\n"
+   "   entry next = m_queue.front();\n"
+   "   m_queue.pop_front();\n"
+   "   pthread_cond_signal(&m_drained);\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
+   "   record = std::move(*next.m_record);\n"
+   "   next.m_record->clear();\n"
+   "   while (m_file < next.m_file) {\n"
+   "      m_file_start[++m_file] = m_records_read;\n"
+   "   }\n"
+   "   ++m_records_read;\n"
+   "   m_hit_eof = false;\n"
+   "   pthread_mutex_lock(&m_mutex);\n"
+   "   m_spares.push_back(next.m_record);\n"
+   "   pthread_mutex_unlock(&m_mutex);\n"
    "   return *this;\n"
    "}\n"
    "\n"
-   "ostream::ostream(std::ostream &src)\n"
+   "int chain::getFileIndex() const {\n"
+   "   return m_file;\n"
+   "}\n"
+   "\n"
+   "const std::string &chain::getFileName(int index) const {\n"
+   "   return m_paths.at(index);\n"
+   "}\n"
+   "\n"
+   "int chain::getFileCount() const {\n"
+   "   return m_file_start.size();\n"
+   "}\n"
+   "\n"
+   "size_t chain::getFileStart(int index) const {\n"
+   "   return m_file_start.at(index);\n"
+   "}\n"
+   "\n"
+   "size_t chain::getRecordsRead() const {\n"
+   "   return m_records_read;\n"
+   "}\n"
+   "\n"
+   "bool chain::eof() {\n"
+   "   return m_hit_eof;\n"
+   "}\n"
+   "\n"
+   "bool chain::operator!() {\n"
+   "   return eof();\n"
+   "}\n"
+   "\n"
+   "chain::operator void*() {\n"
+   "   return (m_hit_eof)? 0 : this;\n"
+   "}\n"
+   "\n"
+   "ostream::ostream(std::ostream &src, int async_blocks)\n"
    " : m_ostr(src),\n"
+   "   m_async(0),\n"
+   "   m_sink(src.rdbuf()),\n"
    "   m_status_bits(k_default_status)\n"
    "{\n"
    "   m_ostr << HDDM::DocumentString();\n"
@@ -1677,6 +3843,11 @@ int main(int argC, char* argV[])
    "::ostream::ostream(ostream) \"\n"
    "                               \"error - write error on header output!\");\n"
    "   }\n"
+   "   if (async_blocks > 0) {\n"
+   "      m_ostr.flush();\n"
+   "      m_async = new asyncsink(m_ostr.rdbuf(), async_blocks);\n"
+   "      m_sink = m_async;\n"
+   "   }\n"
    "   pthread_mutex_init(&m_streambuf_mutex,0);\n"
    "   for (int i=0; i<threads::max_threads; ++i) {\n"
    "      my_thread_private[i] = 0;\n"
@@ -1693,21 +3864,65 @@ int main(int argC, char* argV[])
    "            delete MY(xstr);\n"
    "         }\n"
    "         if (MY(sbuf)) {\n"
+   "            if (MY(sbuf)->getbuf())\n"
+   "               bufferpool::checkin(MY(sbuf)->getbuf(),MY(sbuf)->capacity());\n"
    "            delete MY(sbuf);\n"
    "         }\n"
    "         if (MY(xcmp)) {\n"
    "            MY(xcmp)->pubsync();\n"
-   "            MY(ostr)->rdbuf(m_ostr.rdbuf());\n"
+   "            MY(ostr)->rdbuf(m_sink);\n"
    "            delete MY(xcmp);\n"
    "         }\n"
    "         if (MY(ostr)) {\n"
    "            MY(ostr)->flush();\n"
    "            delete MY(ostr);\n"
    "         }\n"
-   "         delete [] MY(event_buffer);\n"
    "         delete my_private;\n"
    "      }\n"
    "   }\n"
+   "   if (m_async) {\n"
+   "      m_async->close();\n"
+   "      delete m_async;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "void ostream::flush() {\n"
+   "   MY_SETUP\n"
+   "   lock_streambufs();\n"
+   "   MY(ostr)->flush();\n"
+   "   bool good = MY(ostr)->good();\n"
+   "   unlock_streambufs();\n"
+   "   pthread_mutex_lock(&m_streambuf_mutex);\n"
+   "   good &= (m_sink->pubsync() == 0);\n"
+   "   pthread_mutex_unlock(&m_streambuf_mutex);\n"
+   "   if (!good) {\n"
+   "      throw std::runtime_error(\"hddm_"
+                << classPrefix << "::ostream::flush error - \"\n"
+   "                               \"write error on event output!\");\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "void ostream::close() {\n"
+   "   // Flushes the output of all threads through to the underlying\n"
+   "   // stream and stops the background writer, if any. It must only\n"
+   "   // be called after all threads have finished writing records.\n"
+   "   bool good = true;\n"
+   "   for (int i=0; i<threads::max_threads; ++i) {\n"
+   "      thread_private_data *my_private = my_thread_private[i];\n"
+   "      if (my_private != 0 && MY(ostr)) {\n"
+   "         MY(ostr)->flush();\n"
+   "         good &= MY(ostr)->good();\n"
+   "      }\n"
+   "   }\n"
+   "   if (m_async) {\n"
+   "      good &= (m_async->close() == 0);\n"
+   "   }\n"
+   "   m_ostr.flush();\n"
+   "   if (!good || !m_ostr.good()) {\n"
+   "      throw std::runtime_error(\"hddm_"
+                << classPrefix << "::ostream::close error - \"\n"
+   "                               \"write error on event output!\");\n"
+   "   }\n"
    "}\n"
    "\n"
    "void ostream::init_private_data() {\n"
@@ -1716,10 +3931,9 @@ int main(int argC, char* argV[])
    "      my_thread_private[threadID] = new thread_private_data;\n"
    "   }\n"
    "   MY_SETUP\n"
-   "   MY(event_buffer) = new char[MY(event_buffer_size) = 100000];\n"
-   "   MY(sbuf) = new ostreambuffer(MY(event_buffer),MY(event_buffer_size));\n"
+   "   MY(sbuf) = new ostreambuffer(0,0);\n"
    "   MY(xstr) = new xstream::xdr::ostream(MY(sbuf));\n"
-   "   MY(ostr) = new std::ostream(m_ostr.rdbuf());\n"
+   "   MY(ostr) = new std::ostream(m_sink);\n"
    "   MY(xcmp) = 0;\n"
    "   MY(last_start) = 0;\n"
    "   MY(last_offset) = 0;\n"
@@ -1729,6 +3943,21 @@ int main(int argC, char* argV[])
    "   MY(mutex_lock) = 0;\n"
    "}\n"
    "\n"
+   "void ostream::acquire_event_buffer(int size) {\n"
+   "   MY_SETUP\n"
+   "   release_event_buffer();\n"
+   "   char *buffer = bufferpool::checkout(size);\n"
+   "   MY(sbuf)->setbuffer(buffer,size);\n"
+   "}\n"
+   "\n"
+   "void ostream::release_event_buffer() {\n"
+   "   MY_SETUP\n"
+   "   if (MY(sbuf) && MY(sbuf)->getbuf()) {\n"
+   "      bufferpool::checkin(MY(sbuf)->getbuf(),MY(sbuf)->capacity());\n"
+   "      MY(sbuf)->setbuffer(0,0);\n"
+   "   }\n"
+   "}\n"
+   "\n"
    "void ostream::setCompression(int flags) {\n"
    "   MY_SETUP\n"
    "   int oldcmp = (int)m_status_bits & k_bits_compression;\n"
@@ -1738,7 +3967,7 @@ int main(int argC, char* argV[])
    "      m_status_bits.fetch_or(k_bits_compression & flags);\n"
    "      if (newcmp != 0)\n"
    "         m_status_bits.fetch_or(k_can_reposition);\n"
-   "      MY(sbuf)->reset();\n"
+   "      acquire_event_buffer(bufferpool::k_min_buffer_size);\n"
    "      *MY(xstr) << 1 << 8 << 0 << (int)m_status_bits;\n"
    "      lock_streambufs();\n"
    "      MY(ostr)->write(MY(sbuf)->getbuf(),MY(sbuf)->size());\n"
@@ -1751,6 +3980,7 @@ int main(int argC, char* argV[])
    "      MY(ostr)->flush();\n"
    "      update_streambufs();\n"
    "      unlock_streambufs();\n"
+   "      release_event_buffer();\n"
    "   }\n"
    "}\n"
    "\n"
@@ -1761,7 +3991,7 @@ int main(int argC, char* argV[])
    "   if (oldint != newint) {\n"
    "      m_status_bits.fetch_and(~k_bits_integrity | flags);\n"
    "      m_status_bits.fetch_or(k_bits_integrity & flags);\n"
-   "      MY(sbuf)->reset();\n"
+   "      acquire_event_buffer(bufferpool::k_min_buffer_size);\n"
    "      *MY(xstr) << 1 << 8 << 0 << (int)m_status_bits;\n"
    "      lock_streambufs();\n"
    "      MY(ostr)->write(MY(sbuf)->getbuf(),MY(sbuf)->size());\n"
@@ -1774,6 +4004,7 @@ int main(int argC, char* argV[])
    "      MY(ostr)->flush();\n"
    "      update_streambufs();\n"
    "      unlock_streambufs();\n"
+   "      release_event_buffer();\n"
    "   }\n"
    "}\n"
    "\n" 
@@ -1799,18 +4030,18 @@ int main(int argC, char* argV[])
    "   int newcmp = (int)m_status_bits & k_bits_compression;\n"
    "   if (oldcmp != newcmp) {\n"
    "      if (oldcmp != k_no_compression) {\n"
-   "         MY(ostr)->rdbuf(m_ostr.rdbuf());\n"
+   "         MY(ostr)->rdbuf(m_sink);\n"
    "         delete MY(xcmp);\n"
    "         MY(xcmp) = 0;\n"
    "      }\n"
    "      if (newcmp == k_z_compression) {\n"
    "         //std::cerr << \"output switched on z compression\" << std::endl;\n"
-   "         MY(xcmp) = new xstream::z::ostreambuf(m_ostr.rdbuf());\n"
+   "         MY(xcmp) = new xstream::z::ostreambuf(m_sink);\n"
    "         MY(ostr)->rdbuf(MY(xcmp));\n"
    "      }\n"
    "      else if (newcmp == k_bz2_compression) {\n"
    "         //std::cerr << \"output switched on bz2 compression\" << std::endl;\n"
-   "         MY(xcmp )= new xstream::bz::ostreambuf(m_ostr.rdbuf());\n"
+   "         MY(xcmp )= new xstream::bz::ostreambuf(m_sink);\n"
    "         MY(ostr)->rdbuf(MY(xcmp));\n"
    "      }\n"
    "      else if (newcmp != k_no_compression) {\n"
@@ -1964,10 +4195,47 @@ int main(int argC, char* argV[])
    "   }\n"
    "}\n"
    "\n"
-   "chromosome istream::synthesize(const std::string &src, size_t p_src,\n"
-   "                               const std::string &ref, size_t p_ref)\n"
+   "// Streams reading files with the same header share one decoding tree.\n"
+   "// Only the most recently used few are kept; a stream still reading with\n"
+   "// an evicted tree holds on to it through its own shared_ptr.\n"
+   "static const size_t k_genome_cache_size = 8;\n"
+   "static std::list<std::pair<std::string, std::shared_ptr<const codon> > >\n"
+   "       genome_cache;\n"
+   "static pthread_mutex_t genome_cache_mutex = PTHREAD_MUTEX_INITIALIZER;\n"
+   "\n"
+   "std::shared_ptr<const codon> istream::lookup_genome()\n"
+   "{\n"
+   "   std::shared_ptr<const codon> result;\n"
+   "   pthread_mutex_lock(&genome_cache_mutex);\n"
+   "   for (auto it = genome_cache.begin(); it != genome_cache.end(); ++it) {\n"
+   "      if (it->first == m_documentString) {\n"
+   "         genome_cache.splice(genome_cache.begin(), genome_cache, it);\n"
+   "         result = it->second;\n"
+   "         pthread_mutex_unlock(&genome_cache_mutex);\n"
+   "         return result;\n"
+   "      }\n"
+   "   }\n"
+   "   try {\n"
+   "      codon *gene = new codon();\n"
+   "      result.reset(gene);\n"
+   "      gene->m_tagname = \"HDDM\";\n"
+   "      synthesize(*gene,m_documentString,0,HDDM::DocumentString(),0);\n"
+   "      genome_cache.emplace_front(m_documentString, result);\n"
+   "   }\n"
+   "   catch (...) {\n"
+   "      pthread_mutex_unlock(&genome_cache_mutex);\n"
+   "      throw;\n"
+   "   }\n"
+   "   if (genome_cache.size() > k_genome_cache_size) {\n"
+   "      genome_cache.pop_back();\n"
+   "   }\n"
+   "   pthread_mutex_unlock(&genome_cache_mutex);\n"
+   "   return result;\n"
+   "}\n"
+   "\n"
+   "void istream::synthesize(codon &gene, const std::string &src, size_t p_src,\n"
+   "                         const std::string &ref, size_t p_ref)\n"
    "{\n"
-   "   chromosome chrom;\n"
    "   int slevel, rlevel;\n"
    "   std::string stag, rtag;\n"
    "   p_src = getTag(src,p_src,stag,slevel);\n"
@@ -1980,15 +4248,17 @@ int main(int argC, char* argV[])
    "   }\n"
    "   else if (!tags_match(stag,rtag)) {\n"
    "      collide(stag,rtag);\n"
-   "      return chrom;\n"
+   "      return;\n"
    "   }\n"
    "\n"
    "   size_t p2_src, p2_ref;\n"
    "   int s2level, r2level;\n"
    "   std::string s2tag, r2tag;\n"
+   "   bool identity = true;\n"
    "   getTag(src,p2_src=p_src,s2tag,s2level);\n"
    "   while (s2level > slevel) {\n"
-   "      codon *gene = new codon();\n"
+   "      gene.m_sequence.push_back(codon());\n"
+   "      codon &child = gene.m_sequence.back();\n"
    "      std::string s2tagname = s2tag.substr(1,s2tag.find(\" \")-1);\n"
    "      getTag(ref,p2_ref=p_ref,r2tag,r2level);\n"
    "      int order_of_this_tag_in_ref = 1;\n"
@@ -2000,22 +4270,32 @@ int main(int argC, char* argV[])
    "               break;\n"
    "            }\n"
    "            else {\n"
-   "               gene->m_order = order_of_this_tag_in_ref;\n"
+   "               child.m_order = order_of_this_tag_in_ref;\n"
    "            }\n"
-   "            gene->m_sequence = synthesize(src,p2_src,ref,p2_ref);\n"
+   "            synthesize(child,src,p2_src,ref,p2_ref);\n"
    "            break;\n"
    "         }\n"
    "         p2_ref = getEndTag(ref,p2_ref,r2tag);\n"
    "         getTag(ref,p2_ref,r2tag,r2level);\n"
    "         ++order_of_this_tag_in_ref;\n"
    "      }\n"
-   "      gene->m_tagname = s2tagname;\n"
-   "      chrom.push_back(*gene);\n"
-   "      delete gene;\n"
+   "      child.m_tagname = s2tagname;\n"
+   "      identity &= (child.m_identity &&\n"
+   "                   child.m_order == int(gene.m_sequence.size()));\n"
    "      p2_src = getEndTag(src,p2_src,s2tag);\n"
    "      getTag(src,p2_src,s2tag,s2level);\n"
    "   }\n"
-   "   return chrom;\n"
+   "\n"
+   "   // the subtree is an identity only if the library also has\n"
+   "   // no children beyond the ones found in the input file\n"
+   "   size_t children = 0;\n"
+   "   getTag(ref,p2_ref=p_ref,r2tag,r2level);\n"
+   "   while (r2level > rlevel) {\n"
+   "      ++children;\n"
+   "      p2_ref = getEndTag(ref,p2_ref,r2tag);\n"
+   "      getTag(ref,p2_ref,r2tag,r2level);\n"
+   "   }\n"
+   "   gene.m_identity = identity && (children == gene.m_sequence.size());\n"
    "}\n"
    "\n"
    "#ifdef HDF5_SUPPORT\n"
@@ -2114,6 +4394,166 @@ int CodeBuilder::element_in_list(XtString &name, parentList_t list)
    return -1;
 }
 
+/* Return a typed expression that reaches the nearest ancestor of tag
+ * that owns attribute attr directly through the m_parent links, or an
+ * empty string if the tag or any of its ancestors occurs in more than
+ * one place in the document, so the ancestor types are not fixed.
+ */
+XtString CodeBuilder::ancestorPath(XtString &tagS, XtString &attrS)
+{
+   if (contexts[tagS] != 1)
+   {
+      return "";
+   }
+   parentList_t &plist = parents[tagS];
+   for (size_t n = 0; n < plist.size(); ++n)
+   {
+      XtString hostS(((DOMElement*)plist[n])->getTagName());
+      if (contexts[hostS] != 1)
+      {
+         return "";
+      }
+   }
+   for (size_t n = plist.size(); n > 0; --n)
+   {
+      DOMElement *hostEl = (DOMElement*)plist[n-1];
+      XtString hostS(hostEl->getTagName());
+      if (XtString(hostEl->getAttribute(X(attrS))).size() > 0)
+      {
+         std::stringstream pathS;
+         pathS << "static_cast<const " << hostS.simpleType()
+               << "*>(ancestor(" << plist.size() - n + 1 << "))->";
+         return pathS.str();
+      }
+   }
+   return "";
+}
+
+/* Collect the names of all attributes that appear anywhere in the
+ * document and write out the attr_id enum, together with a perfect
+ * hash table that maps attribute names to ids without any string
+ * comparisons beyond the one needed to confirm the match.
+ */
+void CodeBuilder::constructAttributeIDs(DOMElement* el)
+{
+   XtString tagS(el->getTagName());
+   DOMNamedNodeMap *myAttr = el->getAttributes();
+   for (unsigned int n = 0; n < myAttr->getLength(); n++)
+   {
+      XtString attrS(myAttr->item(n)->getNodeName());
+      if (attrS == "unknown")
+      {
+         std::cerr
+              << "hddm-cpp error: attribute name \"unknown\" in tag "
+              << "\"" << tagS << "\" is reserved, please rename it."
+              << std::endl;
+         exit(1);
+      }
+      if (std::find(attrNames.begin(), attrNames.end(), attrS) == attrNames.end())
+      {
+         attrNames.push_back(attrS);
+      }
+   }
+   DOMNodeList* contList = el->getChildNodes();
+   size_t contLength = contList->getLength();
+   for (size_t c = 0; c < contLength; c++)
+   {
+      DOMNode* cont = contList->item(c);
+      if (cont->getNodeType() == DOMNode::ELEMENT_NODE)
+      {
+         constructAttributeIDs((DOMElement*)cont);
+      }
+   }
+   if (tagS != "HDDM")
+   {
+      return;
+   }
+
+   // search for a seed that maps every name to its own slot
+   unsigned int slots = 4;
+   while (slots < attrNames.size() * 2)
+   {
+      slots *= 2;
+   }
+   uint32_t seed = 2166136261U;
+   std::vector<int> table;
+   for (int trial = 0; ; ++trial)
+   {
+      if (trial == 10000)
+      {
+         slots *= 2;
+         trial = 0;
+      }
+      seed = 2166136261U + trial;
+      table.assign(slots, 0);
+      size_t n;
+      for (n = 0; n < attrNames.size(); ++n)
+      {
+         uint32_t hash = seed;
+         for (size_t i = 0; i < attrNames[n].size(); ++i)
+         {
+            hash ^= (unsigned char)attrNames[n][i];
+            hash *= 16777619U;
+         }
+         if (table[hash & (slots - 1)] != 0)
+         {
+            break;
+         }
+         table[hash & (slots - 1)] = n + 1;
+      }
+      if (n == attrNames.size())
+      {
+         break;
+      }
+   }
+
+   hFile << "enum attr_id {" << std::endl
+         << "   k_attr_unknown";
+   for (size_t n = 0; n < attrNames.size(); ++n)
+   {
+      hFile << "," << std::endl << "   k_attr_" << attrNames[n];
+   }
+   hFile << std::endl << "};" << std::endl
+         << std::endl
+         << "const int k_attr_count = " << attrNames.size() + 1 << ";"
+         << std::endl
+         << "const int k_attr_hash_slots = " << slots << ";" << std::endl
+         << "const uint32_t k_attr_hash_seed = " << seed << "U;" << std::endl
+         << std::endl
+         << "inline const char *attributeName(attr_id id) {" << std::endl
+         << "   static const char *names[k_attr_count] = {" << std::endl
+         << "      \"\"";
+   for (size_t n = 0; n < attrNames.size(); ++n)
+   {
+      hFile << "," << std::endl << "      \"" << attrNames[n] << "\"";
+   }
+   hFile << std::endl << "   };" << std::endl
+         << "   return (id > 0 && id < k_attr_count)? names[id] : \"\";"
+         << std::endl
+         << "}" << std::endl
+         << std::endl
+         << "inline attr_id lookupAttribute(const std::string &name) {"
+         << std::endl
+         << "   static const attr_id slots[k_attr_hash_slots] = {";
+   for (size_t n = 0; n < slots; ++n)
+   {
+      hFile << ((n > 0)? "," : "") << std::endl << "      "
+            << ((table[n] > 0)? "k_attr_" + attrNames[table[n] - 1] :
+                                std::string("k_attr_unknown"));
+   }
+   hFile << std::endl << "   };" << std::endl
+         << "   uint32_t hash = k_attr_hash_seed;" << std::endl
+         << "   for (size_t i=0; i < name.size(); ++i) {" << std::endl
+         << "      hash ^= (unsigned char)name[i];" << std::endl
+         << "      hash *= 16777619U;" << std::endl
+         << "   }" << std::endl
+         << "   attr_id id = slots[hash & (k_attr_hash_slots - 1)];" << std::endl
+         << "   return (name == attributeName(id))? id : k_attr_unknown;"
+         << std::endl
+         << "}" << std::endl
+         << std::endl;
+}
+
 /* Verify that the tag group under this element does not collide
  * with existing tag group elref, otherwise exit with fatal error
  */
@@ -2231,7 +4671,12 @@ void CodeBuilder::writeClassdef(DOMElement* el)
          << ": public HDDM_Element {" << std::endl
          << " public:" << std::endl;
    if (tagS == "HDDM") {
-      hFile << "   HDDM();" << std::endl;
+      hFile << "   HDDM();" << std::endl
+            << "   HDDM(const HDDM &src);" << std::endl
+            << "   HDDM(HDDM &&src);" << std::endl
+            << "   HDDM &operator=(const HDDM &src);" << std::endl
+            << "   HDDM &operator=(HDDM &&src);" << std::endl
+            << "   HDDM *clone() const;" << std::endl;
    }
    hFile << "   ~" << tagS.simpleType() << "();" << std::endl;
    hFile << "   void clear();" << std::endl;
@@ -2435,10 +4880,15 @@ void CodeBuilder::writeClassdef(DOMElement* el)
             << "(int count=-1, int start=0);" << std::endl;
    }
 
-   hFile << "   const void *getAttribute(const std::string &name,"
+   hFile << "   using HDDM_Element::getAttribute;\n"
+         << "   const void *getAttribute(attr_id id,"
          << " hddm_type *atype=0) const;\n"
          << "   std::string toString(int indent=0);\n"
-         << "   std::string toXML(int indent=0);\n";
+         << "   std::string toXML(int indent=0);\n"
+         << "   using HDDM_Element::writeString;\n"
+         << "   using HDDM_Element::writeXML;\n"
+         << "   void writeString(buffersink &ostr, int indent=0);\n"
+         << "   void writeXML(buffersink &ostr, int indent=0);\n";
 
    if (tagS == "HDDM")
    {
@@ -2468,17 +4918,48 @@ void CodeBuilder::writeClassdef(DOMElement* el)
             << tagS.simpleType() << ">;" << std::endl
             << "   " << tagS.simpleType() << "() {}" << std::endl
             << "   " << tagS.simpleType() 
-            << "(HDDM_Element *parent, int owner=0);" << std::endl;
+            << "(HDDM_Element *parent, int owner=0);" << std::endl
+            << "   " << tagS.simpleType() << "(const "
+            << tagS.simpleType() << " &src) = delete;" << std::endl
+            << "   " << tagS.simpleType() << " &operator=(const "
+            << tagS.simpleType() << " &src) = delete;" << std::endl;
+      if (compactLayout)
+      {
+         hFile << "   static void *operator new(size_t size) {" << std::endl
+               << "      return elementpool<" << tagS.simpleType()
+               << ">::allocate(size);" << std::endl
+               << "   }" << std::endl
+               << "   static void operator delete(void *ptr, size_t size) {"
+               << std::endl
+               << "      elementpool<" << tagS.simpleType()
+               << ">::release(ptr, size);" << std::endl
+               << "   }" << std::endl;
+      }
       hFile << " private:" << std::endl;
    }
 
    hFile << "   void streamer(istream &istr);" << std::endl
-         << "   void streamer(ostream &ostr);" << std::endl;
+         << "   void streamer(ostream &ostr);" << std::endl
+         << "   void assign(const " << tagS.simpleType() << " &src);"
+         << std::endl;
+   if (tagS != "HDDM")
+   {
+      hFile << "   void rehost(HDDM *host);" << std::endl;
+   }
 
+   // In compact mode the data members are grouped by alignment so that
+   // the 4-byte and 1-byte members pack into the tail of HDDM_Element,
+   // booleans take one byte, and the char* shadows of the string members
+   // that only the HDF5 interface needs are left out of non-HDF5 builds.
+   for (int group = 0; group < 3; ++group)
    for (unsigned int n = 0; n < myAttr->getLength(); n++)
    {
       XtString attrS(myAttr->item(n)->getNodeName());
       XtString typeS(el->getAttribute(X(attrS)));
+      if (memberGroup(typeS) != group)
+      {
+         continue;
+      }
       if (typeS == "int")
       {
          hFile << "   int m_" << attrS << ";" << std::endl;
@@ -2497,17 +4978,22 @@ void CodeBuilder::writeClassdef(DOMElement* el)
       }
       else if (typeS == "boolean")
       {
-         hFile << "   int m_" << attrS << ";" << std::endl;
-      }
-      else if (typeS == "string")
-      {
-         hFile << "   std::string m_" << attrS << ";" << std::endl;
-         hFile << "   const char *mx_" << attrS << ";" << std::endl;
+         hFile << "   " << ((compactLayout)? "bool" : "int")
+               << " m_" << attrS << ";" << std::endl;
       }
-      else if (typeS == "anyURI")
+      else if (typeS == "string" || typeS == "anyURI")
       {
          hFile << "   std::string m_" << attrS << ";" << std::endl;
-         hFile << "   const char *mx_" << attrS << ";" << std::endl;
+         if (compactLayout)
+         {
+            hFile << "#ifdef HDF5_SUPPORT" << std::endl
+                   << "   const char *mx_" << attrS << ";" << std::endl
+                   << "#endif" << std::endl;
+         }
+         else
+         {
+            hFile << "   const char *mx_" << attrS << ";" << std::endl;
+         }
       }
       else if (typeS == "Particle_t")
       {
@@ -2637,6 +5123,7 @@ void CodeBuilder::constructGroup(DOMElement* el)
    parentList_t::iterator piter;
    parents[tagS].insert(parents[tagS].begin(),
                         parentList.begin(),parentList.end());
+   ++contexts[tagS];
    std::vector<DOMElement*>::iterator iter;
    for (iter = tagList.begin(); iter != tagList.end(); iter++)
    {
@@ -2697,11 +5184,16 @@ void CodeBuilder::writeClassimp(DOMElement* el)
             << " : HDDM_Element(parent, owner)";
    }
    DOMNamedNodeMap *myAttr = el->getAttributes();
+   for (int group = 0; group < 3; ++group)
    for (unsigned int n = 0; n < myAttr->getLength(); n++)
    {
       XtString attrS(myAttr->item(n)->getNodeName());
       XtString typeS(el->getAttribute(X(attrS)));
-      if (typeS == "int")
+      if (memberGroup(typeS) != group)
+      {
+         continue;
+      }
+      else if (typeS == "int")
       {
          hFile << "," << std::endl << "   m_" << attrS << "(0)";
       }
@@ -2794,30 +5286,129 @@ void CodeBuilder::writeClassimp(DOMElement* el)
    }
    else
    {
-      hFile << std::endl << "{}" << std::endl << std::endl;
-   }
-
-   hFile << "inline " << tagS.simpleType() << "::~"
-         << tagS.simpleType() << "() {" << std::endl
-         << "   clear();" << std::endl
-         << "}" << std::endl;
-   if (tagS != "HDDM")
-   {
-      hFile << "inline void " << tagS.simpleType() 
-            << "::clear() {";
-      if (children[tagS].size() > 0) {
-         hFile << std::endl
-               << "   if (m_host != 0) {" << std::endl;
-         for (citer = children[tagS].begin();
-              citer != children[tagS].end();
-              ++citer)
-         {
-            DOMElement *childEl = (DOMElement*)(*citer);
-            XtString cnameS(childEl->getTagName());
-            hFile << "   delete" << cnameS.plural().simpleType()
-                  << "();" << std::endl;
-         }
-         hFile << "   }" << std::endl;
+      hFile << std::endl << "{}" << std::endl << std::endl;
+   }
+
+   hFile << "inline " << tagS.simpleType() << "::~"
+         << tagS.simpleType() << "() {" << std::endl
+         << "   clear();" << std::endl
+         << "}" << std::endl;
+   if (tagS != "HDDM")
+   {
+      hFile << "inline void " << tagS.simpleType() 
+            << "::clear() {";
+      if (children[tagS].size() > 0) {
+         hFile << std::endl
+               << "   if (m_host != 0) {" << std::endl;
+         for (citer = children[tagS].begin();
+              citer != children[tagS].end();
+              ++citer)
+         {
+            DOMElement *childEl = (DOMElement*)(*citer);
+            XtString cnameS(childEl->getTagName());
+            hFile << "   delete" << cnameS.plural().simpleType()
+                  << "();" << std::endl;
+         }
+         hFile << "   }" << std::endl;
+      }
+      hFile << "}" << std::endl << std::endl;
+   }
+
+   hFile << "inline void " << tagS.simpleType() << "::assign(const "
+         << tagS.simpleType() << " &src) {" << std::endl;
+   myAttr = el->getAttributes();
+   for (unsigned int n = 0; n < myAttr->getLength(); n++)
+   {
+      XtString attrS(myAttr->item(n)->getNodeName());
+      XtString typeS(el->getAttribute(X(attrS)));
+      if (typeS == "int" || typeS == "long" || typeS == "float" ||
+          typeS == "double" || typeS == "boolean" || typeS == "string" ||
+          typeS == "anyURI" || typeS == "Particle_t")
+      {
+         hFile << "   m_" << attrS << " = src.m_" << attrS << ";" << std::endl;
+      }
+   }
+   for (citer = children[tagS].begin();
+        citer != children[tagS].end();
+        ++citer)
+   {
+      DOMElement *childEl = (DOMElement*)(*citer);
+      XtString cnameS(childEl->getTagName());
+      XtString repS(childEl->getAttribute(X("maxOccurs")));
+      int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
+      XtString listS("m_" + cnameS + ((rep > 1)? "_list" : "_link"));
+      hFile << "   " << listS << ".assign(src." << listS << ");" << std::endl;
+   }
+   hFile << "}" << std::endl << std::endl;
+
+   if (tagS == "HDDM")
+   {
+      hFile << "inline HDDM::HDDM(const HDDM &src)" << std::endl
+            << " : HDDM()" << std::endl
+            << "{" << std::endl
+            << "   assign(src);" << std::endl
+            << "}" << std::endl << std::endl
+            << "inline HDDM::HDDM(HDDM &&src)" << std::endl
+            << " : HDDM()" << std::endl
+            << "{" << std::endl;
+      for (citer = children[tagS].begin();
+           citer != children[tagS].end();
+           ++citer)
+      {
+         DOMElement *childEl = (DOMElement*)(*citer);
+         XtString cnameS(childEl->getTagName());
+         XtString repS(childEl->getAttribute(X("maxOccurs")));
+         int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
+         XtString listS("m_" + cnameS + ((rep > 1)? "_list" : "_link"));
+         hFile << "   " << listS << ".splice(src." << listS << ");"
+               << std::endl;
+      }
+      hFile << "}" << std::endl << std::endl
+            << "inline HDDM &HDDM::operator=(const HDDM &src) {" << std::endl
+            << "   if (this != &src) {" << std::endl
+            << "      clear();" << std::endl
+            << "      assign(src);" << std::endl
+            << "   }" << std::endl
+            << "   return *this;" << std::endl
+            << "}" << std::endl << std::endl
+            << "inline HDDM &HDDM::operator=(HDDM &&src) {" << std::endl
+            << "   if (this != &src) {" << std::endl
+            << "      clear();" << std::endl;
+      for (citer = children[tagS].begin();
+           citer != children[tagS].end();
+           ++citer)
+      {
+         DOMElement *childEl = (DOMElement*)(*citer);
+         XtString cnameS(childEl->getTagName());
+         XtString repS(childEl->getAttribute(X("maxOccurs")));
+         int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
+         XtString listS("m_" + cnameS + ((rep > 1)? "_list" : "_link"));
+         hFile << "      " << listS << ".splice(src." << listS << ");"
+               << std::endl;
+      }
+      hFile << "   }" << std::endl
+            << "   return *this;" << std::endl
+            << "}" << std::endl << std::endl
+            << "inline HDDM *HDDM::clone() const {" << std::endl
+            << "   return new HDDM(*this);" << std::endl
+            << "}" << std::endl << std::endl;
+   }
+   else
+   {
+      hFile << "inline void " << tagS.simpleType()
+            << "::rehost(HDDM *host) {" << std::endl
+            << "   m_host = host;" << std::endl;
+      for (citer = children[tagS].begin();
+           citer != children[tagS].end();
+           ++citer)
+      {
+         DOMElement *childEl = (DOMElement*)(*citer);
+         XtString cnameS(childEl->getTagName());
+         XtString repS(childEl->getAttribute(X("maxOccurs")));
+         int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
+         XtString listS("m_" + cnameS + ((rep > 1)? "_list" : "_link"));
+         hFile << "   " << listS << ".rehost(host, &host->m_" << cnameS
+               << "_plist);" << std::endl;
       }
       hFile << "}" << std::endl << std::endl;
    }
@@ -2845,124 +5436,140 @@ void CodeBuilder::writeClassimp(DOMElement* el)
          XtString typeS(hostEl->getAttribute(X(attrS)));
          attrList[attrS] = typeS;
          XtString getS("get" + attrS.simpleType());
+         XtString pathS(ancestorPath(tagS, attrS));
          if (typeS == "int")
          {
             hFile << "inline int " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(int*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(int*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (typeS == "long")
          {
             hFile << "inline int64_t " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(int64_t*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(int64_t*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (typeS == "float")
          {
             hFile << "inline float " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(float*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(float*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (typeS == "double")
          {
             hFile << "inline double " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(double*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(double*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (typeS == "boolean")
          {
             hFile << "inline bool " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(bool*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(bool*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (typeS == "string")
          {
             hFile << "inline std::string " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(const std::string*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(const std::string*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (typeS == "anyURI")
          {
             hFile << "inline std::string " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(const std::string*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(const std::string*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (typeS == "Particle_t")
          {
             hFile << "inline Particle_t " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(Particle_t*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(Particle_t*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (guessType(typeS) == "int")
          {
             hFile << "inline int " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(int*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(int*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (guessType(typeS) == "long")
          {
             hFile << "inline int64_t " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(long long int*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(long long int*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (guessType(typeS) == "float")
          {
             hFile << "inline float " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(float*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(float*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (guessType(typeS) == "double")
          {
             hFile << "inline double " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(double*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(double*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (guessType(typeS) == "boolean")
          {
             hFile << "inline bool " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(bool*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(bool*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else if (guessType(typeS) == "Particle_t")
          {
             hFile << "inline Particle_t " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(Particle_t*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(Particle_t*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
          else /* any attributes not of the above types are strings */
          {
             hFile << "inline std::string " << tagS.simpleType()
                   << "::" << getS << "() const {" << std::endl
-                  << "   return *(std::string*)m_parent->getAttribute(\""
-                  << attrS << "\");" << std::endl
+                  << "   return " << ((pathS.size())? pathS + getS + "()" :
+                        "*(std::string*)m_parent->getAttribute(k_attr_" + attrS + ")")
+                  << ";" << std::endl
                   << "}" << std::endl << std::endl;
          }
       }
@@ -3143,14 +5750,14 @@ void CodeBuilder::writeClassimp(DOMElement* el)
             << "}" << std::endl << std::endl;
    }
    hFile << "inline const void *" << tagS.simpleType()
-         << "::getAttribute(const std::string &name,\n"
-         << "                                                   "
-         << "hddm_type *atype) const {" << std::endl;
+         << "::getAttribute(attr_id id, hddm_type *atype) const {"
+         << std::endl
+         << "   switch (id) {" << std::endl;
    for (unsigned int n = 0; n < myAttr->getLength(); n++)
    {
       XtString attrS(myAttr->item(n)->getNodeName());
       XtString typeS(el->getAttribute(X(attrS)));
-      hFile << "   if (name == \"" << attrS << "\") {\n"
+      hFile << "    case k_attr_" << attrS << ": {\n"
             << "      if (atype != 0)\n";
       if (typeS == "int")
       {
@@ -3227,11 +5834,14 @@ void CodeBuilder::writeClassimp(DOMElement* el)
                << " = get" << attrS.simpleType() << "();\n";
       }
       hFile << "      return &m_" << attrS << ";\n"
-            << "   }\n";
+            << "    }\n";
    }
+   hFile << "    default:\n"
+         << "      break;\n"
+         << "   }\n";
    if (tagS != "HDDM")
    {
-      hFile << "   return m_parent->getAttribute(name, atype);" << std::endl;
+      hFile << "   return m_parent->getAttribute(id, atype);" << std::endl;
    }
    else
    {
@@ -3241,10 +5851,22 @@ void CodeBuilder::writeClassimp(DOMElement* el)
 
    cFile << "std::string " << tagS.simpleType()
          << "::toString(int indent) {\n"
-         << "   std::stringstream ostr;\n"
-         << "   for (int n=0; n < indent; ++n)\n"
-         << "      ostr << \" \";\n"
-         << "   ostr << \"" << tagS << "\"\n";
+         << "   buffersink sink;\n"
+         << "   writeString(sink, indent);\n"
+         << "   return sink.str();\n"
+         << "}" << std::endl << std::endl;
+
+   cFile << "std::string " << tagS.simpleType()
+         << "::toXML(int indent) {\n"
+         << "   buffersink sink;\n"
+         << "   writeXML(sink, indent);\n"
+         << "   return sink.str();\n"
+         << "}" << std::endl << std::endl;
+
+   cFile << "void " << tagS.simpleType()
+         << "::writeString(buffersink &ostr, int indent) {\n"
+         << "   ostr.indent(indent);\n"
+         << "   ostr << \"" << tagS << "\"";
    for (unsigned int n = 0; n < myAttr->getLength(); n++)
    {
       XtString attrS(myAttr->item(n)->getNodeName());
@@ -3252,67 +5874,41 @@ void CodeBuilder::writeClassimp(DOMElement* el)
       if (typeS == "int" || typeS == "long" || 
           typeS == "float" || typeS == "double")
       {
-	     cFile << "        << \" " << attrS << "=\" << "
-               << "m_" << attrS << std::endl;
+	     cFile << std::endl << "        << \" " << attrS << "=\" << "
+               << "m_" << attrS;
       }
       else if (typeS == "boolean")
       {
-	     cFile << "        << \" " << attrS << "=\" << "
-               << "((m_" << attrS << " == 0)? \"true\" : \"false\")"
-               << std::endl;
+	     cFile << std::endl << "        << \" " << attrS << "=\" << "
+               << "((m_" << attrS << " == 0)? \"true\" : \"false\")";
       }
       else if (typeS == "string" || typeS == "anyURI")
       {
-	     cFile << "        << \" " << attrS << "=\" << "
-               << "\"\\\"\" << m_" << attrS << " << \"\\\"\"" << std::endl;
+	     cFile << std::endl << "        << \" " << attrS << "=\" << "
+               << "'\"' << m_" << attrS << " << '\"'";
       }
       else if (typeS == "Particle_t")
       {
-	     cFile << "        << \" " << attrS << "=\" << "
-               << "ParticleType((Particle_t)m_" << attrS << ")" << std::endl;
+	     cFile << std::endl << "        << \" " << attrS << "=\" << "
+               << "ParticleType((Particle_t)m_" << attrS << ")";
       }
    }
-   cFile << "             << std::endl;" << std::endl;
+   cFile << std::endl << "        << '\\n';" << std::endl;
    for (citer = children[tagS].begin(); citer != children[tagS].end(); ++citer)
    {
       DOMElement *childEl = (DOMElement*)(*citer);
       XtString cnameS(childEl->getTagName());
       XtString repS(childEl->getAttribute(X("maxOccurs")));
       int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
-      if (rep > 1)
-      {
-         cFile << "   int " << cnameS.listType() << "Count=0;" << std::endl
-               << "   for (" << cnameS.listType() << "::iterator it = "
-               << "m_" << cnameS << "_list.begin();" << std::endl
-               << "        it != "
-               << "m_" << cnameS << "_list.end(); ++it)" << std::endl
-               << "   {" << std::endl
-               << "      if (++" << cnameS.listType() << "Count > "
-               << "m_" << cnameS << "_list.size()) {" << std::endl
-               << "         throw std::runtime_error(\"hddm_" 
-                            << classPrefix << "::toString error - "
-                           "list improperly terminated!\");" << std::endl
-               << "      }" << std::endl
-               << "      ostr << it->toString(indent + 2);" << std::endl
-               << "   }" << std::endl;
-      }
-      else
-      {
-         cFile << "   if (! m_" << cnameS << "_link.empty()) {\n"
-               << "      ostr << m_" << cnameS << "_link.begin()"
-               << "->toString(indent + 2);\n"
-               << "   }" << std::endl;
-      }
+      cFile << "   m_" << cnameS << ((rep > 1)? "_list" : "_link")
+            << ".writeString(ostr, indent + 2);" << std::endl;
    }
-   cFile << "   return ostr.str();" << std::endl
-         << "}" << std::endl << std::endl;
+   cFile << "}" << std::endl << std::endl;
 
-   cFile << "std::string " << tagS.simpleType()
-         << "::toXML(int indent) {\n"
-         << "   std::stringstream ostr;\n"
-         << "   for (int n=0; n < indent; ++n)\n"
-         << "      ostr << \" \";\n"
-         << "   ostr << \"<" << tagS << "\"\n";
+   cFile << "void " << tagS.simpleType()
+         << "::writeXML(buffersink &ostr, int indent) {\n"
+         << "   ostr.indent(indent);\n"
+         << "   ostr << \"<" << tagS << "\"";
    for (unsigned int n = 0; n < myAttr->getLength(); n++)
    {
       XtString attrS(myAttr->item(n)->getNodeName());
@@ -3323,30 +5919,27 @@ void CodeBuilder::writeClassimp(DOMElement* el)
       }
       if (typeS == "boolean")
       {
-	     cFile << "        << \" " << attrS << "=\" << "
-               << "((m_" << attrS << " == 0)? \"\\\"true\\\"\" : \"\\\"false\\\"\")"
-               << std::endl;
+	     cFile << std::endl << "        << \" " << attrS << "=\" << "
+               << "((m_" << attrS << " == 0)? \"\\\"true\\\"\" : \"\\\"false\\\"\")";
       }
       else if (typeS == "Particle_t")
       {
-	     cFile << "        << \" " << attrS << "=\\\"\" << "
-               << "ParticleType((Particle_t)m_" << attrS << ") << \"\\\"\""
-               << std::endl;
+	     cFile << std::endl << "        << \" " << attrS << "=\\\"\" << "
+               << "ParticleType((Particle_t)m_" << attrS << ") << '\"'";
       }
       else
       {
-	     cFile << "        << \" " << attrS << "=\" << "
-               << "\"\\\"\" << get" << attrS.simpleType() 
-               << "() << \"\\\"\"" << std::endl;
+	     cFile << std::endl << "        << \" " << attrS << "=\\\"\" << "
+               << "get" << attrS.simpleType() << "() << '\"'";
       }
    }
    if (children[tagS].size() > 0)
    {
-       cFile << "        << \">\" << std::endl;" << std::endl;
+       cFile << std::endl << "        << \">\\n\";" << std::endl;
    }
    else
    {
-       cFile << "        << \" />\" << std::endl;" << std::endl;
+       cFile << std::endl << "        << \" />\\n\";" << std::endl;
    }
    for (citer = children[tagS].begin(); citer != children[tagS].end(); ++citer)
    {
@@ -3354,40 +5947,15 @@ void CodeBuilder::writeClassimp(DOMElement* el)
       XtString cnameS(childEl->getTagName());
       XtString repS(childEl->getAttribute(X("maxOccurs")));
       int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
-      if (rep > 1)
-      {
-         cFile << "   int " << cnameS.listType() << "Count=0;" << std::endl
-               << "   for (" << cnameS.listType() << "::iterator it = "
-               << "m_" << cnameS << "_list.begin();" << std::endl
-               << "        it != "
-               << "m_" << cnameS << "_list.end(); ++it)" << std::endl
-               << "   {" << std::endl
-               << "      if (++" << cnameS.listType() << "Count > "
-               << "m_" << cnameS << "_list.size()) {" << std::endl
-               << "         throw std::runtime_error(\"hddm_" 
-                            << classPrefix << "::toXML error - "
-                            "list improperly terminated!\");" << std::endl
-               << "      }" << std::endl
-               << "      ostr << it->toXML(indent + 2);" << std::endl
-               << "   }" << std::endl;
-      }
-      else
-      {
-         cFile << "   if (! m_" << cnameS << "_link.empty()) {\n"
-               << "      ostr << m_" << cnameS << "_link.begin()"
-               << "->toXML(indent + 2);" << std::endl
-               << "   }" << std::endl;
-      }
+      cFile << "   m_" << cnameS << ((rep > 1)? "_list" : "_link")
+            << ".writeXML(ostr, indent + 2);" << std::endl;
    }
    if (children[tagS].size() > 0)
    {
-      cFile << "   for (int n=0; n < indent; ++n)\n"
-            << "      ostr << \" \";\n"
-            << "   ostr << \"</" << tagS << ">\"\n"
-            << "        << std::endl;" << std::endl;
+      cFile << "   ostr.indent(indent);\n"
+            << "   ostr << \"</" << tagS << ">\\n\";" << std::endl;
    }
-   cFile << "   return ostr.str();" << std::endl
-         << "}" << std::endl << std::endl;
+   cFile << "}" << std::endl << std::endl;
 
    cFile << "#ifdef HDF5_SUPPORT" << std::endl
          << "hid_t " << tagS.simpleType()
@@ -3445,7 +6013,9 @@ void CodeBuilder::writeClassimp(DOMElement* el)
          {
             cFile << "   H5Tinsert(tid, \"" << attrS << "\", "
                   << "(char*)&m_" << attrS << " - (char*)this, "
-                  << "((inmemory)? H5T_NATIVE_INT : H5T_STD_I32LE));"
+                  << "((inmemory)? "
+                  << ((compactLayout)? "H5T_NATIVE_UCHAR" : "H5T_NATIVE_INT")
+                  << " : H5T_STD_I32LE));"
                   << std::endl;
          }
          else if (typeS == "string")
@@ -4229,6 +6799,7 @@ void CodeBuilder::writeStreamers(DOMElement* el)
    XtString tagS(el->getTagName());
 
    std::vector<XtString> attrV;
+   std::vector<XtString> boolV;
    DOMNamedNodeMap *myAttr = el->getAttributes();
    for (unsigned int n = 0; n < myAttr->getLength(); n++)
    {
@@ -4240,6 +6811,10 @@ void CodeBuilder::writeStreamers(DOMElement* el)
       {
          attrV.push_back(attrS);
       }
+      if (typeS == "boolean" && compactLayout)
+      {
+         boolV.push_back(attrS);
+      }
    }
 
    std::vector<XtString> contV;
@@ -4258,16 +6833,28 @@ void CodeBuilder::writeStreamers(DOMElement* el)
       }
    }
 
+   // compact booleans are one byte in memory but 32 bits on the wire
    hFile << "inline void " << tagS.simpleType() << "::streamer"
          << "(istream &istr) {" << std::endl;
+   for (unsigned int n=0; n < boolV.size(); ++n)
+   {
+      hFile << "   int32_t b_" << boolV[n] << ";" << std::endl;
+   }
    if (attrV.size()) {
       hFile << "   *istr.getXDRistream()";
       for (unsigned int n=0; n < attrV.size(); ++n)
       {
-         hFile << " >> m_" << attrV[n];
+         bool packed = (std::find(boolV.begin(), boolV.end(), attrV[n])
+                        != boolV.end());
+         hFile << " >> " << ((packed)? "b_" : "m_") << attrV[n];
       }
       hFile << ";" << std::endl;
    }
+   for (unsigned int n=0; n < boolV.size(); ++n)
+   {
+      hFile << "   m_" << boolV[n] << " = (b_" << boolV[n] << " != 0);"
+            << std::endl;
+   }
    if (contV.size()) {
       hFile << "   istr";
       for (unsigned int n=0; n < contV.size(); ++n)
@@ -4284,7 +6871,9 @@ void CodeBuilder::writeStreamers(DOMElement* el)
       hFile << "   *ostr.getXDRostream()";
       for (unsigned int n=0; n < attrV.size(); ++n)
       {
-         hFile << " << m_" << attrV[n];
+         bool packed = (std::find(boolV.begin(), boolV.end(), attrV[n])
+                        != boolV.end());
+         hFile << " << " << ((packed)? "(int32_t)m_" : "m_") << attrV[n];
       }
       hFile << ";" << std::endl;
    }
@@ -4308,6 +6897,262 @@ void CodeBuilder::constructStreamers(DOMElement* el)
    }
 }
  
+/* Generate read-only view classes over serialized records */
+
+void CodeBuilder::constructViews()
+{
+   std::vector<DOMElement*>::iterator iter;
+   for (iter = tagList.begin(); iter != tagList.end(); ++iter)
+   {
+      XtString tagS((*iter)->getTagName());
+      hFile << "class " << tagS.simpleType() << "View;" << std::endl;
+   }
+   hFile << std::endl;
+   for (iter = tagList.begin(); iter != tagList.end(); ++iter)
+   {
+      writeViewdef(*iter);
+   }
+   for (iter = tagList.begin(); iter != tagList.end(); ++iter)
+   {
+      writeViewimp(*iter);
+   }
+}
+
+void CodeBuilder::writeViewdef(DOMElement* el)
+{
+   XtString tagS(el->getTagName());
+   XtString viewS(tagS.simpleType() + "View");
+
+   hFile << "class " << viewS << ": public HDDM_View {" << std::endl
+         << " public:" << std::endl
+         << "   " << viewS << "() {}" << std::endl
+         << "   explicit " << viewS << "(const char *data)"
+         << " : HDDM_View(data) {}" << std::endl;
+
+   DOMNamedNodeMap *myAttr = el->getAttributes();
+   for (unsigned int n = 0; n < myAttr->getLength(); n++)
+   {
+      XtString attrS(myAttr->item(n)->getNodeName());
+      XtString typeS(el->getAttribute(X(attrS)));
+      XtString getS("get" + attrS.simpleType());
+      if (typeS == "int")
+      {
+         hFile << "   int " << getS << "() const;" << std::endl;
+      }
+      else if (typeS == "long")
+      {
+         hFile << "   int64_t " << getS << "() const;" << std::endl;
+      }
+      else if (typeS == "float")
+      {
+         hFile << "   float " << getS << "() const;" << std::endl;
+      }
+      else if (typeS == "double")
+      {
+         hFile << "   double " << getS << "() const;" << std::endl;
+      }
+      else if (typeS == "boolean")
+      {
+         hFile << "   bool " << getS << "() const;" << std::endl;
+      }
+      else if (typeS == "string" || typeS == "anyURI")
+      {
+         hFile << "   std::string_view " << getS << "() const;" << std::endl;
+      }
+      else if (typeS == "Particle_t")
+      {
+         hFile << "   Particle_t " << getS << "() const;" << std::endl;
+      }
+   }
+
+   DOMNodeList* contList = el->getChildNodes();
+   for (unsigned int c = 0; c < contList->getLength(); c++)
+   {
+      DOMNode* node = contList->item(c);
+      if (node->getNodeType() == DOMNode::ELEMENT_NODE)
+      {
+         DOMElement *contEl = (DOMElement*)node;
+         XtString cnameS(contEl->getTagName());
+         XtString repS(contEl->getAttribute(X("maxOccurs")));
+         int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
+         hFile << "   " << cnameS.simpleType() << "View get"
+               << cnameS.simpleType()
+               << ((rep > 1)? "(int index=0) const;" : "() const;")
+               << std::endl
+               << "   HDDM_ViewList<" << cnameS.simpleType() << "View> get"
+               << cnameS.plural().simpleType() << "() const;" << std::endl;
+      }
+   }
+
+   hFile << "   static const char *skip(const char *data);" << std::endl
+         << " private:" << std::endl
+         << "   static const char *skip_attributes(const char *data);"
+         << std::endl
+         << "};" << std::endl << std::endl;
+}
+
+void CodeBuilder::writeViewimp(DOMElement* el)
+{
+   XtString tagS(el->getTagName());
+   XtString viewS(tagS.simpleType() + "View");
+
+   // Attributes are laid out back to back in schema order, so each getter
+   // starts from the front of the element and steps over the attributes
+   // ahead of it, adding up the fixed widths and reading string lengths.
+   std::stringstream prefix;
+   int offset = 0;
+   DOMNamedNodeMap *myAttr = el->getAttributes();
+   for (unsigned int n = 0; n < myAttr->getLength(); n++)
+   {
+      XtString attrS(myAttr->item(n)->getNodeName());
+      XtString typeS(el->getAttribute(X(attrS)));
+      XtString getS("get" + attrS.simpleType());
+      XtString decodeS;
+      int width = 4;
+      if (typeS == "int")
+      {
+         hFile << "inline int ";
+         decodeS = "get_int";
+      }
+      else if (typeS == "long")
+      {
+         hFile << "inline int64_t ";
+         decodeS = "get_long";
+         width = 8;
+      }
+      else if (typeS == "float")
+      {
+         hFile << "inline float ";
+         decodeS = "get_float";
+      }
+      else if (typeS == "double")
+      {
+         hFile << "inline double ";
+         decodeS = "get_double";
+         width = 8;
+      }
+      else if (typeS == "boolean")
+      {
+         hFile << "inline bool ";
+         decodeS = "get_int";
+      }
+      else if (typeS == "string" || typeS == "anyURI")
+      {
+         hFile << "inline std::string_view ";
+         decodeS = "get_string";
+         width = 0;
+      }
+      else if (typeS == "Particle_t")
+      {
+         hFile << "inline Particle_t ";
+         decodeS = "(Particle_t)get_int";
+      }
+      else
+      {
+         continue;
+      }
+      hFile << viewS << "::" << getS << "() const {" << std::endl;
+      if (prefix.str().size() > 0)
+      {
+         hFile << "   const char *p = m_data;" << std::endl
+               << prefix.str();
+      }
+      hFile << "   return " << decodeS << "("
+            << ((prefix.str().size() > 0)? "p" : "m_data");
+      if (offset > 0)
+      {
+         hFile << " + " << offset;
+      }
+      hFile << ")" << ((typeS == "boolean")? " != 0" : "") << ";" << std::endl
+            << "}" << std::endl << std::endl;
+      if (width > 0)
+      {
+         offset += width;
+      }
+      else
+      {
+         prefix << "   p = skip_string(p";
+         if (offset > 0)
+         {
+            prefix << " + " << offset;
+         }
+         prefix << ");" << std::endl;
+         offset = 0;
+      }
+   }
+
+   hFile << "inline const char *" << viewS
+         << "::skip_attributes(const char *p) {" << std::endl
+         << prefix.str()
+         << "   return p";
+   if (offset > 0)
+   {
+      hFile << " + " << offset;
+   }
+   hFile << ";" << std::endl
+         << "}" << std::endl << std::endl;
+
+   std::stringstream skips;
+   DOMNodeList* contList = el->getChildNodes();
+   for (unsigned int c = 0; c < contList->getLength(); c++)
+   {
+      DOMNode* node = contList->item(c);
+      if (node->getNodeType() == DOMNode::ELEMENT_NODE)
+      {
+         DOMElement *contEl = (DOMElement*)node;
+         XtString cnameS(contEl->getTagName());
+         XtString repS(contEl->getAttribute(X("maxOccurs")));
+         int rep = (repS == "unbounded")? INT_MAX : atoi(S(repS));
+         XtString cviewS(cnameS.simpleType() + "View");
+         if (rep > 1)
+         {
+            hFile << "inline HDDM_ViewList<" << cviewS << "> " << viewS
+                  << "::get" << cnameS.plural().simpleType() << "() const {"
+                  << std::endl
+                  << "   const char *p = skip_attributes(m_data);" << std::endl
+                  << skips.str()
+                  << "   return HDDM_ViewList<" << cviewS << ">(p);"
+                  << std::endl
+                  << "}" << std::endl << std::endl
+                  << "inline " << cviewS << " " << viewS
+                  << "::get" << cnameS.simpleType() << "(int index) const {"
+                  << std::endl
+                  << "   return get" << cnameS.plural().simpleType()
+                  << "()(index);" << std::endl
+                  << "}" << std::endl << std::endl;
+         }
+         else
+         {
+            hFile << "inline HDDM_ViewList<" << cviewS << "> " << viewS
+                  << "::get" << cnameS.plural().simpleType() << "() const {"
+                  << std::endl
+                  << "   const char *p = skip_attributes(m_data);" << std::endl
+                  << skips.str()
+                  << "   return (get_uint(p) == 0)? HDDM_ViewList<" << cviewS
+                  << ">() :" << std::endl
+                  << "          HDDM_ViewList<" << cviewS << ">(p + 4, 1);"
+                  << std::endl
+                  << "}" << std::endl << std::endl
+                  << "inline " << cviewS << " " << viewS
+                  << "::get" << cnameS.simpleType() << "() const {"
+                  << std::endl
+                  << "   const char *p = skip_attributes(m_data);" << std::endl
+                  << skips.str()
+                  << "   return get_link<" << cviewS << ">(p);" << std::endl
+                  << "}" << std::endl << std::endl;
+         }
+         skips << "   p = skip_sized(p);" << std::endl;
+      }
+   }
+
+   hFile << "inline const char *" << viewS
+         << "::skip(const char *p) {" << std::endl
+         << "   p = skip_attributes(p);" << std::endl
+         << skips.str()
+         << "   return p;" << std::endl
+         << "}" << std::endl << std::endl;
+}
+
 /* Generate methods to read from binary stream into classes */
 
 void CodeBuilder::constructIOstreams(DOMElement* el)
@@ -4351,6 +7196,10 @@ void CodeBuilder::constructIOstreams(DOMElement* el)
    "      return this;\n"
    "}\n"
    "\n"
+   "inline bool istream::viewable() const {\n"
+   "   return m_genome->m_identity;\n"
+   "}\n"
+   "\n"
    "inline int istream::getCompression() const {\n"
    "   return (int)m_status_bits & k_bits_compression;\n"
    "}\n"
@@ -4402,7 +7251,7 @@ void CodeBuilder::constructIOstreams(DOMElement* el)
    "inline istream &istream::operator>>(streamable &object) {\n"
    "   MY_SETUP\n"
    "   if (MY(sequencing)) {\n"
-   "      MY(codon)->m_target.push_back(&object);\n"
+   "      MY(targets).push_back(&object);\n"
    "   }\n"
    "   else {\n"
    "      int size;\n"
@@ -4423,40 +7272,36 @@ void CodeBuilder::constructIOstreams(DOMElement* el)
    "\n"
    "inline void istream::sequencer(streamable &object) {\n"
    "   MY_SETUP\n"
+   "   const codon &gene = *MY(codon);\n"
+   "   if (gene.m_identity) {\n"
+   "      object.streamer(*this);\n"
+   "      return;\n"
+   "   }\n"
+   "   size_t base = MY(targets).size();\n"
+   "   MY(targets).push_back(0);\n"
    "   MY(sequencing) = 1;\n"
-   "   MY(codon)->m_target.clear();\n"
    "   object.streamer(*this);\n"
    "   if (MY(sequencing)) {\n"
    "      MY(sequencing) = 0;\n"
-   "      codon &gene = *MY(codon);\n"
    "      streamable null_streamable;\n"
-   "      gene.m_target.push_front(&null_streamable);\n"
-   "      chromosome::iterator iter;\n"
+   "      MY(targets)[base] = &null_streamable;\n"
+   "      chromosome::const_iterator iter;\n"
    "      for (iter = gene.m_sequence.begin();\n"
    "           iter != gene.m_sequence.end();\n"
    "           ++iter)\n"
    "      {\n"
    "         MY(codon) = &(*iter);\n"
-   "         *this >> *gene.m_target[iter->m_order];\n"
+   "         *this >> *MY(targets)[base + iter->m_order];\n"
    "      }\n"
    "      MY(codon) = &gene;\n"
    "   }\n"
+   "   MY(targets).resize(base);\n"
    "}\n"
    "\n"
    "inline ostream &ostream::operator<<(HDDM &record) {\n"
    "   MY_SETUP\n"
-   "   MY(sbuf)->reset();\n"
+   "   acquire_event_buffer(bufferpool::k_min_buffer_size);\n"
    "   *this << (streamable&)record;\n"
-   "   while (MY(sbuf)->size() == MY(event_buffer_size)) {\n"
-   "      delete MY(xstr);\n"
-   "      delete MY(sbuf);\n"
-   "      char *newbuf = new char[MY(event_buffer_size) *= 2];\n"
-   "      MY(sbuf) = new ostreambuffer(newbuf, MY(event_buffer_size));\n"
-   "      MY(xstr) = new xstream::xdr::ostream(MY(sbuf));\n"
-   "      delete [] MY(event_buffer);\n"
-   "      MY(event_buffer) = newbuf;\n"
-   "      *this << (streamable&)record;\n"
-   "   }\n" 
    "   lock_streambufs();\n"
    "   update_streambufs();\n"
    "   if ((MY(status_bits) & k_crc32_integrity) != 0) {\n"
@@ -4483,12 +7328,13 @@ void CodeBuilder::constructIOstreams(DOMElement* el)
    "      MY(last_offset) = ((xstream::z::ostreambuf*)MY(xcmp))->get_block_offset();\n"
    "   }\n"
    "   else {\n"
-   "      MY(last_start) = m_ostr.tellp();\n"
+   "      MY(last_start) = m_sink->pubseekoff(0,std::ios_base::cur,std::ios_base::out);\n"
    "      MY(last_offset) = 0;\n"
    "   }\n"
    "   unlock_streambufs();\n"
    "   MY(bytes_written) += MY(sbuf)->size();\n"
    "   MY(records_written)++;\n"
+   "   release_event_buffer();\n"
    "   return *this;\n"
    "}\n"
    "\n"
@@ -4558,6 +7404,26 @@ void CodeBuilder::constructDocument(DOMElement* el)
    }
 }
 
+int memberGroup(const std::string &type)
+{
+   // Data members are declared in three passes: 4-byte scalars first,
+   // then booleans, then everything 8-byte aligned. Without the compact
+   // layout every member falls in the last pass, in schema order.
+   if (! compactLayout)
+   {
+      return 2;
+   }
+   else if (type == "int" || type == "float" || type == "Particle_t")
+   {
+      return 0;
+   }
+   else if (type == "boolean")
+   {
+      return 1;
+   }
+   return 2;
+}
+
 std::string guessType(const std::string &literal)
 {
    const char *str = literal.c_str();
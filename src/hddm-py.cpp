@@ -323,6 +323,8 @@ int main(int argC, char* argV[])
    "#include <iostream>\n"
    "#include <exception>\n"
    "#include <particleType.h>\n"
+   "#include <pthread.h>\n"
+   "#include <deque>\n"
    ;
 
 #ifdef ENABLE_ISTREAM_OVER_HTTP
@@ -428,8 +430,20 @@ int main(int argC, char* argV[])
    "static PyObject*\n"
    "_HDDM_Element_getAttribute(PyObject *self, PyObject *args)\n"
    "{\n"
-   "   char *attr;\n"
-   "   if (! PyArg_ParseTuple(args, \"s\", &attr)) {\n"
+   "   PyObject *attr;\n"
+   "   if (! PyArg_ParseTuple(args, \"O\", &attr)) {\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   attr_id id;\n"
+   "   if (PyLong_Check(attr)) {\n"
+   "      id = (attr_id)PyLong_AsLong(attr);\n"
+   "   }\n"
+   "   else if (PyUnicode_Check(attr)) {\n"
+   "      id = lookupAttribute(PyUnicode_AsUTF8(attr));\n"
+   "   }\n"
+   "   else {\n"
+   "      PyErr_SetString(PyExc_TypeError, \"attribute must be given by"
+   " name or k_attr_ id\");\n"
    "      return NULL;\n"
    "   }\n"
    "   _HDDM_Element *me = (_HDDM_Element*)self;\n"
@@ -439,7 +453,7 @@ int main(int argC, char* argV[])
    "      return NULL;\n"
    "   }\n"
    "   hddm_type atype;\n"
-   "   void *val((int*)me->elem->getAttribute(std::string(attr),&atype));\n"
+   "   void *val((int*)me->elem->getAttribute(id,&atype));\n"
    "   if (val == 0) {\n"
    "      Py_INCREF(Py_None);\n"
    "      return Py_None;\n"
@@ -483,7 +497,7 @@ int main(int argC, char* argV[])
    "\n"
    "static PyMethodDef _HDDM_Element_methods[] = {\n"
    "   {\"getAttribute\", _HDDM_Element_getAttribute, METH_VARARGS,\n"
-   "    \"look up named attribute in this element\"},\n"
+   "    \"look up attribute in this element by name or k_attr_ id\"},\n"
    "   {NULL}  /* Sentinel */\n"
    "};\n"
    "\n"
@@ -583,6 +597,17 @@ int main(int argC, char* argV[])
    "}\n"
    "\n"
    "static PyObject*\n"
+   "_HDDM_ElementList_wrap(_HDDM_ElementList *self, HDDM_Element *elem)\n"
+   "{\n"
+   "   PyObject *elem_obj = _HDDM_Element_new(self->subtype, 0, 0);\n"
+   "   ((_HDDM_Element*)elem_obj)->elem = elem;\n"
+   "   ((_HDDM_Element*)elem_obj)->host = self->host;\n"
+   "   My_INCREF(self->host);\n"
+   "   LOG_NEW(self->subtype);\n"
+   "   return elem_obj;\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
    "_HDDM_ElementList_item(_HDDM_ElementList *self, Py_ssize_t i)\n"
    "{\n"
    "   if (self->list == 0)\n"
@@ -592,12 +617,9 @@ int main(int argC, char* argV[])
    "      PyErr_Format(PyExc_IndexError, \"index %ld out of bounds.\", i);\n"
    "      return NULL;\n"
    "   }\n"
-   "   PyObject *elem_obj = _HDDM_Element_new(self->subtype, 0, 0);\n"
-   "   ((_HDDM_Element*)elem_obj)->elem = &(HDDM_Element&)(*self->list)((int)i);\n"
-   "   ((_HDDM_Element*)elem_obj)->host = self->host;\n"
-   "   My_INCREF(self->host);\n"
-   "   LOG_NEW(self->subtype);\n"
-   "   return elem_obj;\n"
+   "   // lists longer than a few elements keep an index of their\n"
+   "   // nodes in the c++ layer, so this takes constant time\n"
+   "   return _HDDM_ElementList_wrap(self, &(*self->list)((int)i));\n"
    "}\n"
    "\n"
    "extern PyTypeObject _HDDM_ElementList_type;\n"
@@ -615,10 +637,17 @@ int main(int argC, char* argV[])
    "      PyErr_SetString(PyExc_RuntimeError, \"add attempted on invalid list\");\n"
    "      return NULL;\n"
    "   }\n"
+   "   HDDM_ElementList<HDDM_Element> *added;\n"
+   "   try {\n"
+   "      added = new HDDM_ElementList<HDDM_Element>(me->list->add(count, start));\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, e.what());\n"
+   "      return NULL;\n"
+   "   }\n"
    "   PyObject *list = _HDDM_ElementList_new(&_HDDM_ElementList_type, 0, 0);\n"
    "   ((_HDDM_ElementList*)list)->subtype = me->subtype;\n"
-   "   ((_HDDM_ElementList*)list)->list = (HDDM_ElementList<HDDM_Element>*)\n"
-   "    new HDDM_ElementList<HDDM_Element>(me->list->add(count, start));\n"
+   "   ((_HDDM_ElementList*)list)->list = added;\n"
    "   ((_HDDM_ElementList*)list)->borrowed = 0;\n"
    "   ((_HDDM_ElementList*)list)->host = me->host;\n"
    "   My_INCREF(me->host);\n"
@@ -640,7 +669,13 @@ int main(int argC, char* argV[])
    "      PyErr_SetString(PyExc_RuntimeError, \"del attempted on invalid list\");\n"
    "      return NULL;\n"
    "   }\n"
-   "   list_obj->list->del(count, start);\n"
+   "   try {\n"
+   "      list_obj->list->del(count, start);\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, e.what());\n"
+   "      return NULL;\n"
+   "   }\n"
    "   Py_INCREF(self);\n"
    "   return self;\n"
    "}\n"
@@ -654,15 +689,161 @@ int main(int argC, char* argV[])
    "      PyErr_SetString(PyExc_RuntimeError, \"clear attempted on invalid list\");\n"
    "      return NULL;\n"
    "   }\n"
-   "   list_obj->list->clear();\n"
+   "   try {\n"
+   "      list_obj->list->clear();\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, e.what());\n"
+   "      return NULL;\n"
+   "   }\n"
    "   Py_INCREF(self);\n"
    "   return self;\n"
    "}\n"
    "\n"
+   "static PyObject*\n"
+   "_HDDM_ElementList_subscript(_HDDM_ElementList *self, PyObject *key)\n"
+   "{\n"
+   "   if (self->list == 0) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, \"lookup attempted on invalid list\");\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   Py_ssize_t len = self->list->size();\n"
+   "   if (PyIndex_Check(key)) {\n"
+   "      Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);\n"
+   "      if (i == -1 && PyErr_Occurred())\n"
+   "         return NULL;\n"
+   "      return _HDDM_ElementList_item(self, (i < 0)? i + len : i);\n"
+   "   }\n"
+   "   else if (! PySlice_Check(key)) {\n"
+   "      PyErr_Format(PyExc_TypeError, \"list indices must be integers\"\n"
+   "                   \" or slices, not %.200s\", Py_TYPE(key)->tp_name);\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   Py_ssize_t start, stop, step, count;\n"
+   "#if PY_MAJOR_VERSION < 3\n"
+   "   if (PySlice_GetIndicesEx((PySliceObject*)key, len,\n"
+   "                            &start, &stop, &step, &count) < 0)\n"
+   "#else\n"
+   "   if (PySlice_GetIndicesEx(key, len, &start, &stop, &step, &count) < 0)\n"
+   "#endif\n"
+   "      return NULL;\n"
+   "   if (step == 1) {\n"
+   "      // contiguous slices are views onto the same elements, which\n"
+   "      // can be modified through the slice but not added or deleted\n"
+   "      if (count == 0)\n"
+   "         start = stop = len;\n"
+   "      PyObject *list = _HDDM_ElementList_new(&_HDDM_ElementList_type, 0, 0);\n"
+   "      ((_HDDM_ElementList*)list)->subtype = self->subtype;\n"
+   "      ((_HDDM_ElementList*)list)->list = new HDDM_ElementList<HDDM_Element>\n"
+   "                                         (self->list->slice(start, stop - 1));\n"
+   "      ((_HDDM_ElementList*)list)->borrowed = 0;\n"
+   "      ((_HDDM_ElementList*)list)->host = self->host;\n"
+   "      My_INCREF(self->host);\n"
+   "      LOG_NEW(Py_TYPE(list), self->subtype, 1);\n"
+   "      return list;\n"
+   "   }\n"
+   "   PyObject *result = PyList_New(count);\n"
+   "   for (Py_ssize_t n=0; result != NULL && n < count; ++n, start += step) {\n"
+   "      PyList_SET_ITEM(result, n, _HDDM_ElementList_wrap(self,\n"
+   "                      &(*self->list)((int)start)));\n"
+   "   }\n"
+   "   return result;\n"
+   "}\n"
+   "\n"
+   "// iterator over a HDDM_ElementList that steps through the c++ list\n"
+   "// one node at a time, instead of looking up each element by index\n"
+   "\n"
+   "typedef struct {\n"
+   "   PyObject_HEAD\n"
+   "   _HDDM_ElementList *list;\n"
+   "   HDDM_ElementList<HDDM_Element>::iterator *iter;\n"
+   "   int index;\n"
+   "   int size;\n"
+   "} _HDDM_ElementListIter;\n"
+   "\n"
+   "static void\n"
+   "_HDDM_ElementListIter_dealloc(_HDDM_ElementListIter* self)\n"
+   "{\n"
+   "   if (self->iter != 0)\n"
+   "      delete self->iter;\n"
+   "   Py_XDECREF(self->list);\n"
+   "   Py_TYPE(self)->tp_free((PyObject*)self);\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_HDDM_ElementListIter_next(_HDDM_ElementListIter *self)\n"
+   "{\n"
+   "   if (self->index >= self->size)\n"
+   "      return NULL;\n"
+   "   else if (self->list->list->size() != self->size) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, \"list changed size during iteration\");\n"
+   "      self->index = self->size;\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   HDDM_Element *elem = &**self->iter;\n"
+   "   if (++self->index < self->size)\n"
+   "      ++*self->iter;\n"
+   "   return _HDDM_ElementList_wrap(self->list, elem);\n"
+   "}\n"
+   "\n"
+   "static PyTypeObject _HDDM_ElementListIter_type = {\n"
+   "    PyVarObject_HEAD_INIT(NULL,0)\n"
+   "    \"hddm_" << classPrefix << ".HDDM_ElementListIterator\", /*tp_name*/\n"
+   "    sizeof(_HDDM_ElementListIter), /*tp_basicsize*/\n"
+   "    0,                         /*tp_itemsize*/\n"
+   "    (destructor)_HDDM_ElementListIter_dealloc, /*tp_dealloc*/\n"
+   "    0,                         /*tp_print*/\n"
+   "    0,                         /*tp_getattr*/\n"
+   "    0,                         /*tp_setattr*/\n"
+   "    0,                         /*tp_compare*/\n"
+   "    0,                         /*tp_repr*/\n"
+   "    0,                         /*tp_as_number*/\n"
+   "    0,                         /*tp_as_sequence*/\n"
+   "    0,                         /*tp_as_mapping*/\n"
+   "    0,                         /*tp_hash */\n"
+   "    0,                         /*tp_call*/\n"
+   "    0,                         /*tp_str*/\n"
+   "    0,                         /*tp_getattro*/\n"
+   "    0,                         /*tp_setattro*/\n"
+   "    0,                         /*tp_as_buffer*/\n"
+   "    Py_TPFLAGS_DEFAULT,        /*tp_flags*/\n"
+   "    \"hddm_" << classPrefix << " element list iterator\", /* tp_doc */\n"
+   "    0,                         /* tp_traverse */\n"
+   "    0,                         /* tp_clear */\n"
+   "    0,                         /* tp_richcompare */\n"
+   "    0,                         /* tp_weaklistoffset */\n"
+   "    PyObject_SelfIter,         /* tp_iter */\n"
+   "    (iternextfunc)_HDDM_ElementListIter_next, /* tp_iternext */\n"
+   "};\n"
+   "\n"
+   "static PyObject*\n"
+   "_HDDM_ElementList_iter(_HDDM_ElementList *self)\n"
+   "{\n"
+   "   if (self->list == 0) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, \"iteration attempted on invalid list\");\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   _HDDM_ElementListIter *iter;\n"
+   "   iter = PyObject_New(_HDDM_ElementListIter, &_HDDM_ElementListIter_type);\n"
+   "   if (iter == NULL)\n"
+   "      return NULL;\n"
+   "   Py_INCREF(self);\n"
+   "   iter->list = self;\n"
+   "   iter->index = 0;\n"
+   "   iter->size = self->list->size();\n"
+   "   iter->iter = (iter->size > 0)?\n"
+   "                new HDDM_ElementList<HDDM_Element>::iterator(self->list->begin()) : 0;\n"
+   "   return (PyObject*)iter;\n"
+   "}\n"
+   "\n"
    "static PyMemberDef _HDDM_ElementList_members[] = {\n"
    "   {NULL}  /* Sentinel */\n"
    "};\n"
    "\n"
+   "// defined with the tables of per-tag functions further down\n"
+   "static PyObject *_HDDM_ElementList_column(PyObject *self, PyObject *args);\n"
+   "static PyObject *_HDDM_ElementList_setColumn(PyObject *self, PyObject *args);\n"
+   "\n"
    "static PyMethodDef _HDDM_ElementList_methods[] = {\n"
    "   {\"add\",  _HDDM_ElementList_add, METH_VARARGS,\n"
    "    \"add (or insert) a new element to the list.\"},\n"
@@ -670,6 +851,12 @@ int main(int argC, char* argV[])
    "    \"delete an existing element from the list.\"},\n"
    "   {\"clear\",  _HDDM_ElementList_clear, METH_NOARGS,\n"
    "    \"reset the list to zero elements.\"},\n"
+   "   {\"column\",  _HDDM_ElementList_column, METH_VARARGS,\n"
+   "    \"return the values of the named numeric attribute of all elements\\n\"\n"
+   "    \"in the list as one array.\"},\n"
+   "   {\"set_column\",  _HDDM_ElementList_setColumn, METH_VARARGS,\n"
+   "    \"set the named numeric attribute of all elements in the list from\\n\"\n"
+   "    \"a sequence or array holding one value for each element.\"},\n"
    "   {NULL}  /* Sentinel */\n"
    "};\n"
    "\n"
@@ -686,6 +873,12 @@ int main(int argC, char* argV[])
    "    0,                                          /* sq_inplace_repeat */\n"
    "};\n"
    "\n"
+   "static PyMappingMethods _HDDM_ElementList_as_mapping = {\n"
+   "    (lenfunc)_HDDM_ElementList_size,            /* mp_length */\n"
+   "    (binaryfunc)_HDDM_ElementList_subscript,    /* mp_subscript */\n"
+   "    0,                                          /* mp_ass_subscript */\n"
+   "};\n"
+   "\n"
    "PyTypeObject _HDDM_ElementList_type = {\n"
    "    PyVarObject_HEAD_INIT(NULL,0)\n"
    "    \"hddm_" << classPrefix << ".HDDM_ElementList\", /*tp_name*/\n"
@@ -699,7 +892,7 @@ int main(int argC, char* argV[])
    "    0,                         /*tp_repr*/\n"
    "    0,                         /*tp_as_number*/\n"
    "    &_HDDM_ElementList_as_sequence, /*tp_as_sequence*/\n"
-   "    0,                         /*tp_as_mapping*/\n"
+   "    &_HDDM_ElementList_as_mapping, /*tp_as_mapping*/\n"
    "    0,                         /*tp_hash */\n"
    "    0,                         /*tp_call*/\n"
    "    0,                         /*tp_str*/\n"
@@ -712,7 +905,7 @@ int main(int argC, char* argV[])
    "    0,                         /* tp_clear */\n"
    "    0,                         /* tp_richcompare */\n"
    "    0,                         /* tp_weaklistoffset */\n"
-   "    0,                         /* tp_iter */\n"
+   "    (getiterfunc)_HDDM_ElementList_iter, /* tp_iter */\n"
    "    0,                         /* tp_iternext */\n"
    "    _HDDM_ElementList_methods, /* tp_methods */\n"
    "    _HDDM_ElementList_members, /* tp_members */\n"
@@ -726,6 +919,270 @@ int main(int argC, char* argV[])
    "    0,                         /* tp_alloc */\n"
    "    _HDDM_ElementList_new,     /* tp_new */\n"
    "};\n"
+   "\n"
+   "\n"
+   "// columns of attribute values collected from many elements at once,\n"
+   "// used to hand whole branches of the record tree to python as arrays\n"
+   "\n"
+   "struct _HDDM_Column {\n"
+   "   std::string name;\n"
+   "   attr_id id;\n"
+   "   hddm_type type;\n"
+   "   std::vector<char> data;\n"
+   "   template <class T>\n"
+   "   void put(T value) {\n"
+   "      size_t size = data.size();\n"
+   "      data.resize(size + sizeof(T));\n"
+   "      memcpy(&data[size], &value, sizeof(T));\n"
+   "   }\n"
+   "};\n"
+   "\n"
+   "struct _HDDM_ColumnSet {\n"
+   "   int depth;                      // levels below the record\n"
+   "   std::vector<int> path;          // child index taken at each level\n"
+   "   std::vector<int64_t> count;     // elements seen at each level\n"
+   "   std::vector<std::vector<int64_t> > offsets;\n"
+   "   std::vector<_HDDM_Column> columns;\n"
+   "};\n"
+   "\n"
+   "typedef struct {\n"
+   "   const char *tag;\n"
+   "   const char **children;\n"
+   "   hddm_type (*columnType)(attr_id id);\n"
+   "   PyTypeObject *type;\n"
+   "   bool (*getColumn)(HDDM_ElementList<HDDM_Element> *list, _HDDM_Column &col);\n"
+   "   void (*setColumn)(HDDM_ElementList<HDDM_Element> *list, attr_id id,\n"
+   "                     const char *data);\n"
+   "} _HDDM_ElementInfo;\n"
+   "\n"
+   "static size_t\n"
+   "_HDDM_arrayType(hddm_type type, const char **dtype, const char **typecode)\n"
+   "{\n"
+   "   // returns the size of one array item, or 0 for a non-numeric type\n"
+   "   switch (type) {\n"
+   "    case k_hddm_int:\n"
+   "    case k_hddm_Particle_t:\n"
+   "      *dtype = \"i4\";\n"
+   "      *typecode = \"i\";\n"
+   "      return 4;\n"
+   "    case k_hddm_long:\n"
+   "      *dtype = \"i8\";\n"
+   "      *typecode = \"q\";\n"
+   "      return 8;\n"
+   "    case k_hddm_float:\n"
+   "      *dtype = \"f4\";\n"
+   "      *typecode = \"f\";\n"
+   "      return 4;\n"
+   "    case k_hddm_double:\n"
+   "      *dtype = \"f8\";\n"
+   "      *typecode = \"d\";\n"
+   "      return 8;\n"
+   "    case k_hddm_boolean:\n"
+   "      *dtype = \"?\";\n"
+   "      *typecode = \"B\";\n"
+   "      return 1;\n"
+   "    default:\n"
+   "      PyErr_SetString(PyExc_TypeError, \"only numeric attributes\"\n"
+   "                      \" can be stored in arrays\");\n"
+   "      return 0;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_HDDM_makeArray(hddm_type type, const void *data, size_t size)\n"
+   "{\n"
+   "   // numpy is imported at run time so that the module still works\n"
+   "   // without it, returning the data as an array.array instead\n"
+   "   const char *dtype;\n"
+   "   const char *typecode;\n"
+   "   if (_HDDM_arrayType(type, &dtype, &typecode) == 0)\n"
+   "      return NULL;\n"
+   "   PyObject *buf = PyByteArray_FromStringAndSize((const char*)data, size);\n"
+   "   if (buf == NULL)\n"
+   "      return NULL;\n"
+   "   PyObject *array = NULL;\n"
+   "   PyObject *module = PyImport_ImportModule(\"numpy\");\n"
+   "   if (module != NULL) {\n"
+   "      array = PyObject_CallMethod(module, \"frombuffer\", \"Os\", buf, dtype);\n"
+   "   }\n"
+   "   else {\n"
+   "      PyErr_Clear();\n"
+   "      module = PyImport_ImportModule(\"array\");\n"
+   "      if (module != NULL)\n"
+   "         array = PyObject_CallMethod(module, \"array\", \"sO\", typecode, buf);\n"
+   "   }\n"
+   "   Py_XDECREF(module);\n"
+   "   Py_DECREF(buf);\n"
+   "   return array;\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_HDDM_toArray(hddm_type type, PyObject *values, Py_ssize_t count)\n"
+   "{\n"
+   "   // converts any sequence or array of numbers into a contiguous array\n"
+   "   // of count items of the given type, copying only if necessary\n"
+   "   const char *dtype;\n"
+   "   const char *typecode;\n"
+   "   size_t itemsize = _HDDM_arrayType(type, &dtype, &typecode);\n"
+   "   if (itemsize == 0)\n"
+   "      return NULL;\n"
+   "   PyObject *array = NULL;\n"
+   "   PyObject *module = PyImport_ImportModule(\"numpy\");\n"
+   "   if (module != NULL) {\n"
+   "      array = PyObject_CallMethod(module, \"ascontiguousarray\", \"Os\",\n"
+   "                                  values, dtype);\n"
+   "   }\n"
+   "   else {\n"
+   "      PyErr_Clear();\n"
+   "      module = PyImport_ImportModule(\"array\");\n"
+   "      if (module != NULL)\n"
+   "         array = PyObject_CallMethod(module, \"array\", \"sO\", typecode, values);\n"
+   "   }\n"
+   "   Py_XDECREF(module);\n"
+   "   if (array == NULL)\n"
+   "      return NULL;\n"
+   "   Py_ssize_t size = PyObject_Size(array);\n"
+   "   if (size != count) {\n"
+   "      if (size >= 0)\n"
+   "         PyErr_Format(PyExc_ValueError, \"expected %zd values, got %zd\",\n"
+   "                      count, size);\n"
+   "      Py_DECREF(array);\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   return array;\n"
+   "}\n"
+   "\n"
+   "\n"
+   "// single records converted to and from the bytes that an uncompressed\n"
+   "// ostream writes for them, through a private ostream/istream pair that\n"
+   "// is set up once with the data model of this module; only ever used\n"
+   "// with the GIL held\n"
+   "\n"
+   "class _HDDM_bytesink : public std::streambuf {\n"
+   " public:\n"
+   "   std::string bytes;\n"
+   " protected:\n"
+   "   int overflow(int c) {\n"
+   "      if (c != EOF)\n"
+   "         bytes.push_back((char)c);\n"
+   "      return c;\n"
+   "   }\n"
+   "   std::streamsize xsputn(const char *s, std::streamsize n) {\n"
+   "      bytes.append(s, n);\n"
+   "      return n;\n"
+   "   }\n"
+   "};\n"
+   "\n"
+   "class _HDDM_bytesource : public std::streambuf {\n"
+   " public:\n"
+   "   void set(const char *data, size_t size) {\n"
+   "      setg((char*)data, (char*)data, (char*)data + size);\n"
+   "   }\n"
+   "};\n"
+   "\n"
+   "class _HDDM_codec {\n"
+   " public:\n"
+   "   _HDDM_codec() : m_ostr(&m_sink), m_istr(&m_source),\n"
+   "                   m_writer(0), m_reader(0) {}\n"
+   "   void encode(HDDM &record) {\n"
+   "      if (m_writer == 0)\n"
+   "         m_writer = new ostream(m_ostr);\n"
+   "      m_sink.bytes.clear();\n"
+   "      *m_writer << record;\n"
+   "   }\n"
+   "   const std::string &bytes() const {\n"
+   "      return m_sink.bytes;\n"
+   "   }\n"
+   "   bool decode(const char *bytes, size_t size, HDDM &record) {\n"
+   "      if (m_reader == 0) {\n"
+   "         std::string header(HDDM::DocumentString());\n"
+   "         m_source.set(header.data(), header.size());\n"
+   "         m_reader = new istream(m_istr);\n"
+   "      }\n"
+   "      m_source.set(bytes, size);\n"
+   "      try {\n"
+   "         *m_reader >> record;\n"
+   "      }\n"
+   "      catch (...) {\n"
+   "         reset();\n"
+   "         throw;\n"
+   "      }\n"
+   "      if (! *m_reader) {\n"
+   "         reset();\n"
+   "         return false;\n"
+   "      }\n"
+   "      return true;\n"
+   "   }\n"
+   "   void reset() {\n"
+   "      // a reader that failed mid-record is left in an unknown state\n"
+   "      delete m_reader;\n"
+   "      m_reader = 0;\n"
+   "      m_istr.clear();\n"
+   "   }\n"
+   " private:\n"
+   "   _HDDM_bytesink m_sink;\n"
+   "   _HDDM_bytesource m_source;\n"
+   "   std::ostream m_ostr;\n"
+   "   std::istream m_istr;\n"
+   "   ostream *m_writer;\n"
+   "   istream *m_reader;\n"
+   "};\n"
+   "\n"
+   "static _HDDM_codec *_HDDM_record_codec = 0;\n"
+   "\n"
+   "static PyObject*\n"
+   "_HDDM_encodeRecord(HDDM *record)\n"
+   "{\n"
+   "   if (_HDDM_record_codec == 0)\n"
+   "      _HDDM_record_codec = new _HDDM_codec();\n"
+   "   try {\n"
+   "      _HDDM_record_codec->encode(*record);\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, e.what());\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   const std::string &bytes = _HDDM_record_codec->bytes();\n"
+   "   return PyBytes_FromStringAndSize(bytes.data(), bytes.size());\n"
+   "}\n"
+   "\n"
+   "static int\n"
+   "_HDDM_decodeRecord(PyObject *obj, HDDM *record)\n"
+   "{\n"
+   "   // the record is decoded straight out of the memory of any object\n"
+   "   // that exports the buffer protocol, eg. bytes, bytearray, memoryview\n"
+   "   Py_buffer view;\n"
+   "   if (PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) != 0)\n"
+   "      return -1;\n"
+   "   const unsigned char *data = (const unsigned char*)view.buf;\n"
+   "   Py_ssize_t size = -1;\n"
+   "   if (view.len >= 4)\n"
+   "      size = ((Py_ssize_t)data[0] << 24) + (data[1] << 16) +\n"
+   "             (data[2] << 8) + data[3];\n"
+   "   if (size < 0 || size + 4 != view.len) {\n"
+   "      PyBuffer_Release(&view);\n"
+   "      PyErr_SetString(PyExc_ValueError, \"buffer does not hold exactly \"\n"
+   "                      \"one serialized hddm_" << classPrefix << " record\");\n"
+   "      return -1;\n"
+   "   }\n"
+   "   if (_HDDM_record_codec == 0)\n"
+   "      _HDDM_record_codec = new _HDDM_codec();\n"
+   "   std::string error;\n"
+   "   try {\n"
+   "      if (! _HDDM_record_codec->decode((const char*)view.buf, view.len,\n"
+   "                                       *record))\n"
+   "         error = \"incomplete hddm_" << classPrefix << " record in buffer\";\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      error = e.what();\n"
+   "   }\n"
+   "   PyBuffer_Release(&view);\n"
+   "   if (error.size() > 0) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, error.c_str());\n"
+   "      return -1;\n"
+   "   }\n"
+   "   return 0;\n"
+   "}\n"
    ;
 
    builder.constructGroup(rootEl);
@@ -735,9 +1192,11 @@ int main(int argC, char* argV[])
 
    builder.typesList["HDDM_Element"] = "_HDDM_Element_type";
    builder.typesList["HDDM_ElementList"] = "_HDDM_ElementList_type";
+   builder.typesList["HDDM_ElementListIterator"] = "_HDDM_ElementListIter_type";
    builder.typesList["streamposition"] = "_streamposition_type";
    builder.typesList["ostream"] = "_ostream_type";
    builder.typesList["istream"] = "_istream_type";
+   builder.typesList["istreamBatchIterator"] = "_istreamBatches_type";
 
    builder.pyFile <<
    "\n"
@@ -1268,8 +1727,22 @@ int main(int argC, char* argV[])
    "   xrootdIstream *rstr;\n"
    "#endif\n"
    "   istream *istr;\n"
+   "   PyObject *prefetcher;\n"
    "} _istream;\n"
    "\n"
+   "static int\n"
+   "_istream_busy(_istream *self)\n"
+   "{\n"
+   "   // while an iter_batches worker thread is reading from the stream,\n"
+   "   // nothing else may read from it or move its position\n"
+   "   if (self->prefetcher != 0) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, \"istream is in use \"\n"
+   "                      \"by an active iter_batches iterator\");\n"
+   "      return 1;\n"
+   "   }\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
    "static void\n"
    "_istream_dealloc(_istream* self)\n"
    "{\n"
@@ -1305,6 +1778,7 @@ int main(int argC, char* argV[])
    "      self->rstr = 0;\n"
    "#endif\n"
    "      self->istr = 0;\n"
+   "      self->prefetcher = 0;\n"
    "   }\n"
    "   return (PyObject*)self;\n"
    "}\n"
@@ -1314,6 +1788,8 @@ int main(int argC, char* argV[])
    "{\n"
    "   const char *kwlist[] = {\"file\", NULL};\n"
    "   char *filename;\n"
+   "   if (_istream_busy(self))\n"
+   "      return -1;\n"
    "   if (PyArg_ParseTupleAndKeywords(args, kwds, \"s\", (char**)kwlist, &filename))\n"
    "   {\n"
    "      if (self->fname != 0)\n"
@@ -1412,6 +1888,8 @@ int main(int argC, char* argV[])
    "static PyObject*\n"
    "_istream_getPosition(_istream *self, void *closure)\n"
    "{\n"
+   "   if (_istream_busy(self))\n"
+   "      return NULL;\n"
    "   streamposition *pos = new streamposition();\n"
    "   if (self->istr != 0)\n"
    "      try {\n"
@@ -1434,6 +1912,8 @@ int main(int argC, char* argV[])
    "      PyErr_SetString(PyExc_TypeError, \"unexpected argument type\");\n"
    "      return -1;\n"
    "   }\n"
+   "   if (_istream_busy(self))\n"
+   "      return -1;\n"
    "   streamposition *pos = ((_streamposition*)value)->streampos;\n"
    "   if (pos == 0) {\n"
    "      PyErr_SetString(PyExc_TypeError, \"unexpected null argument\");\n"
@@ -1491,6 +1971,8 @@ int main(int argC, char* argV[])
    "      PyErr_SetString(PyExc_TypeError, \"skip count cannot be negative\");\n"
    "      return NULL;\n"
    "   }\n"
+   "   if (_istream_busy((_istream*)self))\n"
+   "      return NULL;\n"
    "   istream *istr = ((_istream*)self)->istr;\n"
    "   if (istr == 0) {\n"
    "      PyErr_SetString(PyExc_TypeError, \"unexpected null istream ptr\");\n"
@@ -1503,6 +1985,8 @@ int main(int argC, char* argV[])
    "static PyObject*\n"
    "_istream_read(PyObject *self, PyObject *args)\n"
    "{\n"
+   "   if (_istream_busy((_istream*)self))\n"
+   "      return NULL;\n"
    "   istream *istr = ((_istream*)self)->istr;\n"
    "   if (istr == 0) {\n"
    "      PyErr_SetString(PyExc_TypeError, \"unexpected null input stream\");\n"
@@ -1511,61 +1995,441 @@ int main(int argC, char* argV[])
    "   _HDDM *record_obj = (_HDDM*)_HDDM_new(&_HDDM_type, 0, 0);\n"
    "   record_obj->elem = new HDDM();\n"
    "   record_obj->host = (PyObject*)record_obj;\n"
+   "   std::string error;\n"
+   "   Py_BEGIN_ALLOW_THREADS\n"
+   "   try {\n"
+   "      *istr >> *record_obj->elem;\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      error = e.what();\n"
+   "   }\n"
+   "   Py_END_ALLOW_THREADS\n"
+   "   if (error.size() > 0) {\n"
+   "      Py_DECREF(record_obj);\n"
+   "      PyErr_SetString(PyExc_RuntimeError, error.c_str());\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   if (*istr) {\n"
+   "      LOG_NEW(Py_TYPE(record_obj), 0, 1);\n"
+   "      return (PyObject*)record_obj;\n"
+   "   }\n"
+   "   return NULL;\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_istream_read_raw(PyObject *self, PyObject *args)\n"
+   "{\n"
+   "   if (_istream_busy((_istream*)self))\n"
+   "      return NULL;\n"
+   "   istream *istr = ((_istream*)self)->istr;\n"
+   "   if (istr == 0) {\n"
+   "      PyErr_SetString(PyExc_TypeError, \"unexpected null input stream\");\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   std::string bytes;\n"
+   "   std::string error;\n"
+   "   bool decoded = false;\n"
+   "   HDDM record;\n"
+   "   Py_BEGIN_ALLOW_THREADS\n"
+   "   try {\n"
+   "      // Records are copied undecoded when the input file was written\n"
+   "      // with this data model, otherwise decoded and serialized again.\n"
+   "      if (istr->viewable()) {\n"
+   "         istr->readRaw(bytes);\n"
+   "      }\n"
+   "      else {\n"
+   "         *istr >> record;\n"
+   "         decoded = true;\n"
+   "      }\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      error = e.what();\n"
+   "   }\n"
+   "   Py_END_ALLOW_THREADS\n"
+   "   if (error.size() > 0) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, error.c_str());\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   else if (decoded) {\n"
+   "      if (*istr)\n"
+   "         return _HDDM_encodeRecord(&record);\n"
+   "   }\n"
+   "   else if (bytes.size() > 0) {\n"
+   "      return PyBytes_FromStringAndSize(bytes.data(), bytes.size());\n"
+   "   }\n"
+   "   Py_INCREF(Py_None);\n"
+   "   return Py_None;\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_istream_to_numpy(PyObject *self, PyObject *args, PyObject *kwds)\n"
+   "{\n"
+   "   const char *kwlist[] = {\"path\", \"attributes\", \"max_records\", NULL};\n"
+   "   char *path;\n"
+   "   PyObject *attrs;\n"
+   "   Py_ssize_t max_records = -1;\n"
+   "   if (! PyArg_ParseTupleAndKeywords(args, kwds, \"sO|n\", (char**)kwlist,\n"
+   "                                     &path, &attrs, &max_records))\n"
+   "   {\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   if (_istream_busy((_istream*)self))\n"
+   "      return NULL;\n"
+   "   istream *istr = ((_istream*)self)->istr;\n"
+   "   if (istr == 0) {\n"
+   "      PyErr_SetString(PyExc_TypeError, \"unexpected null input stream\");\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   _HDDM_ColumnSet cs;\n"
+   "   if (_HDDM_ColumnSet_setup(cs, path, attrs) != 0)\n"
+   "      return NULL;\n"
+   "   std::string error;\n"
+   "   Py_BEGIN_ALLOW_THREADS\n"
+   "   try {\n"
+   "      // Read-only views skip over everything off the requested path\n"
+   "      // without decoding it, but they need the input to have been\n"
+   "      // written with this data model, otherwise decode whole records.\n"
+   "      Py_ssize_t count = 0;\n"
+   "      if (istr->viewable() && max_records != 0) {\n"
+   "         HDDMView view;\n"
+   "         *istr >> view;\n"
+   "         while (! view.empty()) {\n"
+   "            _HDDM_collect(cs, view, 0);\n"
+   "            if (++count == max_records)\n"
+   "               break;\n"
+   "            *istr >> view;\n"
+   "         }\n"
+   "      }\n"
+   "      else {\n"
+   "         HDDM record;\n"
+   "         while (count != max_records && *istr >> record) {\n"
+   "            _HDDM_collect(cs, record, 0);\n"
+   "            ++count;\n"
+   "         }\n"
+   "      }\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      error = e.what();\n"
+   "   }\n"
+   "   Py_END_ALLOW_THREADS\n"
+   "   if (error.size() > 0) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, error.c_str());\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   return _HDDM_ColumnSet_toPython(cs);\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_istream_toString(PyObject *self, PyObject *args=0)\n"
+   "{\n"
+   "   std::stringstream ostr;\n"
+   "   if (((_ostream*)self)->fname != 0)\n"
+   "      ostr << \"hddm_" << classPrefix << ".istream(\\\"\"\n"
+   "           << *((_istream*)self)->fname << \"\\\")\";\n"
+   "   else\n"
+   "      ostr << \"hddm_" << classPrefix << ".istream(NULL)\";\n"
+   "   return PyUnicode_FromString(ostr.str().c_str());\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_istream_toRepr(PyObject *self, PyObject *args=0)\n"
+   "{\n"
+   "   std::stringstream ostr;\n"
+   "   ostr << \"\\\'\";\n"
+   "   if (((_ostream*)self)->fname != 0)\n"
+   "      ostr << \"hddm_" << classPrefix << ".istream(\\\"\"\n"
+   "           << *((_istream*)self)->fname << \"\\\")\";\n"
+   "   else\n"
+   "      ostr << \"hddm_" << classPrefix << ".istream()\";\n"
+   "   ostr << \"\\\'\";\n"
+   "   return PyUnicode_FromString(ostr.str().c_str());\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_istream_iter(PyObject *self)\n"
+   "{\n"
+   "   Py_INCREF(self);\n"
+   "   return self;\n"
+   "}\n"
+   "static PyObject*\n"
+   "_istream_next(PyObject *self)\n"
+   "{\n"
+   "   PyObject *rec = _istream_read(self, 0);\n"
+   "   if (rec == NULL && ! PyErr_Occurred())\n"
+   "      PyErr_SetString(PyExc_StopIteration, \"no more data on input stream\");\n"
+   "   return rec;\n"
+   "}\n"
+   "\n"
+   "\n"
+   "// iterator over batches of records from a hddm_" << classPrefix << ".istream,\n"
+   "// decoded ahead of time on a worker thread that never touches python\n"
+   "\n"
+   "typedef struct {\n"
+   "   PyObject_HEAD\n"
+   "   PyObject *istream_obj;\n"
+   "   int batch_size;\n"
+   "   int prefetch;\n"
+   "   int thread_id;\n"
+   "   pthread_t thread;\n"
+   "   pthread_mutex_t mutex;\n"
+   "   pthread_cond_t filled;\n"
+   "   pthread_cond_t drained;\n"
+   "   std::deque<std::vector<HDDM*> > *ready;\n"
+   "   std::string *error;\n"
+   "   int running;\n"
+   "   int stopping;\n"
+   "   int finished;\n"
+   "} _istreamBatches;\n"
+   "\n"
+   "static void*\n"
+   "_istreamBatches_worker(void *arg)\n"
+   "{\n"
+   "   _istreamBatches *self = (_istreamBatches*)arg;\n"
+   "   istream *istr = ((_istream*)self->istream_obj)->istr;\n"
+   "   // The worker reads in a thread slot of its own, and the reading\n"
+   "   // state of the python thread that created the iterator is handed\n"
+   "   // over to it until the worker exits, so reading carries on from\n"
+   "   // where that thread left off, even inside a compressed block. This\n"
+   "   // is safe because the istream refuses all other use meanwhile.\n"
+   "   std::string error;\n"
+   "   bool more = true;\n"
+   "   try {\n"
+   "      istr->handover(self->thread_id, threads::getID());\n"
+   "   }\n"
+   "   catch (std::exception& e) {\n"
+   "      pthread_mutex_lock(&self->mutex);\n"
+   "      *self->error = e.what();\n"
+   "      self->finished = 1;\n"
+   "      pthread_cond_signal(&self->filled);\n"
+   "      pthread_mutex_unlock(&self->mutex);\n"
+   "      return 0;\n"
+   "   }\n"
+   "   while (more) {\n"
+   "      std::vector<HDDM*> batch;\n"
+   "      batch.reserve(self->batch_size);\n"
+   "      try {\n"
+   "         while ((int)batch.size() < self->batch_size) {\n"
+   "            HDDM *record = new HDDM();\n"
+   "            if (! (*istr >> *record)) {\n"
+   "               delete record;\n"
+   "               more = false;\n"
+   "               break;\n"
+   "            }\n"
+   "            batch.push_back(record);\n"
+   "         }\n"
+   "      }\n"
+   "      catch (std::exception& e) {\n"
+   "         error = e.what();\n"
+   "         more = false;\n"
+   "      }\n"
+   "      pthread_mutex_lock(&self->mutex);\n"
+   "      while ((int)self->ready->size() >= self->prefetch && ! self->stopping)\n"
+   "         pthread_cond_wait(&self->drained, &self->mutex);\n"
+   "      if (self->stopping) {\n"
+   "         for (size_t i=0; i < batch.size(); ++i)\n"
+   "            delete batch[i];\n"
+   "         more = false;\n"
+   "      }\n"
+   "      else if (batch.size() > 0) {\n"
+   "         self->ready->push_back(std::vector<HDDM*>());\n"
+   "         self->ready->back().swap(batch);\n"
+   "      }\n"
+   "      if (! more) {\n"
+   "         *self->error = error;\n"
+   "         self->finished = 1;\n"
+   "      }\n"
+   "      pthread_cond_signal(&self->filled);\n"
+   "      pthread_mutex_unlock(&self->mutex);\n"
+   "   }\n"
+   "   istr->handover(threads::ID, self->thread_id);\n"
+   "   threads::releaseID();\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
+   "static void\n"
+   "_istreamBatches_stop(_istreamBatches *self)\n"
+   "{\n"
+   "   // stop the worker, which hands the istream back to its owner,\n"
+   "   // discarding any batches that were decoded but not yet taken\n"
+   "   if (self->running) {\n"
+   "      pthread_mutex_lock(&self->mutex);\n"
+   "      self->stopping = 1;\n"
+   "      pthread_cond_signal(&self->drained);\n"
+   "      pthread_mutex_unlock(&self->mutex);\n"
+   "      Py_BEGIN_ALLOW_THREADS\n"
+   "      pthread_join(self->thread, 0);\n"
+   "      Py_END_ALLOW_THREADS\n"
+   "      self->running = 0;\n"
+   "   }\n"
+   "   if (self->ready != 0) {\n"
+   "      for (size_t n=0; n < self->ready->size(); ++n)\n"
+   "         for (size_t i=0; i < (*self->ready)[n].size(); ++i)\n"
+   "            delete (*self->ready)[n][i];\n"
+   "      self->ready->clear();\n"
+   "   }\n"
+   "   self->finished = 1;\n"
+   "   if (self->istream_obj != 0) {\n"
+   "      ((_istream*)self->istream_obj)->prefetcher = 0;\n"
+   "      Py_DECREF(self->istream_obj);\n"
+   "      self->istream_obj = 0;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "static void\n"
+   "_istreamBatches_dealloc(_istreamBatches* self)\n"
+   "{\n"
+   "   _istreamBatches_stop(self);\n"
+   "   pthread_mutex_destroy(&self->mutex);\n"
+   "   pthread_cond_destroy(&self->filled);\n"
+   "   pthread_cond_destroy(&self->drained);\n"
+   "   delete self->ready;\n"
+   "   delete self->error;\n"
+   "   Py_TYPE(self)->tp_free((PyObject*)self);\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_istreamBatches_next(PyObject *self)\n"
+   "{\n"
+   "   _istreamBatches *me = (_istreamBatches*)self;\n"
+   "   std::vector<HDDM*> batch;\n"
+   "   std::string error;\n"
+   "   if (me->running) {\n"
+   "      Py_BEGIN_ALLOW_THREADS\n"
+   "      pthread_mutex_lock(&me->mutex);\n"
+   "      while (me->ready->size() == 0 && ! me->finished)\n"
+   "         pthread_cond_wait(&me->filled, &me->mutex);\n"
+   "      if (me->ready->size() > 0) {\n"
+   "         batch.swap(me->ready->front());\n"
+   "         me->ready->pop_front();\n"
+   "         pthread_cond_signal(&me->drained);\n"
+   "      }\n"
+   "      else {\n"
+   "         error.swap(*me->error);\n"
+   "      }\n"
+   "      pthread_mutex_unlock(&me->mutex);\n"
+   "      Py_END_ALLOW_THREADS\n"
+   "   }\n"
+   "   if (batch.size() == 0) {\n"
+   "      _istreamBatches_stop(me);\n"
+   "      if (error.size() > 0)\n"
+   "         PyErr_SetString(PyExc_RuntimeError, error.c_str());\n"
+   "      else\n"
+   "         PyErr_SetString(PyExc_StopIteration, \"no more data on input stream\");\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   PyObject *list = PyList_New(batch.size());\n"
+   "   for (size_t i=0; i < batch.size(); ++i) {\n"
+   "      _HDDM *record_obj = (_HDDM*)_HDDM_new(&_HDDM_type, 0, 0);\n"
+   "      record_obj->elem = batch[i];\n"
+   "      record_obj->host = (PyObject*)record_obj;\n"
+   "      LOG_NEW(Py_TYPE(record_obj), 0, 1);\n"
+   "      PyList_SET_ITEM(list, i, (PyObject*)record_obj);\n"
+   "   }\n"
+   "   return list;\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_istreamBatches_close(PyObject *self, PyObject *args)\n"
+   "{\n"
+   "   _istreamBatches_stop((_istreamBatches*)self);\n"
+   "   Py_INCREF(Py_None);\n"
+   "   return Py_None;\n"
+   "}\n"
+   "\n"
+   "static PyMethodDef _istreamBatches_methods[] = {\n"
+   "   {\"close\",  _istreamBatches_close, METH_NOARGS,\n"
+   "    \"stop reading ahead and release the input stream, discarding\\n\"\n"
+   "    \"any records that were decoded but not yet returned.\"},\n"
+   "   {NULL}  /* Sentinel */\n"
+   "};\n"
+   "\n"
+   "static PyTypeObject _istreamBatches_type = {\n"
+   "    PyVarObject_HEAD_INIT(NULL,0)\n"
+   "    \"hddm_" << classPrefix << ".istreamBatchIterator\",  /*tp_name*/\n"
+   "    sizeof(_istreamBatches),   /*tp_basicsize*/\n"
+   "    0,                         /*tp_itemsize*/\n"
+   "    (destructor)_istreamBatches_dealloc, /*tp_dealloc*/\n"
+   "    0,                         /*tp_print*/\n"
+   "    0,                         /*tp_getattr*/\n"
+   "    0,                         /*tp_setattr*/\n"
+   "    0,                         /*tp_compare*/\n"
+   "    0,                         /*tp_repr*/\n"
+   "    0,                         /*tp_as_number*/\n"
+   "    0,                         /*tp_as_sequence*/\n"
+   "    0,                         /*tp_as_mapping*/\n"
+   "    0,                         /*tp_hash */\n"
+   "    0,                         /*tp_call*/\n"
+   "    0,                         /*tp_str*/\n"
+   "    0,                         /*tp_getattro*/\n"
+   "    0,                         /*tp_setattro*/\n"
+   "    0,                         /*tp_as_buffer*/\n"
+   "    Py_TPFLAGS_DEFAULT,        /*tp_flags*/\n"
+   "    \"hddm_" << classPrefix << " istream batch iterator\",    /* tp_doc */\n"
+   "    0,                         /* tp_traverse */\n"
+   "    0,                         /* tp_clear */\n"
+   "    0,                         /* tp_richcompare */\n"
+   "    0,                         /* tp_weaklistoffset */\n"
+   "    PyObject_SelfIter,         /* tp_iter */\n"
+   "    _istreamBatches_next,      /* tp_iternext */\n"
+   "    _istreamBatches_methods,   /* tp_methods */\n"
+   "};\n"
+   "\n"
+   "static PyObject*\n"
+   "_istream_iter_batches(PyObject *self, PyObject *args, PyObject *kwds)\n"
+   "{\n"
+   "   const char *kwlist[] = {\"n\", \"prefetch\", NULL};\n"
+   "   int batch_size;\n"
+   "   int prefetch = 2;\n"
+   "   if (! PyArg_ParseTupleAndKeywords(args, kwds, \"i|i\", (char**)kwlist,\n"
+   "                                     &batch_size, &prefetch))\n"
+   "   {\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   else if (batch_size < 1 || prefetch < 1) {\n"
+   "      PyErr_SetString(PyExc_ValueError, \"batch size and prefetch count \"\n"
+   "                      \"must be positive\");\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   if (_istream_busy((_istream*)self))\n"
+   "      return NULL;\n"
+   "   else if (((_istream*)self)->istr == 0) {\n"
+   "      PyErr_SetString(PyExc_TypeError, \"unexpected null input stream\");\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   int thread_id;\n"
    "   try {\n"
-   "      Py_BEGIN_ALLOW_THREADS\n"
-   "      *istr >> *record_obj->elem;\n"
-   "      Py_END_ALLOW_THREADS\n"
+   "      thread_id = threads::getID();\n"
    "   }\n"
    "   catch (std::exception& e) {\n"
    "      PyErr_SetString(PyExc_RuntimeError, e.what());\n"
    "      return NULL;\n"
    "   }\n"
-   "   if (*istr) {\n"
-   "      LOG_NEW(Py_TYPE(record_obj), 0, 1);\n"
-   "      return (PyObject*)record_obj;\n"
-   "   }\n"
-   "   return NULL;\n"
-   "}\n"
-   "\n"
-   "static PyObject*\n"
-   "_istream_toString(PyObject *self, PyObject *args=0)\n"
-   "{\n"
-   "   std::stringstream ostr;\n"
-   "   if (((_ostream*)self)->fname != 0)\n"
-   "      ostr << \"hddm_" << classPrefix << ".istream(\\\"\"\n"
-   "           << *((_istream*)self)->fname << \"\\\")\";\n"
-   "   else\n"
-   "      ostr << \"hddm_" << classPrefix << ".istream(NULL)\";\n"
-   "   return PyUnicode_FromString(ostr.str().c_str());\n"
-   "}\n"
-   "\n"
-   "static PyObject*\n"
-   "_istream_toRepr(PyObject *self, PyObject *args=0)\n"
-   "{\n"
-   "   std::stringstream ostr;\n"
-   "   ostr << \"\\\'\";\n"
-   "   if (((_ostream*)self)->fname != 0)\n"
-   "      ostr << \"hddm_" << classPrefix << ".istream(\\\"\"\n"
-   "           << *((_istream*)self)->fname << \"\\\")\";\n"
-   "   else\n"
-   "      ostr << \"hddm_" << classPrefix << ".istream()\";\n"
-   "   ostr << \"\\\'\";\n"
-   "   return PyUnicode_FromString(ostr.str().c_str());\n"
-   "}\n"
-   "\n"
-   "static PyObject*\n"
-   "_istream_iter(PyObject *self)\n"
-   "{\n"
+   "   _istreamBatches *iter = PyObject_New(_istreamBatches,\n"
+   "                                        &_istreamBatches_type);\n"
+   "   if (iter == NULL)\n"
+   "      return NULL;\n"
    "   Py_INCREF(self);\n"
-   "   return self;\n"
-   "}\n"
-   "static PyObject*\n"
-   "_istream_next(PyObject *self)\n"
-   "{\n"
-   "   PyObject *rec = _istream_read(self, 0);\n"
-   "   if (rec == NULL)\n"
-   "      PyErr_SetString(PyExc_StopIteration, \"no more data on input stream\");\n"
-   "   return rec;\n"
+   "   iter->istream_obj = self;\n"
+   "   iter->batch_size = batch_size;\n"
+   "   iter->prefetch = prefetch;\n"
+   "   iter->thread_id = thread_id;\n"
+   "   pthread_mutex_init(&iter->mutex, 0);\n"
+   "   pthread_cond_init(&iter->filled, 0);\n"
+   "   pthread_cond_init(&iter->drained, 0);\n"
+   "   iter->ready = new std::deque<std::vector<HDDM*> >();\n"
+   "   iter->error = new std::string();\n"
+   "   iter->running = 0;\n"
+   "   iter->stopping = 0;\n"
+   "   iter->finished = 0;\n"
+   "   ((_istream*)self)->prefetcher = (PyObject*)iter;\n"
+   "   if (pthread_create(&iter->thread, 0, _istreamBatches_worker, iter) != 0) {\n"
+   "      Py_DECREF(iter);\n"
+   "      PyErr_SetString(PyExc_RuntimeError, \"iter_batches failed to \"\n"
+   "                      \"start its worker thread\");\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   iter->running = 1;\n"
+   "   return (PyObject*)iter;\n"
    "}\n"
    "\n"
    "static PyGetSetDef _istream_getsetters[] = {\n"
@@ -1601,6 +2465,20 @@ int main(int argC, char* argV[])
    "    \"read a HDDM record from the input stream.\"},\n"
    "   {\"skip\",  _istream_skip, METH_VARARGS,\n"
    "    \"skip ahead given number of HDDM records in the input stream.\"},\n"
+   "   {\"read_raw\",  _istream_read_raw, METH_NOARGS,\n"
+   "    \"read the next HDDM record from the input stream without decoding\\n\"\n"
+   "    \"it, as the bytes accepted by HDDM.frombytes, or None at the end.\"},\n"
+   "   {\"to_numpy\",  (PyCFunction)_istream_to_numpy, METH_VARARGS | METH_KEYWORDS,\n"
+   "    \"read attributes of the elements at the end of a tag path like\\n\"\n"
+   "    \"'a/b/c' from the next max_records records into flat arrays.\\n\"\n"
+   "    \"Returns (columns, offsets), with columns a dict of arrays keyed\\n\"\n"
+   "    \"by attribute name and offsets[i] the start of the elements at\\n\"\n"
+   "    \"level i+1 under each element at level i (the record is level 0).\"},\n"
+   "   {\"iter_batches\",  (PyCFunction)_istream_iter_batches, METH_VARARGS | METH_KEYWORDS,\n"
+   "    \"return an iterator over lists of up to n HDDM records, decoded on a\\n\"\n"
+   "    \"worker thread that keeps up to prefetch (default 2) batches ready\\n\"\n"
+   "    \"ahead of the caller. The istream cannot be used for anything else\\n\"\n"
+   "    \"until the iterator is exhausted, closed, or deleted.\"},\n"
    "   {NULL}  /* Sentinel */\n"
    "};\n"
    "\n"
@@ -1975,6 +2853,11 @@ int main(int argC, char* argV[])
    "   PyModule_AddIntConstant(m, \"k_hddm_string\", k_hddm_string);\n"
    "   PyModule_AddIntConstant(m, \"k_hddm_anyURI\", k_hddm_anyURI);\n"
    "   PyModule_AddIntConstant(m, \"k_hddm_Particle_t\", k_hddm_Particle_t);\n"
+   "   PyModule_AddIntConstant(m, \"k_attr_unknown\", k_attr_unknown);\n"
+   "   for (int id=1; id < k_attr_count; ++id) {\n"
+   "      std::string name(attributeName((attr_id)id));\n"
+   "      PyModule_AddIntConstant(m, (\"k_attr_\" + name).c_str(), id);\n"
+   "   }\n"
    "   std::string docstring = HDDM::DocumentString();\n"
    "   PyModule_AddStringConstant(m, \"DocumentString\", docstring.c_str());\n"
    "\n"
@@ -3060,6 +3943,85 @@ void CodeBuilder::writeClassdef(DOMElement* el)
       method_descr meth_clrS = {"clear", "METH_NOARGS",
                                 "clear all contents from this " + tagS};
       methods[clrS] = meth_clrS;
+
+      pyFile << "static PyObject*\n"
+                "_HDDM_tobytes(PyObject *self, PyObject *args)\n"
+                "{\n"
+                "   _HDDM *me = (_HDDM*)self;\n"
+                "   if (me->elem == 0) {\n"
+                "      PyErr_SetString(PyExc_RuntimeError, "
+                "\"lookup attempted on invalid HDDM element\");\n"
+                "      return NULL;\n"
+                "   }\n"
+                "   return _HDDM_encodeRecord(me->elem);\n"
+                "}\n\n"
+                "static PyObject*\n"
+                "_HDDM_frombytes(PyObject *cls, PyObject *args)\n"
+                "{\n"
+                "   PyObject *obj;\n"
+                "   if (! PyArg_ParseTuple(args, \"O\", &obj))\n"
+                "      return NULL;\n"
+                "   PyObject *record_obj = PyObject_CallObject(cls, NULL);\n"
+                "   if (record_obj == NULL)\n"
+                "      return NULL;\n"
+                "   if (_HDDM_decodeRecord(obj, ((_HDDM*)record_obj)->elem) != 0) {\n"
+                "      Py_DECREF(record_obj);\n"
+                "      return NULL;\n"
+                "   }\n"
+                "   return record_obj;\n"
+                "}\n\n"
+                "static PyObject*\n"
+                "_HDDM_getstate(PyObject *self, PyObject *args)\n"
+                "{\n"
+                "   return _HDDM_tobytes(self, args);\n"
+                "}\n\n"
+                "static PyObject*\n"
+                "_HDDM_setstate(PyObject *self, PyObject *args)\n"
+                "{\n"
+                "   _HDDM *me = (_HDDM*)self;\n"
+                "   PyObject *state;\n"
+                "   if (! PyArg_ParseTuple(args, \"O\", &state))\n"
+                "      return NULL;\n"
+                "   else if (me->elem == 0) {\n"
+                "      PyErr_SetString(PyExc_RuntimeError, "
+                "\"lookup attempted on invalid HDDM element\");\n"
+                "      return NULL;\n"
+                "   }\n"
+                "   if (_HDDM_decodeRecord(state, me->elem) != 0)\n"
+                "      return NULL;\n"
+                "   Py_INCREF(Py_None);\n"
+                "   return Py_None;\n"
+                "}\n\n"
+                "static PyObject*\n"
+                "_HDDM_reduce(PyObject *self, PyObject *args)\n"
+                "{\n"
+                "   // pickled as the type, no constructor arguments, and the\n"
+                "   // serialized record as the state passed to __setstate__\n"
+                "   PyObject *state = _HDDM_tobytes(self, 0);\n"
+                "   if (state == NULL)\n"
+                "      return NULL;\n"
+                "   return Py_BuildValue(\"O()N\", (PyObject*)Py_TYPE(self), state);\n"
+                "}\n\n"
+                ;
+      method_descr meth_tobytes = {"tobytes", "METH_NOARGS",
+                                   "serialize this " + tagS + " record to bytes"};
+      methods["_HDDM_tobytes"] = meth_tobytes;
+      method_descr meth_frombytes = {"frombytes", "METH_VARARGS | METH_CLASS",
+                                     "new " + tagS + " record from the bytes "
+                                     "made by tobytes, or any object with the "
+                                     "same contents that supports the buffer "
+                                     "protocol"};
+      methods["_HDDM_frombytes"] = meth_frombytes;
+      method_descr meth_getstate = {"__getstate__", "METH_NOARGS",
+                                    "pickle support, same as tobytes"};
+      methods["_HDDM_getstate"] = meth_getstate;
+      method_descr meth_setstate = {"__setstate__", "METH_VARARGS",
+                                    "pickle support, replace the contents "
+                                    "of this record with serialized bytes"};
+      methods["_HDDM_setstate"] = meth_setstate;
+      method_descr meth_reduce = {"__reduce__", "METH_NOARGS",
+                                  "pickle support"};
+      methods["_HDDM_reduce"] = meth_reduce;
    }
 
    XtString strS("_" + tagS.simpleType() + "_toString");
@@ -3074,8 +4036,9 @@ void CodeBuilder::writeClassdef(DOMElement* el)
              " element\");\n"
              "      return NULL;\n"
              "   }\n"
-             "   std::string str(me->elem->toString());\n"
-             "   return PyUnicode_FromString(str.c_str());\n"
+             "   buffersink sink;\n"
+             "   me->elem->writeString(sink);\n"
+             "   return PyUnicode_FromStringAndSize(sink.data(), sink.size());\n"
              "}\n\n"
              ;
    method_descr str_method = {"toString", "METH_NOARGS",
@@ -3094,8 +4057,9 @@ void CodeBuilder::writeClassdef(DOMElement* el)
              " element\");\n"
              "      return NULL;\n"
              "   }\n"
-             "   std::string str(me->elem->toXML());\n"
-             "   return PyUnicode_FromString(str.c_str());\n"
+             "   buffersink sink;\n"
+             "   me->elem->writeXML(sink);\n"
+             "   return PyUnicode_FromStringAndSize(sink.data(), sink.size());\n"
              "}\n\n"
              ;
    method_descr xml_method = {"toXML", "METH_NOARGS",
@@ -3258,21 +4222,459 @@ void CodeBuilder::constructGroup(DOMElement* el)
    }
 }
 
-/* Write method implementation of the classes for this tag */
+/* Write the column collectors for this tag, templated so that
+ * the same code walks either a decoded record or a record view
+ */
 
 void CodeBuilder::writeClassimp(DOMElement* el)
 {
+   XtString tagS(el->getTagName());
+   XtString typeS(tagS.simpleType());
+
+   pyFile <<
+   "// collect columns of " << tagS << " attributes\n"
+   "\n"
+   "static const char *_" << typeS << "_children[] = {";
+   parentList_t::iterator citer;
+   for (citer = children[tagS].begin(); citer != children[tagS].end(); ++citer)
+   {
+      XtString cnameS(((DOMElement*)(*citer))->getTagName());
+      pyFile << "\"" << cnameS << "\", ";
+   }
+   pyFile << "0};\n"
+   "\n"
+   "static hddm_type\n"
+   "_" << typeS << "_columnType(attr_id id)\n"
+   "{\n"
+   "   switch (id) {\n"
+   ;
+
+   std::map<XtString,XtString> columns;
+   DOMNamedNodeMap *myAttr = el->getAttributes();
+   for (unsigned int n = 0; n < myAttr->getLength(); n++)
+   {
+      XtString attrS(myAttr->item(n)->getNodeName());
+      XtString atypeS(el->getAttribute(X(attrS)));
+      if (atypeS == "int" || atypeS == "long" || atypeS == "float" ||
+          atypeS == "double" || atypeS == "boolean" || atypeS == "string" ||
+          atypeS == "anyURI" || atypeS == "Particle_t")
+      {
+         pyFile << "    case k_attr_" << attrS << ":\n"
+                   "      return k_hddm_" << atypeS << ";\n";
+         if (atypeS != "string" && atypeS != "anyURI")
+         {
+            columns[attrS] = atypeS;
+         }
+      }
+   }
+
+   pyFile <<
+   "    default:\n"
+   "      break;\n"
+   "   }\n"
+   "   return k_hddm_unknown;\n"
+   "}\n"
+   "\n"
+   "template <class E>\n"
+   "static void\n"
+   "_" << typeS << "_collect(_HDDM_ColumnSet &cs, E &&elem, int level)\n"
+   "{\n"
+   "   ++cs.count[level];\n"
+   "   if (level == cs.depth) {\n"
+   "      for (size_t i=0; i < cs.columns.size(); ++i) {\n"
+   "         _HDDM_Column &col = cs.columns[i];\n"
+   "         switch (col.id) {\n"
+   ;
+   std::map<XtString,XtString>::iterator aiter;
+   for (aiter = columns.begin(); aiter != columns.end(); ++aiter)
+   {
+      XtString attrS(aiter->first);
+      XtString getS("get" + attrS.simpleType());
+      pyFile << "          case k_attr_" << attrS << ":\n"
+                "            col.put("
+             << ((aiter->second == "Particle_t")? "(int)" : "")
+             << "elem." << getS << "());\n"
+                "            break;\n";
+   }
+   pyFile <<
+   "          default:\n"
+   "            break;\n"
+   "         }\n"
+   "      }\n"
+   "      return;\n"
+   "   }\n"
+   "   switch (cs.path[level]) {\n"
+   ;
+   int c = 0;
+   for (citer = children[tagS].begin(); citer != children[tagS].end(); ++citer)
+   {
+      XtString cnameS(((DOMElement*)(*citer))->getTagName());
+      pyFile << "    case " << c++ << ":\n"
+                "      for (auto &&child : elem.get"
+             << cnameS.plural().simpleType() << "())\n"
+                "         _" << cnameS.simpleType()
+             << "_collect(cs, child, level + 1);\n"
+                "      break;\n";
+   }
+   pyFile <<
+   "    default:\n"
+   "      break;\n"
+   "   }\n"
+   "   cs.offsets[level].push_back(cs.count[level + 1]);\n"
+   "}\n"
+   "\n"
+   ;
+
+   // list columns can also be read from the attributes inherited from
+   // the host elements, but only the element's own ones can be set
+
+   std::map<XtString,XtString> listColumns(columns);
+   for (citer = parents[tagS].begin(); citer != parents[tagS].end(); ++citer)
+   {
+      DOMElement *hostEl = (DOMElement*)(*citer);
+      DOMNamedNodeMap *hostAttr = hostEl->getAttributes();
+      for (unsigned int n = 0; n < hostAttr->getLength(); n++)
+      {
+         XtString attrS(hostAttr->item(n)->getNodeName());
+         XtString atypeS(hostEl->getAttribute(X(attrS)));
+         if (listColumns.find(attrS) == listColumns.end() &&
+             XtString(el->getAttribute(X(attrS))).size() == 0 &&
+             (atypeS == "int" || atypeS == "long" || atypeS == "float" ||
+              atypeS == "double" || atypeS == "boolean" ||
+              atypeS == "Particle_t"))
+         {
+            listColumns[attrS] = atypeS;
+         }
+      }
+   }
+
+   pyFile <<
+   "static bool\n"
+   "_" << typeS << "_getColumn(HDDM_ElementList<HDDM_Element> *list, "
+   "_HDDM_Column &col)\n"
+   "{\n"
+   ;
+   if (listColumns.size() > 0)
+   {
+      pyFile << "   " << tagS.listType() << " &elems = *("
+             << tagS.listType() << "*)list;\n";
+   }
+   pyFile <<
+   "   switch (col.id) {\n"
+   ;
+   for (aiter = listColumns.begin(); aiter != listColumns.end(); ++aiter)
+   {
+      XtString attrS(aiter->first);
+      XtString getS("get" + attrS.simpleType());
+      pyFile << "    case k_attr_" << attrS << ":\n"
+                "      col.type = k_hddm_" << aiter->second << ";\n"
+                "      for (auto &&elem : elems)\n"
+                "         col.put("
+             << ((aiter->second == "Particle_t")? "(int)" : "")
+             << "elem." << getS << "());\n"
+                "      return true;\n";
+   }
+   pyFile <<
+   "    default:\n"
+   "      return false;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "static void\n"
+   "_" << typeS << "_setColumn(HDDM_ElementList<HDDM_Element> *list, "
+   "attr_id id, const char *data)\n"
+   "{\n"
+   ;
+   if (columns.size() > 0)
+   {
+      pyFile << "   " << tagS.listType() << " &elems = *("
+             << tagS.listType() << "*)list;\n";
+   }
+   pyFile <<
+   "   switch (id) {\n"
+   ;
+   for (aiter = columns.begin(); aiter != columns.end(); ++aiter)
+   {
+      XtString attrS(aiter->first);
+      XtString setS("set" + attrS.simpleType());
+      XtString ctypeS;
+      XtString valueS("*values++");
+      if (aiter->second == "int")
+         ctypeS = "int32_t";
+      else if (aiter->second == "long")
+         ctypeS = "int64_t";
+      else if (aiter->second == "float")
+         ctypeS = "float";
+      else if (aiter->second == "double")
+         ctypeS = "double";
+      else if (aiter->second == "boolean")
+      {
+         ctypeS = "unsigned char";
+         valueS = "(*values++ != 0)";
+      }
+      else
+      {
+         ctypeS = "int32_t";
+         valueS = "(Particle_t)*values++";
+      }
+      pyFile << "    case k_attr_" << attrS << ": {\n"
+                "      const " << ctypeS << " *values = (const "
+             << ctypeS << "*)data;\n"
+                "      for (auto &&elem : elems)\n"
+                "         elem." << setS << "(" << valueS << ");\n"
+                "      break;\n"
+                "    }\n";
+   }
+   pyFile <<
+   "    default:\n"
+   "      break;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   ;
 }
 
 /* Generate implementation code for data model classes */
 
 void CodeBuilder::constructMethods(DOMElement* el)
 {
+   pyFile << "\n\n";
    std::vector<DOMElement*>::iterator iter;
    for (iter = tagList.begin(); iter != tagList.end(); iter++)
    {
       writeClassimp(*iter);
    }
+
+   pyFile <<
+   "static _HDDM_ElementInfo _HDDM_elementInfo[] = {\n";
+   for (iter = tagList.begin(); iter != tagList.end(); iter++)
+   {
+      XtString tagS((*iter)->getTagName());
+      pyFile << "   {\"" << tagS << "\", "
+             << "_" << tagS.simpleType() << "_children, "
+             << "_" << tagS.simpleType() << "_columnType,\n"
+             << "    &_" << tagS.simpleType() << "_type, "
+             << "_" << tagS.simpleType() << "_getColumn, "
+             << "_" << tagS.simpleType() << "_setColumn},\n";
+   }
+   pyFile <<
+   "   {0, 0, 0, 0, 0, 0}\n"
+   "};\n"
+   "\n"
+   "static const _HDDM_ElementInfo*\n"
+   "_HDDM_ElementInfo_lookup(const std::string &tag)\n"
+   "{\n"
+   "   for (int i=0; _HDDM_elementInfo[i].tag != 0; ++i) {\n"
+   "      if (tag == _HDDM_elementInfo[i].tag)\n"
+   "         return &_HDDM_elementInfo[i];\n"
+   "   }\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
+   "static int\n"
+   "_HDDM_ColumnSet_setup(_HDDM_ColumnSet &cs, const char *path, PyObject *attrs)\n"
+   "{\n"
+   "   const _HDDM_ElementInfo *info = _HDDM_ElementInfo_lookup(\"HDDM\");\n"
+   "   std::stringstream spath(path);\n"
+   "   std::string tag;\n"
+   "   cs.depth = 0;\n"
+   "   while (std::getline(spath, tag, '/')) {\n"
+   "      if (tag.size() == 0 || (cs.depth == 0 && tag == \"HDDM\"))\n"
+   "         continue;\n"
+   "      int child;\n"
+   "      for (child=0; info->children[child] != 0; ++child) {\n"
+   "         if (tag == info->children[child])\n"
+   "            break;\n"
+   "      }\n"
+   "      if (info->children[child] == 0) {\n"
+   "         PyErr_Format(PyExc_ValueError, \"no %s element inside %s\",\n"
+   "                      tag.c_str(), info->tag);\n"
+   "         return -1;\n"
+   "      }\n"
+   "      cs.path.push_back(child);\n"
+   "      info = _HDDM_ElementInfo_lookup(tag);\n"
+   "      ++cs.depth;\n"
+   "   }\n"
+   "   if (cs.depth == 0) {\n"
+   "      PyErr_SetString(PyExc_ValueError, \"empty element path\");\n"
+   "      return -1;\n"
+   "   }\n"
+   "   PyObject *names;\n"
+   "   if (PyUnicode_Check(attrs))\n"
+   "      names = PyTuple_Pack(1, attrs);\n"
+   "   else\n"
+   "      names = PySequence_Fast(attrs, \"attributes must be a list of names\");\n"
+   "   if (names == NULL)\n"
+   "      return -1;\n"
+   "   Py_ssize_t nnames = PySequence_Fast_GET_SIZE(names);\n"
+   "   for (Py_ssize_t i=0; i < nnames; ++i) {\n"
+   "      PyObject *name = PySequence_Fast_GET_ITEM(names, i);\n"
+   "      const char *sname = (PyUnicode_Check(name))? PyUnicode_AsUTF8(name) : 0;\n"
+   "      if (sname == 0) {\n"
+   "         PyErr_SetString(PyExc_TypeError, \"attribute names must be strings\");\n"
+   "         Py_DECREF(names);\n"
+   "         return -1;\n"
+   "      }\n"
+   "      _HDDM_Column col;\n"
+   "      col.name = sname;\n"
+   "      col.id = lookupAttribute(col.name);\n"
+   "      col.type = info->columnType(col.id);\n"
+   "      if (col.type == k_hddm_unknown) {\n"
+   "         PyErr_Format(PyExc_ValueError, \"%s element has no attribute %s\",\n"
+   "                      info->tag, sname);\n"
+   "         Py_DECREF(names);\n"
+   "         return -1;\n"
+   "      }\n"
+   "      else if (col.type == k_hddm_string || col.type == k_hddm_anyURI) {\n"
+   "         PyErr_Format(PyExc_TypeError, \"%s attribute %s is a string,\"\n"
+   "                      \" only numeric attributes can be stored in arrays\",\n"
+   "                      info->tag, sname);\n"
+   "         Py_DECREF(names);\n"
+   "         return -1;\n"
+   "      }\n"
+   "      cs.columns.push_back(col);\n"
+   "   }\n"
+   "   Py_DECREF(names);\n"
+   "   cs.count.assign(cs.depth + 1, 0);\n"
+   "   cs.offsets.assign(cs.depth, std::vector<int64_t>(1, 0));\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_HDDM_ColumnSet_toPython(_HDDM_ColumnSet &cs)\n"
+   "{\n"
+   "   PyObject *columns = PyDict_New();\n"
+   "   PyObject *offsets = PyList_New(cs.depth);\n"
+   "   PyObject *result = Py_BuildValue(\"(NN)\", columns, offsets);\n"
+   "   if (result == NULL)\n"
+   "      return NULL;\n"
+   "   for (size_t i=0; i < cs.columns.size(); ++i) {\n"
+   "      _HDDM_Column &col = cs.columns[i];\n"
+   "      PyObject *array = _HDDM_makeArray(col.type, col.data.data(),\n"
+   "                                        col.data.size());\n"
+   "      if (array == NULL ||\n"
+   "          PyDict_SetItemString(columns, col.name.c_str(), array) != 0)\n"
+   "      {\n"
+   "         Py_XDECREF(array);\n"
+   "         Py_DECREF(result);\n"
+   "         return NULL;\n"
+   "      }\n"
+   "      Py_DECREF(array);\n"
+   "      std::vector<char>().swap(col.data);\n"
+   "   }\n"
+   "   for (int level=0; level < cs.depth; ++level) {\n"
+   "      std::vector<int64_t> &offs = cs.offsets[level];\n"
+   "      PyObject *array = _HDDM_makeArray(k_hddm_long, offs.data(),\n"
+   "                                        offs.size() * sizeof(int64_t));\n"
+   "      if (array == NULL) {\n"
+   "         Py_DECREF(result);\n"
+   "         return NULL;\n"
+   "      }\n"
+   "      PyList_SET_ITEM(offsets, level, array);\n"
+   "   }\n"
+   "   return result;\n"
+   "}\n"
+   "\n"
+   "static const _HDDM_ElementInfo*\n"
+   "_HDDM_ElementList_info(_HDDM_ElementList *me)\n"
+   "{\n"
+   "   if (me->list == 0) {\n"
+   "      PyErr_SetString(PyExc_RuntimeError, \"unexpected null list\");\n"
+   "      return 0;\n"
+   "   }\n"
+   "   for (int i=0; _HDDM_elementInfo[i].tag != 0; ++i) {\n"
+   "      if (me->subtype == _HDDM_elementInfo[i].type)\n"
+   "         return &_HDDM_elementInfo[i];\n"
+   "   }\n"
+   "   PyErr_SetString(PyExc_TypeError, \"unexpected list element type\");\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_HDDM_ElementList_column(PyObject *self, PyObject *args)\n"
+   "{\n"
+   "   // one pass over the c++ list, without a python object per element\n"
+   "   char *name;\n"
+   "   if (! PyArg_ParseTuple(args, \"s\", &name))\n"
+   "      return NULL;\n"
+   "   _HDDM_ElementList *me = (_HDDM_ElementList*)self;\n"
+   "   const _HDDM_ElementInfo *info = _HDDM_ElementList_info(me);\n"
+   "   if (info == 0)\n"
+   "      return NULL;\n"
+   "   _HDDM_Column col;\n"
+   "   col.name = name;\n"
+   "   col.id = lookupAttribute(col.name);\n"
+   "   col.data.reserve(me->list->size() * sizeof(double));\n"
+   "   if (! info->getColumn(me->list, col)) {\n"
+   "      hddm_type type = info->columnType(col.id);\n"
+   "      if (type == k_hddm_string || type == k_hddm_anyURI)\n"
+   "         PyErr_Format(PyExc_TypeError, \"%s attribute %s is a string,\"\n"
+   "                      \" only numeric attributes can be stored in arrays\",\n"
+   "                      info->tag, name);\n"
+   "      else\n"
+   "         PyErr_Format(PyExc_ValueError, \"%s element has no attribute %s\",\n"
+   "                      info->tag, name);\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   return _HDDM_makeArray(col.type, col.data.data(), col.data.size());\n"
+   "}\n"
+   "\n"
+   "static PyObject*\n"
+   "_HDDM_ElementList_setColumn(PyObject *self, PyObject *args)\n"
+   "{\n"
+   "   char *name;\n"
+   "   PyObject *values;\n"
+   "   if (! PyArg_ParseTuple(args, \"sO\", &name, &values))\n"
+   "      return NULL;\n"
+   "   _HDDM_ElementList *me = (_HDDM_ElementList*)self;\n"
+   "   const _HDDM_ElementInfo *info = _HDDM_ElementList_info(me);\n"
+   "   if (info == 0)\n"
+   "      return NULL;\n"
+   "   attr_id id = lookupAttribute(name);\n"
+   "   hddm_type type = info->columnType(id);\n"
+   "   if (type == k_hddm_unknown) {\n"
+   "      _HDDM_Column col;\n"
+   "      col.id = id;\n"
+   "      if (info->getColumn(me->list, col))\n"
+   "         PyErr_Format(PyExc_AttributeError, \"%s attribute %s is inherited\"\n"
+   "                      \" from a host element and cannot be set here\",\n"
+   "                      info->tag, name);\n"
+   "      else\n"
+   "         PyErr_Format(PyExc_ValueError, \"%s element has no attribute %s\",\n"
+   "                      info->tag, name);\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   else if (type == k_hddm_string || type == k_hddm_anyURI) {\n"
+   "      PyErr_Format(PyExc_TypeError, \"%s attribute %s is a string,\"\n"
+   "                   \" only numeric attributes can be set from arrays\",\n"
+   "                   info->tag, name);\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   Py_ssize_t count = me->list->size();\n"
+   "   PyObject *array = _HDDM_toArray(type, values, count);\n"
+   "   if (array == NULL)\n"
+   "      return NULL;\n"
+   "   const char *dtype;\n"
+   "   const char *typecode;\n"
+   "   size_t itemsize = _HDDM_arrayType(type, &dtype, &typecode);\n"
+   "   Py_buffer view;\n"
+   "   if (PyObject_GetBuffer(array, &view, PyBUF_C_CONTIGUOUS) != 0) {\n"
+   "      Py_DECREF(array);\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   else if (view.len != (Py_ssize_t)(count * itemsize)) {\n"
+   "      PyErr_Format(PyExc_ValueError, \"expected %zd values\", count);\n"
+   "      PyBuffer_Release(&view);\n"
+   "      Py_DECREF(array);\n"
+   "      return NULL;\n"
+   "   }\n"
+   "   info->setColumn(me->list, id, (const char*)view.buf);\n"
+   "   PyBuffer_Release(&view);\n"
+   "   Py_DECREF(array);\n"
+   "   Py_INCREF(Py_None);\n"
+   "   return Py_None;\n"
+   "}\n"
+   ;
 }
 
 /* Generate methods for serializing classes to a stream and back again */
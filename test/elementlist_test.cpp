@@ -0,0 +1,97 @@
+// Element lists that belong to sibling parents share a single host list,
+// one after the other. Once a list is long enough to be indexed, edits
+// made through its sibling at their common boundary must not disturb it,
+// and sorting it through its range of pointers must leave the elements
+// and their children where they belong.
+
+#include <hddm_x.hpp>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+#define CHECK(cond) \
+   if (!(cond)) { \
+      std::cerr << "elementlist_test: check failed at line " << __LINE__ \
+                << ": " #cond << std::endl; \
+      exit(1); \
+   }
+
+static int count(hddm_x::CourseList &courses) {
+   int n = 0;
+   for (auto it = courses.begin(); it != courses.end(); ++it)
+      ++n;
+   return n;
+}
+
+int main() {
+   hddm_x::HDDM record;
+   hddm_x::StudentList students = record.addStudents();
+   hddm_x::EnrolledList enrolled = students().addEnrolleds(2);
+   hddm_x::CourseList first = enrolled(0).addCourses(20);
+   for (int i=0; i < 20; ++i)
+      first(i).setCredits(i);
+   hddm_x::CourseList second = enrolled(1).addCourses(3);
+   for (int i=0; i < 3; ++i)
+      second(i).setCredits(100 + i);
+
+   // walking the first list indexes it
+   CHECK(count(first) == 20);
+   CHECK(first(19).getCredits() == 19);
+
+   // insert at the front of the second list, right behind the first one
+   hddm_x::CourseList added = enrolled(1).addCourses(2, 0);
+   added(0).setCredits(200);
+   added(1).setCredits(201);
+   CHECK(count(first) == 20);
+   CHECK(first.end() == enrolled(0).getCourses().end());
+   int credits = 0;
+   for (auto it = first.begin(); it != first.end(); ++it)
+      CHECK(it->getCredits() == credits++);
+
+   // erase the tail of the first list, then the front of the second
+   enrolled(0).deleteCourses(15, 5);
+   CHECK(enrolled(0).getCourses().size() == 5);
+   hddm_x::CourseList rest = enrolled(1).getCourses();
+   CHECK(rest.size() == 5);
+   CHECK(rest(0).getCredits() == 200);
+   CHECK(rest(2).getCredits() == 100);
+   enrolled(1).deleteCourses(2, 0);
+   hddm_x::CourseList head = enrolled(0).getCourses();
+   CHECK(count(head) == 5);
+   CHECK(head(4).getCredits() == 4);
+   CHECK(enrolled(1).getCourses()(0).getCredits() == 100);
+
+   // sort a long list in reverse through its pointers, next to a sibling
+   hddm_x::CourseList many = enrolled(0).addCourses(40);
+   for (int i=0; i < 40; ++i) {
+      many(i).setCredits(i);
+      many(i).addResults();
+      many(i).getResult().setGrade(std::to_string(i));
+   }
+   hddm_x::CourseList all = enrolled(0).getCourses();
+   CHECK(all.size() == 45);
+   auto ptrs = all.pointers();
+   std::sort(ptrs.begin(), ptrs.end(),
+             [](const hddm_x::Course *a, const hddm_x::Course *b) {
+                return a->getCredits() > b->getCredits();
+             });
+   all = enrolled(0).getCourses();
+   CHECK(count(all) == 45);
+   for (int i=1; i < 45; ++i)
+      CHECK(all(i - 1).getCredits() >= all(i).getCredits());
+   CHECK(all(0).getCredits() == 39);
+   CHECK(all(0).getResult().getGrade() == "39");
+   CHECK(enrolled(1).getCourses()(0).getCredits() == 100);
+   auto found = std::lower_bound(all.begin(), all.end(), 20,
+             [](const hddm_x::Course &c, int credits) {
+                return c.getCredits() > credits;
+             });
+   CHECK(found - all.begin() == 19);
+   CHECK(found->getResult().getGrade() == "20");
+   enrolled(0).deleteCourses();
+   CHECK(enrolled(0).getCourses().size() == 0);
+   CHECK(count(rest = enrolled(1).getCourses()) == 3);
+
+   std::cout << "elementlist_test: all checks passed" << std::endl;
+   return 0;
+}
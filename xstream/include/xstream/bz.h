@@ -15,6 +15,11 @@
 #include <streambuf>
 
 namespace xstream{
+
+namespace fd{
+class preadbuf;
+}
+
 /*!
  * \brief bzip2 compression/decompression objects
  *
@@ -175,6 +180,7 @@ class istreambuf: public common, public std::streambuf {
             char buf[64];
         } leftovers_buf;
         leftovers_buf *leftovers;
+        xstream::fd::preadbuf *blocks; /*!< shared positional reader, if any */
 
         /*!
          * \brief inspect bzlib error status and raise exception in case of error
@@ -10,6 +10,13 @@
 /* if file descriptor support exists */
 #define HAVE_FD 1
 
+/* if the linux io_uring interface is available */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
 /* Define to 1 if you have the <inttypes.h> header file. */
 #define HAVE_INTTYPES_H 1
 
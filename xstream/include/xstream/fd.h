@@ -13,6 +13,9 @@
 #include <xstream/posix.h>
 #include <streambuf>
 #include <set>
+#include <atomic>
+#include <vector>
+#include <pthread.h>
 
 namespace xstream{
 
@@ -87,6 +90,239 @@ class streambuf: public xstream::ostreambuf, private xstream::posix::fd {
 
 };
 
+/*!
+ * \brief positional read streambuf that can be shared between threads
+ *
+ * reads from a file descriptor with \c pread at a shared cursor that is
+ * advanced atomically, so several readers can consume the same file
+ * at once without serializing on the file position. Besides the usual
+ * streambuf interface, a reader can look at the data at the cursor
+ * and then claim it, or claim a whole size-prefixed block in one step.
+ *
+ * \note the get area is only meant for sequential use by one thread,
+ * eg. for reading a file header, and is dropped by any seek
+ *
+ */
+class preadbuf: public std::streambuf {
+    private:
+        int fdn; /*!< the actual file descriptor */
+        bool dest_close; /*!< if close should be called at destruction time */
+        std::atomic<std::streamoff> cursor; /*!< next unclaimed byte in the file */
+        xstream::buffer rbuf; /*!< were buffered read data is stored */
+        pthread_mutex_t seek_mutex; /*!< guards seek+read where \c pread is missing */
+
+        /*!
+         * \brief returns the cursor, waiting while it is held by lock()
+         */
+        std::streamoff current();
+
+        /*!
+         * \brief requests that input buffer be reloaded (overloaded from streambuf)
+         */
+        int underflow();
+
+        /*!
+         * \brief reads \c n characters to \c buffer (overloaded from streambuf)
+         *
+         */
+        std::streamsize xsgetn(char *buffer, std::streamsize n);
+
+        /*!
+         * \brief moves or reports the cursor (overloaded from streambuf)
+         *
+         */
+        std::streampos seekoff(std::streamoff off, std::ios_base::seekdir dir,
+                               std::ios_base::openmode which);
+
+        /*!
+         * \brief moves the cursor (overloaded from streambuf)
+         *
+         */
+        std::streampos seekpos(std::streampos pos, std::ios_base::openmode which);
+
+    public:
+        /*!
+         * \brief construct specifying the file descriptor
+         *
+         * \param fd filedescriptor, reading starts at its current offset
+         * \param close if true closes the file descriptor at destruction
+         */
+        preadbuf(int fd, bool close=true);
+
+        /*!
+         * \brief closes the file descriptor if requested
+         *
+         */
+        ~preadbuf();
+
+        /*!
+         * \brief reads up to \c n bytes at offset \c pos, cursor is unchanged
+         *
+         * \return number of bytes read, less than \c n only at end of file
+         */
+        std::streamsize pread(char *buffer, std::streamsize n, std::streamoff pos);
+
+        /*!
+         * \brief returns the offset of the next unclaimed byte
+         *
+         */
+        std::streamoff tell();
+
+        /*!
+         * \brief claims \c n bytes starting at \c pos
+         *
+         * \return false if the cursor has moved away from \c pos, ie. some
+         * other reader claimed that data first
+         */
+        bool claim(std::streamoff pos, std::streamsize n);
+
+        /*!
+         * \brief holds the cursor at \c pos until unlock is called
+         *
+         * other readers wait instead of claiming anything beyond \c pos,
+         * which gives the caller a chance to act on data at \c pos that
+         * changes how the data after it must be read
+         *
+         * \return false if the cursor has already moved away from \c pos
+         */
+        bool lock(std::streamoff pos);
+
+        /*!
+         * \brief releases a lock taken by lock(), moving the cursor to \c pos
+         *
+         */
+        void unlock(std::streamoff pos);
+
+        /*!
+         * \brief claims and reads the next block prefixed by its size
+         *
+         * the block is expected to start with a 4-byte big-endian size
+         * whose leading byte is zero, as written by the compressing
+         * streambufs in this library
+         *
+         * \param start receives the file offset of the block
+         * \param buffer where the block contents are stored
+         * \param n size of \c buffer
+         *
+         * \return size of the block, 0 at end of file, or -1 if the data
+         * at the cursor are not a sized block that fits in \c buffer
+         */
+        std::streamsize claim_block(std::streamoff &start, char *buffer,
+                                    std::streamsize n);
+};
+
+#if HAVE_IO_URING
+
+/*!
+ * \brief read-ahead streambuf that keeps many reads in flight with io_uring
+ *
+ * reads a file sequentially in chunks, keeping up to \c depth of them
+ * queued in the kernel ahead of the reader so that the device sees a
+ * deep queue instead of one synchronous read at a time. After a seek the
+ * read-ahead starts again with a single chunk and doubles with each chunk
+ * consumed, so random access does not pay for a full window of reads it
+ * never uses. If the kernel refuses io_uring, each chunk is read with
+ * \c pread when it is queued instead.
+ *
+ * \note like any other streambuf, it is meant for one reader at a time
+ *
+ */
+class uringbuf: public std::streambuf {
+    private:
+        struct ring; /*!< kernel submission and completion queues */
+
+        typedef struct {
+            char *buf; /*!< chunk data */
+            std::streamoff offset; /*!< file offset of the chunk */
+            std::streamsize result; /*!< bytes read, once complete */
+            bool busy; /*!< read still in flight */
+            bool submitted; /*!< holds a queued chunk not yet consumed */
+        } chunk_slot;
+
+        int fdn; /*!< the actual file descriptor */
+        bool dest_close; /*!< if close should be called at destruction time */
+        ring *uring; /*!< null if reads are done synchronously */
+        std::vector<chunk_slot> slots; /*!< circular queue of chunks */
+        std::streamsize chunk_size; /*!< bytes per read */
+        int window; /*!< number of chunks to keep queued */
+        int head; /*!< slot being consumed */
+        int queued; /*!< slots in use, counting from head */
+        bool current; /*!< if the get area points into the head slot */
+        std::streamoff next_offset; /*!< file offset of the next chunk to queue */
+        std::streamoff get_offset; /*!< logical position when not current */
+        std::streamoff end_offset; /*!< end of file, once it has been seen */
+
+        /*!
+         * \brief queues a read of the next chunk into slot \c n
+         */
+        void submit(int n);
+
+        /*!
+         * \brief waits until the kernel is done with slot \c n
+         *
+         * \return false if the ring failed, leaving the read in flight
+         */
+        bool reap(int n);
+
+        /*!
+         * \brief waits until the read into slot \c n is complete
+         */
+        void complete(int n);
+
+        /*!
+         * \brief drops all queued chunks and restarts reading at \c pos
+         */
+        void restart(std::streamoff pos);
+
+        /*!
+         * \brief requests that input buffer be reloaded (overloaded from streambuf)
+         */
+        int underflow();
+
+        /*!
+         * \brief moves or reports the read position (overloaded from streambuf)
+         *
+         */
+        std::streampos seekoff(std::streamoff off, std::ios_base::seekdir dir,
+                               std::ios_base::openmode which);
+
+        /*!
+         * \brief moves the read position (overloaded from streambuf)
+         *
+         */
+        std::streampos seekpos(std::streampos pos, std::ios_base::openmode which);
+
+    public:
+        /*!
+         * \brief construct specifying the file descriptor
+         *
+         * \param fd filedescriptor, reading starts at its current offset
+         * \param close if true closes the file descriptor at destruction
+         * \param depth maximum number of reads kept in flight
+         * \param chunk size of each read, best chosen to hold several
+         * compressed blocks or records of the data being read
+         */
+        uringbuf(int fd, bool close=true, int depth=16,
+                 std::streamsize chunk=1024*1024);
+
+        /*!
+         * \brief waits for reads in flight and closes the ring
+         *
+         * never throws; a chunk whose read cannot be reaped is leaked
+         * rather than freed under the kernel
+         */
+        ~uringbuf();
+
+        /*!
+         * \brief returns true if reads are going through io_uring
+         *
+         */
+        bool is_async() const {
+            return uring != 0;
+        }
+};
+
+#endif
 
 }//namespace fd
 }//namespace xstream
@@ -17,6 +17,11 @@
 #include <sstream>
 
 namespace xstream{
+
+namespace fd{
+class preadbuf;
+}
+
 /*!
  * \brief zlib's compression/decompression (inflate/deflate) classes
  *
@@ -210,6 +215,7 @@ class istreambuf: public common, public std::streambuf{
             char buf[64];
         } leftovers_buf;
         leftovers_buf *leftovers;
+        xstream::fd::preadbuf *blocks; /*!< shared positional reader, if any */
 
         /*!
          * \brief requests that input buffer be reloaded (overloaded from streambuf)
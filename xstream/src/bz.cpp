@@ -15,6 +15,7 @@
 #include <cassert>
 
 #include <xstream/bz.h>
+#include <xstream/fd.h>
 #include <xstream/except/bz.h>
 
 #include <bzlib.h>
@@ -435,7 +436,7 @@ namespace bz {
     istreambuf::istreambuf(std::streambuf *sb, int *left, unsigned int left_size)
     : common(sb), end(false), block_size(0), block_next(0), 
       new_block_start(0), new_block_offset(0),
-      leftovers(0)
+      leftovers(0), blocks(0)
     {
         LOG("bz::istreambuf");
         int cret =::BZ2_bzDecompressInit(z_strm,
@@ -452,6 +453,9 @@ namespace bz {
         //no buffering
         setg(out.buf, out.buf, out.buf);
         block_start = _sb->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+#if HAVE_FD
+        blocks = dynamic_cast<xstream::fd::preadbuf*>(sb);
+#endif
 
         if (left_size >= sizeof(leftovers_buf)) {
             leftovers = (leftovers_buf*)left;
@@ -603,6 +607,31 @@ namespace bz {
         LOG("bz::istreambuf::read_decompress ");
         bool reinit_decompressor = false;
         size_t read;
+#if HAVE_FD
+        if (blocks != 0 && block_size >= 0) { // claim whole blocks, no lock
+            if (new_block_start > 0) {
+               _sb->pubseekoff(new_block_start, std::ios_base::beg,
+                                                std::ios_base::in);
+               new_block_start = 0;
+               block_next = 0;
+               end = false;
+            }
+            std::streamoff start;
+            std::streamsize got = blocks->claim_block(start, in.buf, in.size);
+            if (got < 0) { // not a sized block, read it the usual way
+                blocks = 0;
+                leftovers->len = 0;
+                read_decompress();
+                return;
+            }
+            block_start = start;
+            block_size = got;
+            reinit_decompressor = (block_next != block_start);
+            block_next = block_start + std::streamoff(got + 4);
+            read = (size_t)got;
+        }
+        else
+#endif
         if (block_size < 0) { // stream has no blocksize markers
             MUTEX_LOCK
             if (new_block_start > 0) {
@@ -2,9 +2,28 @@
 #include <xstream/posix.h>
 #include <xstream/fd.h>
 
+#include <xstream/except/posix.h>
+
 #include <algorithm>
 #include <streambuf>
 
+#ifdef _WIN32
+#include <unistd_win32.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <sched.h>
+
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <cstring>
+#endif
+
 #include "debug.h"
 
 #if HAVE_FD
@@ -123,6 +142,534 @@ namespace xstream
                 sync();
             }
         }
+
+        static const size_t preadbuf_len = 64 * 1024;
+
+        preadbuf::preadbuf(int f, bool c)
+        : fdn(f), dest_close(c), rbuf(preadbuf_len)
+        {
+            LOG("fd::preadbuf (int fd)");
+#ifndef _WIN32
+            std::streamoff start = ::lseek(fdn, 0, SEEK_CUR);
+#else
+            std::streamoff start = ::_lseeki64(fdn, 0, SEEK_CUR);
+#endif
+            cursor.store((start < 0)? 0 : start);
+            pthread_mutex_init(&seek_mutex, 0);
+            setg(rbuf.buf, rbuf.buf, rbuf.buf);
+        }
+
+        preadbuf::~preadbuf() {
+            LOG("fd::~preadbuf");
+            pthread_mutex_destroy(&seek_mutex);
+            if (dest_close) {
+#ifndef _WIN32
+                ::close(fdn);
+#else
+                ::_close(fdn);
+#endif
+            }
+        }
+
+        std::streamsize preadbuf::pread(char *buffer, std::streamsize n,
+                                        std::streamoff pos)
+        {
+            LOG("fd::preadbuf::pread " << n << " at " << pos);
+            std::streamsize nread = 0;
+            while (nread < n) {
+#ifndef _WIN32
+                ssize_t count = ::pread(fdn, buffer + nread, n - nread,
+                                        pos + nread);
+#else
+                pthread_mutex_lock(&seek_mutex);
+                ssize_t count = ::_lseeki64(fdn, pos + nread, SEEK_SET);
+                if (count != -1) {
+                    count = ::_read(fdn, buffer + nread, (int)(n - nread));
+                }
+                pthread_mutex_unlock(&seek_mutex);
+#endif
+                if (-1 == count && EINTR == errno) {
+                    continue;
+                }
+                xstream::posix::check_return((int)count, "pread");
+                if (0 == count) {
+                    break;
+                }
+                nread += count;
+            }
+            return nread;
+        }
+
+        std::streamoff preadbuf::current() {
+            std::streamoff pos = cursor.load();
+            while (pos < 0) {
+                sched_yield();
+                pos = cursor.load();
+            }
+            return pos;
+        }
+
+        std::streamoff preadbuf::tell() {
+            return current() - (egptr() - gptr());
+        }
+
+        bool preadbuf::claim(std::streamoff pos, std::streamsize n) {
+            return cursor.compare_exchange_strong(pos, pos + n);
+        }
+
+        bool preadbuf::lock(std::streamoff pos) {
+            // a held cursor is stored as -1 - pos
+            return cursor.compare_exchange_strong(pos, -1 - pos);
+        }
+
+        void preadbuf::unlock(std::streamoff pos) {
+            cursor.store(pos);
+        }
+
+        std::streamsize preadbuf::claim_block(std::streamoff &start,
+                                              char *buffer, std::streamsize n)
+        {
+            LOG("fd::preadbuf::claim_block");
+            unsigned char head[4];
+            std::streamsize size;
+            do {
+                start = current();
+                std::streamsize got = pread((char*)head, 4, start);
+                if (got < 4) {
+                    return 0;
+                }
+                else if (head[0] != 0) {
+                    return -1;
+                }
+                size = (head[1] << 16) + (head[2] << 8) + head[3];
+                if (size > n) {
+                    return -1;
+                }
+            } while (!claim(start, size + 4));
+            return pread(buffer, size, start + 4);
+        }
+
+        int preadbuf::underflow() {
+            LOG("fd::preadbuf::underflow");
+            std::streamoff pos = current();
+            std::streamsize nread = pread(rbuf.buf, rbuf.size, pos);
+            cursor.store(pos + nread);
+            setg(rbuf.buf, rbuf.buf, rbuf.buf + nread);
+            if (0 == nread) {
+                return eof;
+            } else {
+                return static_cast<unsigned char>(*rbuf.buf);
+            }
+        }
+
+        std::streamsize preadbuf::xsgetn(char *buffer, std::streamsize n) {
+            LOG("fd::preadbuf::xsgetn " << n);
+            std::streamsize av = egptr() - gptr();
+            if (av > n) {
+                av = n;
+            }
+            std::copy(gptr(), gptr() + av, buffer);
+            gbump((int)av);
+            std::streamsize nread = av;
+            if (nread < n) {
+                // claim the whole range first, then give back the part
+                // beyond end of file if nobody has claimed more since
+                std::streamoff pos;
+                do {
+                    pos = current();
+                } while (!claim(pos, n - nread));
+                std::streamsize got = pread(buffer + nread, n - nread, pos);
+                std::streamoff end = pos + (n - nread);
+                cursor.compare_exchange_strong(end, pos + got);
+                nread += got;
+            }
+            LOG("\tread " << nread);
+            return nread;
+        }
+
+        std::streampos preadbuf::seekoff(std::streamoff off,
+                                         std::ios_base::seekdir dir,
+                                         std::ios_base::openmode which)
+        {
+            LOG("fd::preadbuf::seekoff " << off << "," << dir);
+            if (dir == std::ios_base::cur) {
+                if (off == 0) {
+                    return tell();
+                }
+                return seekpos(tell() + off, which);
+            }
+            else if (dir == std::ios_base::beg) {
+                return seekpos(off, which);
+            }
+#ifndef _WIN32
+            std::streamoff end = ::lseek(fdn, 0, SEEK_END);
+#else
+            std::streamoff end = ::_lseeki64(fdn, 0, SEEK_END);
+#endif
+            if (end < 0) {
+                return std::streampos(std::streamoff(-1));
+            }
+            return seekpos(end + off, which);
+        }
+
+        std::streampos preadbuf::seekpos(std::streampos pos,
+                                         std::ios_base::openmode which)
+        {
+            LOG("fd::preadbuf::seekpos " << pos);
+            if ((which & std::ios_base::in) == 0 || std::streamoff(pos) < 0) {
+                return std::streampos(std::streamoff(-1));
+            }
+            setg(rbuf.buf, rbuf.buf, rbuf.buf);
+            cursor.store(pos);
+            return pos;
+        }
+
+#if HAVE_IO_URING
+
+        // The ring is driven through the raw system calls so that no
+        // dependency on liburing is needed. Only the small subset used
+        // here is wrapped: readv submissions and their completions.
+
+        struct uringbuf::ring {
+            int fd;
+            void *sq_ptr;
+            void *cq_ptr;
+            size_t sq_len;
+            size_t cq_len;
+            struct io_uring_sqe *sqes;
+            size_t sqes_len;
+            unsigned *sq_head;
+            unsigned *sq_tail;
+            unsigned *sq_mask;
+            unsigned *sq_array;
+            unsigned *cq_head;
+            unsigned *cq_tail;
+            unsigned *cq_mask;
+            struct io_uring_cqe *cqes;
+            std::vector<struct iovec> iov;
+
+            static ring *open(unsigned entries);
+            void close();
+            int enter(unsigned submit, unsigned wait);
+        };
+
+        uringbuf::ring *uringbuf::ring::open(unsigned entries)
+        {
+            struct io_uring_params p;
+            memset(&p, 0, sizeof(p));
+            int rfd = (int)syscall(__NR_io_uring_setup, entries, &p);
+            if (rfd < 0) {
+                LOG("fd::uringbuf io_uring_setup failed, errno " << errno);
+                return 0;
+            }
+            ring *r = new ring;
+            r->fd = rfd;
+            r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+            if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                r->sq_len = r->cq_len = std::max(r->sq_len, r->cq_len);
+            }
+            r->sq_ptr = mmap(0, r->sq_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQ_RING);
+            r->cq_ptr = MAP_FAILED;
+            if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                r->cq_ptr = r->sq_ptr;
+            }
+            else if (r->sq_ptr != MAP_FAILED) {
+                r->cq_ptr = mmap(0, r->cq_len, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_CQ_RING);
+            }
+            r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+            r->sqes = (struct io_uring_sqe*)MAP_FAILED;
+            if (r->sq_ptr != MAP_FAILED && r->cq_ptr != MAP_FAILED) {
+                r->sqes = (struct io_uring_sqe*)mmap(0, r->sqes_len,
+                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          rfd, IORING_OFF_SQES);
+            }
+            if (r->sqes == MAP_FAILED) {
+                LOG("fd::uringbuf ring mmap failed, errno " << errno);
+                if (r->sq_ptr != MAP_FAILED) {
+                    if (r->cq_ptr != r->sq_ptr && r->cq_ptr != MAP_FAILED)
+                        munmap(r->cq_ptr, r->cq_len);
+                    munmap(r->sq_ptr, r->sq_len);
+                }
+                ::close(rfd);
+                delete r;
+                return 0;
+            }
+            char *sq = (char*)r->sq_ptr;
+            char *cq = (char*)r->cq_ptr;
+            r->sq_head = (unsigned*)(sq + p.sq_off.head);
+            r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+            r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+            r->sq_array = (unsigned*)(sq + p.sq_off.array);
+            r->cq_head = (unsigned*)(cq + p.cq_off.head);
+            r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+            r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+            r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+            r->iov.resize(entries);
+            return r;
+        }
+
+        void uringbuf::ring::close()
+        {
+            munmap(sqes, sqes_len);
+            if (cq_ptr != sq_ptr)
+                munmap(cq_ptr, cq_len);
+            munmap(sq_ptr, sq_len);
+            ::close(fd);
+        }
+
+        int uringbuf::ring::enter(unsigned submit, unsigned wait)
+        {
+            int ret;
+            do {
+                ret = (int)syscall(__NR_io_uring_enter, fd, submit, wait,
+                                   (wait > 0)? IORING_ENTER_GETEVENTS : 0, 0, 0);
+            } while (-1 == ret && EINTR == errno);
+            return ret;
+        }
+
+        uringbuf::uringbuf(int f, bool c, int depth, std::streamsize chunk)
+        : fdn(f), dest_close(c), uring(0), chunk_size(chunk), window(1),
+          head(0), queued(0), current(false), end_offset(-1)
+        {
+            LOG("fd::uringbuf (int fd)");
+            depth = std::max(depth, 1);
+            slots.resize(depth);
+            for (int n=0; n < depth; ++n) {
+                slots[n].buf = new char[chunk_size];
+                slots[n].offset = 0;
+                slots[n].result = 0;
+                slots[n].busy = false;
+                slots[n].submitted = false;
+            }
+            uring = ring::open(depth);
+            next_offset = ::lseek(fdn, 0, SEEK_CUR);
+            if (next_offset < 0) {
+                next_offset = 0;
+            }
+            get_offset = next_offset;
+            setg(0, 0, 0);
+        }
+
+        uringbuf::~uringbuf()
+        {
+            LOG("fd::~uringbuf");
+            for (int n=0; n < (int)slots.size(); ++n) {
+                if (reap(n)) {
+                    delete [] slots[n].buf;
+                }
+                else {
+                    LOG("fd::~uringbuf leaking chunk " << n << " still in flight");
+                }
+            }
+            if (uring != 0) {
+                uring->close();
+                delete uring;
+            }
+            if (dest_close) {
+                ::close(fdn);
+            }
+        }
+
+        void uringbuf::submit(int n)
+        {
+            chunk_slot &slot = slots[n];
+            slot.offset = next_offset;
+            slot.result = 0;
+            slot.submitted = true;
+            next_offset += chunk_size;
+            if (uring != 0) {
+                unsigned tail = *uring->sq_tail;
+                unsigned index = tail & *uring->sq_mask;
+                struct io_uring_sqe *sqe = &uring->sqes[index];
+                memset(sqe, 0, sizeof(*sqe));
+                uring->iov[n].iov_base = slot.buf;
+                uring->iov[n].iov_len = chunk_size;
+                sqe->opcode = IORING_OP_READV;
+                sqe->fd = fdn;
+                sqe->addr = (unsigned long)&uring->iov[n];
+                sqe->len = 1;
+                sqe->off = slot.offset;
+                sqe->user_data = n;
+                uring->sq_array[index] = index;
+                __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+                if (uring->enter(1, 0) == 1) {
+                    slot.busy = true;
+                    return;
+                }
+                // the ring is unusable, carry on without it if possible
+                LOG("fd::uringbuf io_uring_enter failed, errno " << errno);
+                for (int i=0; i < (int)slots.size(); ++i) {
+                    if (slots[i].busy) {
+                        xstream::posix::check_return(-1, "io_uring_enter");
+                    }
+                }
+                uring->close();
+                delete uring;
+                uring = 0;
+            }
+            ssize_t count;
+            do {
+                count = ::pread(fdn, slot.buf, chunk_size, slot.offset);
+            } while (-1 == count && EINTR == errno);
+            xstream::posix::check_return((int)count, "pread");
+            slot.result = count;
+        }
+
+        bool uringbuf::reap(int n)
+        {
+            while (slots[n].busy) {
+                unsigned chead = *uring->cq_head;
+                if (chead == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+                    if (uring->enter(0, 1) < 0) {
+                        return false;
+                    }
+                    continue;
+                }
+                struct io_uring_cqe *cqe = &uring->cqes[chead & *uring->cq_mask];
+                chunk_slot &done = slots[cqe->user_data];
+                done.result = cqe->res;
+                done.busy = false;
+                __atomic_store_n(uring->cq_head, chead + 1, __ATOMIC_RELEASE);
+            }
+            return true;
+        }
+
+        void uringbuf::complete(int n)
+        {
+            if (! reap(n)) {
+                xstream::posix::check_return(-1, "io_uring_enter");
+            }
+            chunk_slot &slot = slots[n];
+            if (slot.result < 0) {
+                errno = (int)-slot.result;
+                slot.result = 0;
+                xstream::posix::check_return(-1, "io_uring read");
+            }
+            // short reads are only expected at end of file, but finish
+            // the chunk with pread in case the kernel stopped early
+            while (slot.result > 0 && slot.result < chunk_size) {
+                ssize_t count = ::pread(fdn, slot.buf + slot.result,
+                                        chunk_size - slot.result,
+                                        slot.offset + slot.result);
+                if (-1 == count && EINTR == errno) {
+                    continue;
+                }
+                xstream::posix::check_return((int)count, "pread");
+                if (0 == count) {
+                    break;
+                }
+                slot.result += count;
+            }
+            if (slot.result < chunk_size &&
+                (end_offset < 0 || slot.offset + slot.result < end_offset))
+            {
+                end_offset = slot.offset + slot.result;
+            }
+        }
+
+        void uringbuf::restart(std::streamoff pos)
+        {
+            // the queued chunks are dropped, so only wait for the kernel
+            // to let go of their buffers without looking at the results
+            for (int n=0; n < (int)slots.size(); ++n) {
+                if (slots[n].submitted && ! reap(n)) {
+                    xstream::posix::check_return(-1, "io_uring_enter");
+                }
+                slots[n].submitted = false;
+            }
+            head = 0;
+            queued = 0;
+            current = false;
+            window = 1;
+            next_offset = pos;
+            get_offset = pos;
+            end_offset = -1;
+            setg(0, 0, 0);
+        }
+
+        int uringbuf::underflow()
+        {
+            LOG("fd::uringbuf::underflow");
+            if (current) {
+                chunk_slot &slot = slots[head];
+                get_offset = slot.offset + slot.result;
+                slot.submitted = false;
+                head = (head + 1) % (int)slots.size();
+                --queued;
+                current = false;
+                window = std::min(window * 2, (int)slots.size());
+            }
+            while (queued < window &&
+                   (end_offset < 0 || next_offset < end_offset))
+            {
+                submit((head + queued) % (int)slots.size());
+                ++queued;
+            }
+            if (queued == 0) {
+                setg(0, 0, 0);
+                return eof;
+            }
+            complete(head);
+            chunk_slot &slot = slots[head];
+            if (0 == slot.result) { // read ahead past end of file
+                setg(0, 0, 0);
+                return eof;
+            }
+            current = true;
+            setg(slot.buf, slot.buf, slot.buf + slot.result);
+            return static_cast<unsigned char>(*slot.buf);
+        }
+
+        std::streampos uringbuf::seekoff(std::streamoff off,
+                                         std::ios_base::seekdir dir,
+                                         std::ios_base::openmode which)
+        {
+            LOG("fd::uringbuf::seekoff " << off << "," << dir);
+            std::streamoff pos = (current)?
+                                 slots[head].offset + (gptr() - eback()) :
+                                 get_offset;
+            if (dir == std::ios_base::cur) {
+                if (off == 0) {
+                    return pos;
+                }
+                return seekpos(pos + off, which);
+            }
+            else if (dir == std::ios_base::beg) {
+                return seekpos(off, which);
+            }
+            std::streamoff end = ::lseek(fdn, 0, SEEK_END);
+            if (end < 0) {
+                return std::streampos(std::streamoff(-1));
+            }
+            return seekpos(end + off, which);
+        }
+
+        std::streampos uringbuf::seekpos(std::streampos pos,
+                                         std::ios_base::openmode which)
+        {
+            LOG("fd::uringbuf::seekpos " << pos);
+            std::streamoff off = pos;
+            if ((which & std::ios_base::in) == 0 || off < 0) {
+                return std::streampos(std::streamoff(-1));
+            }
+            if (current && off >= slots[head].offset &&
+                off < slots[head].offset + slots[head].result)
+            {
+                // still inside the chunk being read, keep the read-ahead
+                char *start = slots[head].buf;
+                setg(start, start + (off - slots[head].offset),
+                     start + slots[head].result);
+            }
+            else {
+                restart(off);
+            }
+            return pos;
+        }
+
+#endif
     }    //namespace fd
 }    //namespace xstream
 